@@ -0,0 +1,247 @@
+#include <PinChangeInterrupt.h>
+
+/*
+ * PPM generator driven by the binary protocol of servo_serial_node (src/nodes/servo_protocol.h)
+ * Frame : | 0xA5 | 0x5A | type | seq | length | payload | crc16 (LE) |, CRC-16/CCITT-FALSE over type..payload
+ * COMMAND  (0x01) : 4 x uint16 servo pulses [us]
+ * FEEDBACK (0x02) : uint8 acknowledged seq, 4 x uint16 measured RC pulses [us]
+ * Every command is applied and acknowledged immediately, feedback is also sent every FEEDBACK_PERIOD ms
+ */
+
+#define CHANNEL_NUMBER 6            //number of chanels in DX6i
+#define CHANNEL_DEFAULT_VALUE 1500  //default servo value
+#define THROTTLE_DEFAULT_VALUE 1100  //default throttle value
+#define FRAME_LENGTH 22000           //PPM frame length in microseconds 
+#define PULSE_LENGTH 300             //pulse length
+#define onState 1                    //polarity of the pulses: 1 is positive, 0 is negative
+#define sigPin 13                    //PPM signal output pin on the arduino
+
+#define BAUD_RATE 250000
+#define FEEDBACK_PERIOD 20
+#define SYNC0 0xA5
+#define SYNC1 0x5A
+#define COMMAND 0x01
+#define FEEDBACK 0x02
+#define MAX_PAYLOAD 32
+#define NUM_SERVOS 4
+
+/*
+ * Define pins used to provide RC PWM signal to Arduino
+ * Pins 8, 9 and 10 are used since they work on both ATMega328 and 
+ * ATMega32u4 board. So this code will work on Uno/Mini/Nano/Micro/Leonardo
+ * See PinChangeInterrupt documentation for usable pins on other boards
+ */
+const byte channel_pin[] = {8, 9, 10, 11};
+volatile unsigned long rising_start[] = {0, 0, 0, 0};
+volatile long channel_length[] = {0, 0, 0, 0};
+
+// store ppm signals
+volatile int ppm[CHANNEL_NUMBER];
+
+// protocol state
+enum ParserState {WAIT_SYNC0, WAIT_SYNC1, TYPE, SEQ, LENGTH, PAYLOAD, CRC_LOW, CRC_HIGH};
+ParserState parser_state = WAIT_SYNC0;
+byte frame_type, frame_seq, frame_length, frame_index;
+byte frame_payload[MAX_PAYLOAD];
+uint16_t frame_crc;
+byte last_ack = 0;
+unsigned long last_feedback = 0;
+
+uint16_t crc16(const byte *data, byte size, uint16_t crc)
+{
+  for (byte i = 0; i < size; ++i)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (byte bit = 0; bit < 8; ++bit)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  }
+  return crc;
+}
+
+void sendFeedback()
+{
+  byte frame[5 + 9 + 2];
+  frame[0] = SYNC0;
+  frame[1] = SYNC1;
+  frame[2] = FEEDBACK;
+  frame[3] = last_ack;
+  frame[4] = 9;
+  frame[5] = last_ack;
+  for (byte i = 0; i < NUM_SERVOS; ++i)
+  {
+    noInterrupts();
+    uint16_t pulse = (uint16_t)channel_length[i];
+    interrupts();
+    frame[6 + 2 * i] = pulse & 0xFF;
+    frame[7 + 2 * i] = pulse >> 8;
+  }
+  uint16_t crc = crc16(frame + 2, 3 + 9, 0xFFFF);
+  frame[14] = crc & 0xFF;
+  frame[15] = crc >> 8;
+  Serial.write(frame, sizeof(frame));
+  last_feedback = millis();
+}
+
+void handleFrame()
+{
+  if ((frame_type != COMMAND) || (frame_length != 2 * NUM_SERVOS))
+    return;
+
+  //update first 4 channels in ppm
+  for (byte i = 0; i < NUM_SERVOS; ++i)
+  {
+    int pulse = frame_payload[2 * i] | (frame_payload[2 * i + 1] << 8);
+    noInterrupts();
+    ppm[i] = pulse;
+    interrupts();
+  }
+  last_ack = frame_seq;
+  sendFeedback();
+}
+
+void parseByte(byte value)
+{
+  switch (parser_state)
+  {
+    case WAIT_SYNC0:
+      if (value == SYNC0) parser_state = WAIT_SYNC1;
+      break;
+    case WAIT_SYNC1:
+      parser_state = (value == SYNC1) ? TYPE : ((value == SYNC0) ? WAIT_SYNC1 : WAIT_SYNC0);
+      break;
+    case TYPE:
+      frame_type = value;
+      parser_state = SEQ;
+      break;
+    case SEQ:
+      frame_seq = value;
+      parser_state = LENGTH;
+      break;
+    case LENGTH:
+      frame_length = value;
+      frame_index = 0;
+      if (value > MAX_PAYLOAD) parser_state = WAIT_SYNC0;
+      else parser_state = (value == 0) ? CRC_LOW : PAYLOAD;
+      break;
+    case PAYLOAD:
+      frame_payload[frame_index++] = value;
+      if (frame_index == frame_length) parser_state = CRC_LOW;
+      break;
+    case CRC_LOW:
+      frame_crc = value;
+      parser_state = CRC_HIGH;
+      break;
+    case CRC_HIGH:
+    {
+      frame_crc |= (uint16_t)value << 8;
+      parser_state = WAIT_SYNC0;
+      byte header[3] = {frame_type, frame_seq, frame_length};
+      if (crc16(frame_payload, frame_length, crc16(header, 3, 0xFFFF)) == frame_crc)
+        handleFrame();
+      break;
+    }
+  }
+}
+
+void setup() 
+{
+  pinMode(channel_pin[0], INPUT);
+  pinMode(channel_pin[1], INPUT);
+  pinMode(channel_pin[2], INPUT);
+  pinMode(channel_pin[3], INPUT);
+  
+  attachPinChangeInterrupt(digitalPinToPinChangeInterrupt(channel_pin[0]), onRising0, CHANGE);
+  attachPinChangeInterrupt(digitalPinToPinChangeInterrupt(channel_pin[1]), onRising1, CHANGE);
+  attachPinChangeInterrupt(digitalPinToPinChangeInterrupt(channel_pin[2]), onRising2, CHANGE);
+  attachPinChangeInterrupt(digitalPinToPinChangeInterrupt(channel_pin[3]), onRising3, CHANGE);
+
+  // PPM generation set up
+  for(int i=0; i<CHANNEL_NUMBER; i++)
+  {
+      ppm[i]= CHANNEL_DEFAULT_VALUE;
+  }
+  ppm[0] = THROTTLE_DEFAULT_VALUE;
+
+  pinMode(sigPin, OUTPUT);
+  digitalWrite(sigPin, !onState);  //set the PPM signal pin to the default state (off)
+
+  noInterrupts();
+  TCCR1A = 0;               // set entire TCCR1 register to 0
+  TCCR1B = 0;
+  OCR1A = 100;              // compare match register, change this
+  TCCR1B |= (1 << WGM12);   // turn on CTC mode
+  TCCR1B |= (1 << CS11);    // 8 prescaler: 0,5 microseconds at 16mhz
+  TIMSK1 |= (1 << OCIE1A);  // enable timer compare interrupt
+  interrupts();
+
+  Serial.begin(BAUD_RATE);
+}
+
+
+void processPin(byte pin) {
+uint8_t trigger = getPinChangeInterruptTrigger(digitalPinToPCINT(channel_pin[pin]));
+if(trigger == RISING) {
+    rising_start[pin] = micros();
+  } else if(trigger == FALLING) {
+    channel_length[pin] = micros() - rising_start[pin];
+  }
+}
+
+void onRising0(void) {
+processPin(0);
+}
+void onRising1(void) {
+processPin(1);
+}
+void onRising2(void) {
+processPin(2);
+}
+void onRising3(void) {
+  processPin(3);
+}
+
+void loop() 
+{
+  // no delay : commands are applied as soon as they are received
+  while (Serial.available() > 0)
+  {
+    parseByte(Serial.read());
+  }
+
+  if (millis() - last_feedback >= FEEDBACK_PERIOD)
+  {
+    sendFeedback();
+  }
+}
+
+ISR(TIMER1_COMPA_vect)
+{  
+  static boolean state = true;
+  TCNT1 = 0;
+  if (state)
+  {  //start pulse
+    digitalWrite(sigPin, onState);
+    OCR1A = PULSE_LENGTH * 2;
+    state = false;
+  }
+  else
+  {  //end pulse and calculate when to start the next pulse
+    static byte cur_chan_numb;
+    static unsigned int calc_rest;
+    digitalWrite(sigPin, !onState);
+    state = true;
+    if(cur_chan_numb >= CHANNEL_NUMBER)
+    {
+      cur_chan_numb = 0;
+      calc_rest = calc_rest + PULSE_LENGTH; 
+      OCR1A = (FRAME_LENGTH - calc_rest) * 2;
+      calc_rest = 0;
+    }
+    else
+    {
+      OCR1A = (ppm[cur_chan_numb] - PULSE_LENGTH) * 2;
+      calc_rest = calc_rest + ppm[cur_chan_numb];
+      cur_chan_numb++;
+    }     
+  }
+}
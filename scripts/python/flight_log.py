@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+"""Memory-mapped reader for the binary columnar flight logs written by simple_logger (src/nodes/flight_log.h)
+
+    log = FlightLog('kite_state.oklog')
+    t, x = log['t'], log['x']         # numpy arrays
+    data = log.array()                # rows x columns
+"""
+import struct
+import sys
+
+import numpy as np
+
+MAGIC = b'OKFLOG01'
+BLOCK_MAGIC = 0x4B4C4F42
+NAME_SIZE = 32
+HEADER = struct.Struct('<8sIIII32s')
+BLOCK = struct.Struct('<II')
+
+
+class FlightLog(object):
+    def __init__(self, filename):
+        self.raw = np.memmap(filename, dtype=np.uint8, mode='r')
+        magic, header_size, num_columns, self.block_rows, _, stream = HEADER.unpack_from(self.raw, 0)
+        if magic != MAGIC or header_size != HEADER.size + NAME_SIZE * num_columns:
+            raise ValueError('not a flight log: ' + filename)
+
+        self.stream = stream.split(b'\0', 1)[0].decode()
+        self.columns = []
+        for c in range(num_columns):
+            name = bytes(self.raw[HEADER.size + c * NAME_SIZE: HEADER.size + (c + 1) * NAME_SIZE])
+            self.columns.append(name.split(b'\0', 1)[0].decode())
+
+        # block index : (offset of the data, rows), a truncated last block is ignored
+        self.blocks = []
+        offset = header_size
+        while offset + BLOCK.size <= self.raw.size:
+            magic, rows = BLOCK.unpack_from(self.raw, offset)
+            size = 8 * num_columns * rows
+            if magic != BLOCK_MAGIC or offset + BLOCK.size + size > self.raw.size:
+                break
+            self.blocks.append((offset + BLOCK.size, rows))
+            offset += BLOCK.size + size
+        self.rows = sum(rows for _, rows in self.blocks)
+
+    def column(self, index):
+        parts = [np.frombuffer(self.raw, dtype='<f8', count=rows, offset=offset + 8 * index * rows)
+                 for offset, rows in self.blocks]
+        return np.concatenate(parts) if parts else np.zeros(0)
+
+    def __getitem__(self, name):
+        return self.column(self.columns.index(name))
+
+    def array(self):
+        return np.column_stack([self.column(c) for c in range(len(self.columns))])
+
+
+if __name__ == '__main__':
+    for filename in sys.argv[1:]:
+        log = FlightLog(filename)
+        print('%s : stream %s, %d rows, columns %s' % (filename, log.stream, log.rows, ' '.join(log.columns)))
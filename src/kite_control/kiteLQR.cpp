@@ -0,0 +1,160 @@
+#include "kiteLQR.h"
+#include "yaml-cpp/yaml.h"
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    std::vector<double> to_vector(const Eigen::MatrixXd &mat)
+    {
+        return std::vector<double>(mat.data(), mat.data() + mat.size());
+    }
+
+    Eigen::MatrixXd from_node(const YAML::Node &node, const int &rows, const int &cols)
+    {
+        std::vector<double> data = node.as<std::vector<double>>();
+        if(data.size() != static_cast<size_t>(rows * cols))
+            throw std::runtime_error("KiteLQR: inconsistent matrix size in gain table file");
+
+        return Eigen::MatrixXd::Map(data.data(), rows, cols);
+    }
+}
+
+KiteLQR::KiteLQR() : m_theta_min(0), m_theta_max(2 * M_PI)
+{
+}
+
+KiteLQR::KiteLQR(const std::string &filename) : KiteLQR()
+{
+    load(filename);
+}
+
+void KiteLQR::allocate()
+{
+    const int nu = dim_u();
+    m_x.resize(DIM_X);
+    m_u.resize(nu);
+    m_e.resize(DIM_E);
+    m_gain.resize(nu, DIM_E);
+
+    if(m_lbu.size() != nu)
+    {
+        m_lbu = Eigen::VectorXd::Constant(nu, -std::numeric_limits<double>::infinity());
+        m_ubu = Eigen::VectorXd::Constant(nu, std::numeric_limits<double>::infinity());
+    }
+}
+
+void KiteLQR::setTable(const double &theta_min, const double &theta_max, const Eigen::MatrixXd &x_ref,
+                       const Eigen::MatrixXd &u_ref, const std::vector<Eigen::MatrixXd> &gains, const std::vector<bool> &stable)
+{
+    const Eigen::Index N = x_ref.cols();
+    if((x_ref.rows() != DIM_X) || (u_ref.cols() != N) || (gains.size() != static_cast<size_t>(N)) || (stable.size() != gains.size()))
+        throw std::runtime_error("KiteLQR: inconsistent gain table dimensions");
+
+    m_theta_min = theta_min;
+    m_theta_max = theta_max;
+    m_x_ref = x_ref;
+    m_u_ref = u_ref;
+    m_stable = stable;
+    m_K.resize(u_ref.rows(), DIM_E * N);
+    for(Eigen::Index i = 0; i < N; ++i)
+        m_K.block(0, DIM_E * i, u_ref.rows(), DIM_E) = gains[i];
+
+    /** q and -q are the same attitude : keep neighbouring references in the same hemisphere for interpolation */
+    for(Eigen::Index i = 1; i < N; ++i)
+    {
+        if(m_x_ref.col(i).tail<4>().dot(m_x_ref.col(i - 1).tail<4>()) < 0)
+            m_x_ref.col(i).tail<4>() *= -1;
+    }
+
+    allocate();
+}
+
+bool KiteLQR::evaluate(const Eigen::Ref<const Eigen::VectorXd> &state, const double &theta, Eigen::Ref<Eigen::VectorXd> control)
+{
+    if(empty())
+        return false;
+
+    /** neighbouring grid points on the closed path */
+    const int N = size();
+    double s = (theta - m_theta_min) / (m_theta_max - m_theta_min);
+    s -= std::floor(s);
+    const double position = s * N;
+    const int i = std::min(N - 1, static_cast<int>(position));
+    const int j = (i + 1) % N;
+    const double a = position - i;
+
+    /** no allocations : workspace is reserved on setTable/load */
+    m_x = (1 - a) * m_x_ref.col(i) + a * m_x_ref.col(j);
+    if(m_x_ref.col(i).tail<4>().dot(m_x_ref.col(j).tail<4>()) < 0)
+        m_x.tail<4>() = (1 - a) * m_x_ref.col(i).tail<4>() - a * m_x_ref.col(j).tail<4>();
+    m_x.tail<4>().normalize();
+    m_u = (1 - a) * m_u_ref.col(i) + a * m_u_ref.col(j);
+    m_gain = (1 - a) * m_K.block(0, DIM_E * i, dim_u(), DIM_E) + a * m_K.block(0, DIM_E * j, dim_u(), DIM_E);
+
+    /** error state, attitude error from dq = q_ref^-1 * q */
+    m_e.head<9>() = state.head<9>() - m_x.head<9>();
+    const Eigen::Vector4d q_ref = m_x.tail<4>();
+    const Eigen::Vector4d q = state.tail<4>();
+    const double dq0 = q_ref(0) * q(0) + q_ref.tail<3>().dot(q.tail<3>());
+    Eigen::Vector3d dq = q_ref(0) * q.tail<3>() - q(0) * q_ref.tail<3>() - q_ref.tail<3>().cross(q.tail<3>());
+    m_e.tail<3>() = (dq0 < 0) ? (-2.0 * dq) : (2.0 * dq);
+
+    control = m_u;
+    control.noalias() -= m_gain * m_e;
+    control = control.cwiseMax(m_lbu).cwiseMin(m_ubu);
+
+    return m_stable[i] && m_stable[j];
+}
+
+void KiteLQR::save(const std::string &filename) const
+{
+    std::vector<int> stable(m_stable.begin(), m_stable.end());
+
+    YAML::Emitter out;
+    out << YAML::BeginMap;
+    out << YAML::Key << "dim_u"      << YAML::Value << dim_u();
+    out << YAML::Key << "num_points" << YAML::Value << size();
+    out << YAML::Key << "theta_min"  << YAML::Value << m_theta_min;
+    out << YAML::Key << "theta_max"  << YAML::Value << m_theta_max;
+    out << YAML::Key << "stable"     << YAML::Value << YAML::Flow << stable;
+    out << YAML::Key << "lbu"        << YAML::Value << YAML::Flow << to_vector(m_lbu);
+    out << YAML::Key << "ubu"        << YAML::Value << YAML::Flow << to_vector(m_ubu);
+    out << YAML::Key << "x_ref"      << YAML::Value << YAML::Flow << to_vector(m_x_ref);
+    out << YAML::Key << "u_ref"      << YAML::Value << YAML::Flow << to_vector(m_u_ref);
+    out << YAML::Key << "K"          << YAML::Value << YAML::Flow << to_vector(m_K);
+    out << YAML::EndMap;
+
+    std::ofstream fout(filename);
+    fout << out.c_str();
+}
+
+void KiteLQR::load(const std::string &filename)
+{
+    YAML::Node config = YAML::LoadFile(filename);
+    int nu = config["dim_u"].as<int>();
+    int N  = config["num_points"].as<int>();
+
+    m_theta_min = config["theta_min"].as<double>();
+    m_theta_max = config["theta_max"].as<double>();
+    std::vector<int> stable = config["stable"].as<std::vector<int>>();
+    if(stable.size() != static_cast<size_t>(N))
+        throw std::runtime_error("KiteLQR: inconsistent number of grid points in gain table file");
+    m_stable.assign(stable.begin(), stable.end());
+
+    m_lbu   = from_node(config["lbu"], nu, 1);
+    m_ubu   = from_node(config["ubu"], nu, 1);
+    m_x_ref = from_node(config["x_ref"], DIM_X, N);
+    m_u_ref = from_node(config["u_ref"], nu, N);
+    m_K     = from_node(config["K"], nu, DIM_E * N);
+
+    int num_unstable = static_cast<int>(std::count(m_stable.begin(), m_stable.end(), false));
+    if(num_unstable > 0)
+        std::cerr << "KiteLQR: " << num_unstable << " of " << N << " linearizations in " << filename << " are not stabilized \n";
+
+    allocate();
+}
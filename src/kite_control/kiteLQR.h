@@ -0,0 +1,56 @@
+#ifndef KITELQR_H
+#define KITELQR_H
+
+#include "eigen3/Eigen/Dense"
+#include <string>
+#include <vector>
+
+/** Gain-scheduled LQR along the reference path, generated offline by lqr_generator:
+ *  u = sat( u_ref(theta) - K(theta) * e ), e = [v - v_ref, w - w_ref, r - r_ref, dtheta] - 12 error states,
+ *  dtheta = 2 * vec(q_ref^-1 * q) - attitude error. References and gains are tabulated on a uniform grid
+ *  of the path parameter and interpolated linearly, the path is assumed closed.
+ *  Depends only on Eigen and yaml-cpp, evaluation does not allocate : backup for the NMPF.
+ */
+class KiteLQR
+{
+public:
+    enum {DIM_X = 13, DIM_E = 12};
+
+    KiteLQR();
+    KiteLQR(const std::string &filename);
+    virtual ~KiteLQR(){}
+
+    /** x_ref : [13 x N] reference states, u_ref : [nu x N] controls, gains : N [nu x 12] matrices,
+     *  stable : closed loop stability of each linearization, grid points theta_min + i * (theta_max - theta_min) / N */
+    void setTable(const double &theta_min, const double &theta_max, const Eigen::MatrixXd &x_ref,
+                  const Eigen::MatrixXd &u_ref, const std::vector<Eigen::MatrixXd> &gains, const std::vector<bool> &stable);
+
+    /** returns false if the neighbouring linearizations are not stable and the control should not be trusted */
+    bool evaluate(const Eigen::Ref<const Eigen::VectorXd> &state, const double &theta, Eigen::Ref<Eigen::VectorXd> control);
+
+    void setControlBounds(const Eigen::VectorXd &lbu, const Eigen::VectorXd &ubu){m_lbu = lbu; m_ubu = ubu;}
+
+    void save(const std::string &filename) const;
+    void load(const std::string &filename);
+
+    int dim_u() const {return static_cast<int>(m_u_ref.rows());}
+    int size() const {return static_cast<int>(m_x_ref.cols());}
+    bool empty() const {return m_x_ref.cols() == 0;}
+
+private:
+    double m_theta_min, m_theta_max;
+    /** one column per grid point, gains stacked column-wise : [nu x 12 * N] */
+    Eigen::MatrixXd m_x_ref, m_u_ref, m_K;
+    std::vector<bool> m_stable;
+
+    /** control saturation */
+    Eigen::VectorXd m_lbu, m_ubu;
+
+    /** evaluation workspace */
+    Eigen::VectorXd m_x, m_u, m_e;
+    Eigen::MatrixXd m_gain;
+
+    void allocate();
+};
+
+#endif // KITELQR_H
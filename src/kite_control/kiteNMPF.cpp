@@ -2,6 +2,10 @@
 #include "kiteNMPF.h"
 #include "utility"
 #include "pseudospectral/chebyshev.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 using namespace casadi;
 
@@ -14,6 +18,8 @@ const DM KiteNMPF::DEFAULT_UBX = DM::inf(15);
 const DM KiteNMPF::DEFAULT_LBU = -DM::inf(4);
 const DM KiteNMPF::DEFAULT_UBU = DM::inf(4);
 
+const int KiteNMPF::PATH_INDEX_SIZE = 256;
+
 
 KiteNMPF::KiteNMPF(std::shared_ptr<KiteDynamics> _Kite, const Function &_Path) : Kite(std::move(_Kite))
 {
@@ -44,6 +50,206 @@ KiteNMPF::KiteNMPF(std::shared_ptr<KiteDynamics> _Kite, const Function &_Path) :
 
     WARM_START  = false;
     _initialized = false;
+
+    NUM_STARTS  = 1;
+    MS_DEADLINE = 0.05;
+
+    /** @attention : path is assumed to be closed on [0, 2pi] */
+    PathThetaMin = 0.0;
+    PathThetaMax = 2 * M_PI;
+    createPathIndex();
+}
+
+/** persistent workers, each owning one NLP solver instance; a worker that is still busy with a
+ *  previous round when new starts are dispatched is skipped and its late result discarded */
+struct KiteNMPF::MultiStartPool
+{
+    MultiStartPool(const std::vector<Function> &_solvers);
+    ~MultiStartPool();
+
+    void dispatch(const std::vector<DMDict> &_args);
+    /** results of the current round that finished before the deadline */
+    std::vector<int> collect(const std::chrono::steady_clock::time_point &deadline,
+                             std::vector<DMDict> &_results, std::vector<Dict> &_stats);
+    void worker(const int idx);
+
+    std::vector<Function> solvers;
+    std::vector<DMDict> args, results;
+    std::vector<Dict> stats;
+    /** round assigned to / finished by each worker */
+    std::vector<unsigned> ticket, finished;
+    unsigned round;
+    bool shutdown;
+
+    std::mutex mutex;
+    std::condition_variable start_cv, done_cv;
+    std::vector<std::thread> threads;
+};
+
+KiteNMPF::MultiStartPool::MultiStartPool(const std::vector<Function> &_solvers) : solvers(_solvers), round(0), shutdown(false)
+{
+    size_t num_workers = solvers.size();
+    args.resize(num_workers);
+    results.resize(num_workers);
+    stats.resize(num_workers);
+    ticket.assign(num_workers, 0);
+    finished.assign(num_workers, 0);
+
+    for(size_t i = 0; i < num_workers; ++i)
+        threads.emplace_back(&MultiStartPool::worker, this, i);
+}
+
+KiteNMPF::MultiStartPool::~MultiStartPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shutdown = true;
+    }
+    start_cv.notify_all();
+    for(std::thread &thread : threads)
+        thread.join();
+}
+
+void KiteNMPF::MultiStartPool::dispatch(const std::vector<DMDict> &_args)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++round;
+        for(size_t i = 0; i < solvers.size(); ++i)
+        {
+            if(finished[i] != ticket[i])
+                continue;
+            args[i]   = _args[i];
+            ticket[i] = round;
+        }
+    }
+    start_cv.notify_all();
+}
+
+std::vector<int> KiteNMPF::MultiStartPool::collect(const std::chrono::steady_clock::time_point &deadline,
+                                                   std::vector<DMDict> &_results, std::vector<Dict> &_stats)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait_until(lock, deadline, [this]
+    {
+        for(size_t i = 0; i < solvers.size(); ++i)
+            if((ticket[i] == round) && (finished[i] != round))
+                return false;
+        return true;
+    });
+
+    std::vector<int> available;
+    _results.resize(solvers.size());
+    _stats.resize(solvers.size());
+    for(size_t i = 0; i < solvers.size(); ++i)
+    {
+        if((ticket[i] == round) && (finished[i] == round))
+        {
+            _results[i] = results[i];
+            _stats[i]   = stats[i];
+            available.push_back(i);
+        }
+    }
+    return available;
+}
+
+void KiteNMPF::MultiStartPool::worker(const int idx)
+{
+    while(true)
+    {
+        DMDict arg;
+        unsigned my_round;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [this, idx]{return shutdown || (ticket[idx] != finished[idx]);});
+            if(shutdown)
+                return;
+            arg = args[idx];
+            my_round = ticket[idx];
+        }
+
+        DMDict res;
+        Dict st;
+        try
+        {
+            res = solvers[idx](arg);
+            st  = solvers[idx].stats();
+        }
+        catch(std::exception &e)
+        {
+            st["return_status"] = std::string("Exception_Thrown");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results[idx]  = res;
+            stats[idx]    = st;
+            finished[idx] = my_round;
+        }
+        done_cv.notify_all();
+    }
+}
+
+void KiteNMPF::setMultiStart(const int &num_starts, const double &deadline)
+{
+    NUM_STARTS  = std::max(1, num_starts);
+    MS_DEADLINE = deadline;
+}
+
+void KiteNMPF::setPathDomain(const double &theta_min, const double &theta_max)
+{
+    PathThetaMin = theta_min;
+    PathThetaMax = theta_max;
+    createPathIndex();
+}
+
+/** sample the path uniformly in arc length and compile distance derivatives once */
+void KiteNMPF::createPathIndex()
+{
+    /** dense uniform sampling in the path parameter */
+    const int num_dense = 4 * PATH_INDEX_SIZE;
+    const double dtheta = (PathThetaMax - PathThetaMin) / num_dense;
+    Eigen::VectorXd theta_dense(num_dense + 1);
+    Eigen::VectorXd arc_length(num_dense + 1);
+    Eigen::Vector3d point, prev_point;
+
+    for(int i = 0; i <= num_dense; ++i)
+    {
+        theta_dense(i) = PathThetaMin + i * dtheta;
+        std::vector<double> p = PathFunc(DMVector{theta_dense(i)})[0].nonzeros();
+        point = Eigen::Vector3d::Map(p.data());
+        arc_length(i) = (i == 0) ? 0.0 : arc_length(i - 1) + (point - prev_point).norm();
+        prev_point = point;
+    }
+
+    /** resample at equidistant arc-length points */
+    PathIndexTheta.resize(PATH_INDEX_SIZE);
+    PathIndexPoints.resize(3, PATH_INDEX_SIZE);
+    const double ds = arc_length(num_dense) / PATH_INDEX_SIZE;
+    int k = 0;
+    for(int i = 0; i < PATH_INDEX_SIZE; ++i)
+    {
+        double s = i * ds;
+        while((k < num_dense - 1) && (arc_length(k + 1) < s))
+            ++k;
+
+        double segment = arc_length(k + 1) - arc_length(k);
+        double alpha = (segment > 0) ? (s - arc_length(k)) / segment : 0.0;
+        PathIndexTheta(i) = theta_dense(k) + alpha * dtheta;
+
+        std::vector<double> p = PathFunc(DMVector{PathIndexTheta(i)})[0].nonzeros();
+        PathIndexPoints.col(i) = Eigen::Vector3d::Map(p.data());
+    }
+
+    /** squared distance derivatives w.r.t. path parameter */
+    SX theta = SX::sym("theta");
+    SX position = SX::sym("position", 3);
+    SX residual = PathFunc(SXVector{theta})[0] - position;
+    SX distance = 0.5 * SX::dot(residual, residual);
+    SX gradient = SX::gradient(distance, theta);
+    SX hessian  = SX::gradient(gradient, theta);
+
+    PathDistanceDerivatives = Function("path_distance_derivatives", {theta, position}, {gradient, hessian});
 }
 
 
@@ -175,13 +381,23 @@ void KiteNMPF::createNLP()
     NLP["f"] = performance_idx;
     NLP["g"] = diff_constr;
 
-    OPTS["ipopt.linear_solver"]         = "ma97";
-    OPTS["ipopt.print_level"]           = 0;
-    OPTS["ipopt.tol"]                   = 1e-4;
-    OPTS["ipopt.acceptable_tol"]        = 1e-4;
-    OPTS["ipopt.max_iter"]              = 40;
-    OPTS["ipopt.warm_start_init_point"] = "yes";
-    NLP_Solver = nlpsol("solver", "ipopt", NLP, OPTS);
+    NLP_Solver = kmath::nlp_solver("solver", NLP, NLPConfig);
+
+    /** @attention : solver instances run concurrently, the linear solver has to be thread safe (ma97, qpoases) */
+    if((NUM_STARTS > 1) && !kmath::nlp_thread_safe(NLPConfig))
+    {
+        std::cout << "KiteNMPF: " << kmath::nlp_settings_to_string(NLPConfig)
+                  << " is not thread safe, multi-start disabled \n";
+        NUM_STARTS = 1;
+    }
+    MSPool.reset();
+    if(NUM_STARTS > 1)
+    {
+        std::vector<Function> solvers;
+        for(int i = 1; i < NUM_STARTS; ++i)
+            solvers.push_back(kmath::nlp_solver("solver_" + std::to_string(i), NLP, NLPConfig));
+        MSPool = std::make_shared<MultiStartPool>(solvers);
+    }
 
     /** set default args */
     ARG["lbx"] = lbx;
@@ -194,6 +410,7 @@ void KiteNMPF::createNLP()
 
     ARG["x0"] = DM::vertcat(DMVector{DM::repmat(feasible_state, poly_order * num_segments + 1, 1),
                                      DM::repmat(feasible_control, poly_order * num_segments + 1, 1)});
+    ColdStart = ARG["x0"];
 }
 
 void KiteNMPF::computeControl(const DM &_X0)
@@ -283,7 +500,14 @@ void KiteNMPF::computeControl(const DM &_X0)
     //std::cout << "State: " << DM::mtimes(invSX, state) << "\n";
 
     /** store optimal solution */
-    DMDict res = NLP_Solver(ARG);
+    DMDict res;
+    if(MSPool)
+        res = solveMultiStart(X0, flexibility);
+    else
+    {
+        res = NLP_Solver(ARG);
+        stats = NLP_Solver.stats();
+    }
     NLP_X     = res.at("x");
     NLP_LAM_X = res.at("lam_x");
     NLP_LAM_G = res.at("lam_g");
@@ -297,8 +521,9 @@ void KiteNMPF::computeControl(const DM &_X0)
 
     //std::cout << "Chosen : " << NLP_X[idx_theta] << "\n";
 
-    stats = NLP_Solver.stats();
-    std::cout << stats << "\n";
+    telemetry = kmath::nlp_telemetry(stats);
+    telemetry.objective = res.at("f").nonzeros()[0];
+    telemetry.constraint_violation = kmath::constraint_violation(res.at("g"), ARG["lbg"], ARG["ubg"]);
 
     std::string solve_status = static_cast<std::string>(stats["return_status"]);
     if(solve_status.compare("Invalid_Number_Detected") == 0)
@@ -315,6 +540,76 @@ void KiteNMPF::computeControl(const DM &_X0)
     enableWarmStart();
 }
 
+/** alternative starts are dispatched to the pool, the primary (warm) start is solved on the calling thread */
+DMDict KiteNMPF::solveMultiStart(const DM &X0, const double &flexibility)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(MS_DEADLINE);
+    int N  = NUM_SHOOTING_INTERVALS;
+    int nx = 15;
+    int idx_theta = N * nx + 13;
+    std::vector<DMDict> args(NUM_STARTS - 1, ARG);
+
+    /** start 1 : cold feasible guess */
+    args[0].erase("lam_g0");
+    args[0].erase("lam_x0");
+    args[0]["x0"] = ColdStart;
+    args[0]["x0"](Slice(0, (N + 1) * nx), 0) = DM::repmat(X0, (N + 1), 1);
+
+    /** starts 2.. : path parameter re-anchored to the closest point, then alternately shifted by the flexibility */
+    double theta_scale = Scale_X(13,13).nonzeros()[0];
+    double theta_current = X0(13).nonzeros()[0];
+    if(NUM_STARTS > 2)
+    {
+        DM position = DM::mtimes(invSX(Slice(6,9), Slice(6,9)), X0(Slice(6,9)));
+        double theta_anchor = theta_scale * findClosestPointOnPath(position, theta_current / theta_scale).nonzeros()[0];
+
+        for(int k = 2; k < NUM_STARTS; ++k)
+        {
+            int j = k - 2;
+            double theta_k = theta_anchor + ((j % 2 == 1) ? 1 : -1) * ((j + 1) / 2) * flexibility;
+            DMDict &arg = args[k - 1];
+            arg.erase("lam_g0");
+            arg.erase("lam_x0");
+            for(int i = 0; i <= N; ++i)
+                arg["x0"](i * nx + 13) += theta_k - theta_current;
+            arg["lbx"](idx_theta) = theta_k - flexibility;
+            arg["ubx"](idx_theta) = theta_k + flexibility;
+        }
+    }
+
+    MSPool->dispatch(args);
+
+    /** start 0 : shifted previous solution */
+    DMDict best = NLP_Solver(ARG);
+    stats = NLP_Solver.stats();
+    int best_idx = 0;
+
+    std::vector<DMDict> results;
+    std::vector<Dict> alt_stats;
+    std::vector<int> available = MSPool->collect(std::max(deadline, std::chrono::steady_clock::now()), results, alt_stats);
+
+    /** pick the best converged solution by objective value */
+    bool best_converged = kmath::nlp_converged(stats);
+    double best_cost = best_converged ? best.at("f").nonzeros()[0] : std::numeric_limits<double>::infinity();
+    for(int i : available)
+    {
+        if(!kmath::nlp_converged(alt_stats[i]))
+            continue;
+        double cost = results[i].at("f").nonzeros()[0];
+        if(cost < best_cost)
+        {
+            best_cost = cost;
+            best      = results[i];
+            stats     = alt_stats[i];
+            best_idx  = i + 1;
+        }
+    }
+
+    stats["multistart_index"] = best_idx;
+    stats["multistart_available"] = static_cast<int>(available.size()) + 1;
+    return best;
+}
+
 /** get path error */
 double KiteNMPF::getPathError()
 {
@@ -357,36 +652,87 @@ double KiteNMPF::getVirtState()
 /** compute intial guess for virtual state */
 DM KiteNMPF::findClosestPointOnPath(const DM &position, const DM &init_guess)
 {
-    SX theta = SX::sym("theta");
-    SX sym_residual = 0.5 * SX::norm_2(PathFunc(SXVector{theta})[0] - SX(position));
-    SX sym_gradient = SX::gradient(sym_residual,theta);
+    std::vector<double> pos = position.nonzeros();
+    Eigen::Vector3d p = Eigen::Vector3d::Map(pos.data());
+
+    /** global search over the path index */
+    Eigen::Index idx_min;
+    (PathIndexPoints.colwise() - p).colwise().squaredNorm().minCoeff(&idx_min);
+    double theta = PathIndexTheta(idx_min);
+
+    /** Newton refinement : step is limited to the local index spacing, the index is uniform in arc length */
+    const double tol = 1e-6;
+    const int max_iter = 5;
+    const double period = PathThetaMax - PathThetaMin;
+    const Eigen::Index last = PathIndexTheta.size() - 1;
+    const double max_step_up   = (idx_min < last) ? PathIndexTheta(idx_min + 1) - theta : PathIndexTheta(0) + period - theta;
+    const double max_step_down = (idx_min > 0) ? theta - PathIndexTheta(idx_min - 1) : theta - (PathIndexTheta(last) - period);
+    DM sym_pos = DM(pos);
+    for(int i = 0; i < max_iter; ++i)
+    {
+        DMVector res = PathDistanceDerivatives(DMVector{theta, sym_pos});
+        double gradient = res[0].nonzeros()[0];
+        double hessian  = res[1].nonzeros()[0];
+
+        if(std::fabs(gradient) < tol)
+            break;
 
-    Function grad = Function("gradient", {theta}, {sym_gradient});
+        /** fall back to a gradient step if the curvature term is not positive */
+        double step = (hessian > 0) ? -gradient / hessian : -gradient;
+        theta += std::max(-max_step_down, std::min(max_step_up, step));
+    }
+
+    /** unwrap to the period closest to the initial guess */
+    double guess  = init_guess.nonzeros()[0];
+    theta += period * std::round((guess - theta) / period);
+
+    return DM(theta);
+}
 
-    double tol = 1e-2;
-    int counter = 0;
-    DM theta_i = init_guess;
-    DMVector result  = grad(DMVector{theta_i});
-    double step = 0.25;
 
-    /** check for local minimum */
-    if(fabs(result[0].nonzeros()[0]) < tol)
+namespace nmpf_utils
+{
+    Function circular_path(const double &radius, const double &altitude, const double &inclination)
     {
-        theta_i = {M_PI_2 + 0.1};
-        result  = grad(DMVector{theta_i});
+        SX x = SX::sym("x");
+        SX Path = SX::vertcat(SXVector{radius * cos(x), radius * sin(x), altitude});
+        /** rotate path */
+        SX q_rot = SX::vertcat({cos(inclination / 2), 0, sin(inclination / 2), 0});
+        SX q_rot_inv = kmath::quat_inverse(q_rot);
+        SX qP_tmp = kmath::quat_multiply(q_rot_inv, SX::vertcat({0, Path}));
+        SX qP_q = kmath::quat_multiply(qP_tmp, q_rot);
+        Path = qP_q(Slice(1,4), 0);
+
+        return Function("path", {x}, {Path});
     }
 
-    /** @badcode : shitty code */
-    while (fabs(result[0].nonzeros()[0]) >= tol)
+    void default_setup(KiteNMPF &controller)
     {
-        counter++;
-        theta_i -= step * grad(theta_i);
-        /** gradient update */
-        result  = grad(DMVector{theta_i});
-        if(counter > 10)
-            break;
+        /** set control constraints */
+        double angle_sat = kmath::deg2rad(7.0);
+        DM lbu = DM::vertcat({0.1, -angle_sat, -angle_sat, -5});
+        DM ubu = DM::vertcat({0.15, angle_sat, angle_sat, 5});
+
+        /** scaling matrices */
+        DM ScaleX = DM::diag(DM({0.1, 1/3.0, 1/3.0, 1/2.0, 1/5.0, 1/2.0, 1/3.0, 1/3.0, 1/3.0, 1.0, 1.0, 1.0, 1.0, 1/6.28, 1/6.28}));
+        DM ScaleU = DM::diag(DM({1/0.15, 1/0.2618, 1/0.2618, 1/5.0}));
+        controller.setControlScaling(ScaleU);
+        controller.setStateScaling(ScaleX);
+
+        controller.setLBU(lbu);
+        controller.setUBU(ubu);
+
+        /** set variable constraints */
+        DM lbx = DM::vertcat({2.0, -DM::inf(1), -DM::inf(1), -4 * M_PI, -4 * M_PI, -4 * M_PI, -DM::inf(1), -DM::inf(1), -DM::inf(1),
+                             -1.01, -1.01, -1.01, -1.01, -DM::inf(1), -DM::inf(1)});
+
+        DM ubx = DM::vertcat({DM::inf(1), DM::inf(1), DM::inf(1), 4 * M_PI, 4 * M_PI, 4 * M_PI, DM::inf(1), DM::inf(1), DM::inf(1),
+                              1.01, 1.01, 1.01, 1.01, DM::inf(1), DM::inf(1)});
+
+        controller.setLBX(lbx);
+        controller.setUBX(ubx);
+
+        DM vel_ref = 4.0;
+        controller.setReferenceVelocity(vel_ref);
     }
-    std::cout << theta_i << "\n";
-    return theta_i;
 }
-
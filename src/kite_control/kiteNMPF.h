@@ -2,6 +2,7 @@
 #define KITENMPF_H
 
 #include "kite.h"
+#include "nlp_backend.h"
 #include <memory>
 
 
@@ -26,6 +27,9 @@ public:
     void setLBU(const casadi::DM &_lbu){this->LBU = _lbu;}
     void setUBU(const casadi::DM &_ubu){this->UBU = _ubu;}
 
+    casadi::DM getLBU(){return LBU;}
+    casadi::DM getUBU(){return UBU;}
+
     void setStateScaling(const casadi::DM &Scaling){Scale_X = Scaling;
                                                       invSX = casadi::DM::solve(Scale_X, casadi::DM::eye(Scale_X.size1()));}
     void setControlScaling(const casadi::DM &Scaling){Scale_U = Scaling;
@@ -34,18 +38,32 @@ public:
     void setReferenceVelocity(const casadi::DM &vel_ref){reference_velocity = Scale_X(14,14) * vel_ref;}
 
     void setPath(const casadi::SX &_path);
+    /** solve from several initial guesses in parallel: shifted previous solution, cold feasible guess
+     *  and re-anchored path parameter; deadline [s] bounds the wait for the alternative starts only,
+     *  the primary warm-started solve on the calling thread is not bounded.
+     *  should be called before createNLP(), which falls back to a single start with ipopt:mumps */
+    void setMultiStart(const int &num_starts, const double &deadline = 0.05);
+    /** NLP backend : should be set before createNLP() */
+    void setNLPSettings(const kmath::NLPSettings &settings){NLPConfig = settings;}
+    kmath::NLPSettings getNLPSettings(){return NLPConfig;}
     void createNLP();
 
     void enableWarmStart(){WARM_START = true;}
     void disableWarmStart(){WARM_START = false;}
     void computeControl(const casadi::DM &_X0);
+    /** global closest point search over the path index followed by Newton refinement;
+     *  result is unwrapped to the period nearest to the initial guess */
     casadi::DM findClosestPointOnPath(const casadi::DM &position, const casadi::DM &init_guess = casadi::DM(0));
+    /** path parameter domain covered by the path index (assumes a closed path) */
+    void setPathDomain(const double &theta_min, const double &theta_max);
 
     casadi::DM getOptimalControl(){return OptimalControl;}
     casadi::DM getOptimalTrajetory(){return OptimalTrajectory;}
     casadi::Function getPathFunction(){return PathFunc;}
     casadi::Function getAugDynamics(){return AugDynamics;}
     casadi::Dict getStats(){return stats;}
+    /** iterations, timings, objective and constraint violation of the last solve */
+    kmath::NLPTelemetry getTelemetry(){return telemetry;}
     bool initialized(){return _initialized;}
 
     double getPathError();
@@ -64,6 +82,9 @@ public:
     static const casadi::DM DEFAULT_LBU;
     static const casadi::DM DEFAULT_UBU;
 
+    /** number of arc-length samples in the path index */
+    static const int PATH_INDEX_SIZE;
+
 private:
     std::shared_ptr<KiteDynamics> Kite;
     casadi::SX Path;
@@ -93,14 +114,23 @@ private:
     casadi::DM NLP_X, NLP_LAM_G, NLP_LAM_X;
     casadi::Function NLP_Solver;
     casadi::SXDict NLP;
-    casadi::Dict OPTS;
+    kmath::NLPSettings NLPConfig;
     casadi::DMDict ARG;
     casadi::Dict stats;
+    kmath::NLPTelemetry telemetry;
 
     casadi::DM OptimalControl;
     casadi::DM OptimalTrajectory;
 
     unsigned NUM_SHOOTING_INTERVALS;
+    /** MULTI-START : solver instances running on persistent worker threads */
+    struct MultiStartPool;
+    std::shared_ptr<MultiStartPool> MSPool;
+    int NUM_STARTS;
+    double MS_DEADLINE;
+    casadi::DM ColdStart;
+    casadi::DMDict solveMultiStart(const casadi::DM &X0, const double &flexibility);
+
     bool WARM_START;
     bool _initialized;
     bool scale;
@@ -115,6 +145,24 @@ private:
 
     casadi::Function AugJacobian;
     casadi::Function AugDynamics;
+
+    /** PATH INDEX : arc-length sampled path points for closest point search */
+    void createPathIndex();
+    double PathThetaMin, PathThetaMax;
+    Eigen::VectorXd  PathIndexTheta;
+    Eigen::Matrix3Xd PathIndexPoints;
+    /** gradient and hessian of the squared distance to the path : f(theta, position) */
+    casadi::Function PathDistanceDerivatives;
 };
 
+namespace nmpf_utils
+{
+    /** circular orbit rotated about Y-axis by the inclination angle : Function({theta}) -> [x; y; z] */
+    casadi::Function circular_path(const double &radius = 2.65, const double &altitude = 0.0,
+                                   const double &inclination = M_PI / 4);
+
+    /** scaling, box constraints and reference velocity used in the orbit tracking experiments */
+    void default_setup(KiteNMPF &controller);
+}
+
 #endif // KITENMPF_H
@@ -0,0 +1,218 @@
+#include "kitePolicy.h"
+#include "yaml-cpp/yaml.h"
+#include <random>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    std::vector<double> to_vector(const Eigen::MatrixXd &mat)
+    {
+        return std::vector<double>(mat.data(), mat.data() + mat.size());
+    }
+
+    Eigen::MatrixXd from_node(const YAML::Node &node, const int &rows, const int &cols)
+    {
+        std::vector<double> data = node.as<std::vector<double>>();
+        if(data.size() != static_cast<size_t>(rows * cols))
+            throw std::runtime_error("KitePolicy: inconsistent matrix size in policy file");
+
+        return Eigen::MatrixXd::Map(data.data(), rows, cols);
+    }
+}
+
+KitePolicy::KitePolicy() : m_radius(0), m_max_error(std::numeric_limits<double>::infinity()), m_tolerance(0), m_validated(false)
+{
+}
+
+KitePolicy::KitePolicy(const std::string &filename) : KitePolicy()
+{
+    load(filename);
+}
+
+void KitePolicy::allocate()
+{
+    m_input.resize(m_W1.cols());
+    m_hidden.resize(m_W1.rows());
+}
+
+void KitePolicy::normalize(const Eigen::Ref<const Eigen::VectorXd> &state, Eigen::Ref<Eigen::VectorXd> normalized) const
+{
+    /** map the training box onto [-1, 1] */
+    for(Eigen::Index i = 0; i < state.size(); ++i)
+    {
+        double half_width = 0.5 * (m_domain_ub(i) - m_domain_lb(i));
+        double center     = 0.5 * (m_domain_ub(i) + m_domain_lb(i));
+        normalized(i) = (half_width > 0) ? (state(i) - center) / half_width : 0.0;
+    }
+}
+
+void KitePolicy::fit(const Eigen::MatrixXd &states, const Eigen::MatrixXd &controls, const int &num_hidden,
+                     const double &regularization, const unsigned &seed)
+{
+    assert(states.cols() == controls.cols());
+    const Eigen::Index nx = states.rows();
+    const Eigen::Index nu = controls.rows();
+    const Eigen::Index N  = states.cols();
+
+    /** region covered by the data */
+    m_domain_lb = states.rowwise().minCoeff();
+    m_domain_ub = states.rowwise().maxCoeff();
+
+    /** random hidden layer */
+    std::mt19937 generator(seed);
+    std::normal_distribution<double> distribution(0.0, 1.0 / std::sqrt(static_cast<double>(nx)));
+    m_W1.resize(num_hidden, nx);
+    m_b1.resize(num_hidden);
+    for(Eigen::Index i = 0; i < m_W1.size(); ++i)
+        m_W1(i) = distribution(generator);
+    for(Eigen::Index i = 0; i < m_b1.size(); ++i)
+        m_b1(i) = distribution(generator);
+
+    /** hidden layer features */
+    Eigen::MatrixXd X(nx, N);
+    for(Eigen::Index k = 0; k < N; ++k)
+        normalize(states.col(k), X.col(k));
+    Eigen::MatrixXd H = ((m_W1 * X).colwise() + m_b1).array().tanh().matrix();
+
+    /** output layer : ridge regression on centered controls */
+    m_b2 = controls.rowwise().mean();
+    Eigen::MatrixXd Uc = controls.colwise() - m_b2;
+    Eigen::MatrixXd HHt = H * H.transpose();
+    HHt.diagonal().array() += regularization * N;
+    m_W2 = HHt.ldlt().solve(H * Uc.transpose()).transpose();
+
+    if(m_lbu.size() != nu)
+    {
+        m_lbu = Eigen::VectorXd::Constant(nu, -std::numeric_limits<double>::infinity());
+        m_ubu = Eigen::VectorXd::Constant(nu, std::numeric_limits<double>::infinity());
+    }
+
+    m_validated = false;
+    m_max_error = std::numeric_limits<double>::infinity();
+    m_support.resize(nx, 0);
+    allocate();
+}
+
+double KitePolicy::validate(const Eigen::MatrixXd &states, const Eigen::MatrixXd &controls, const double &tolerance,
+                            const double &radius)
+{
+    Eigen::VectorXd control(dim_u());
+    std::vector<Eigen::Index> validated;
+    double max_error = 0;
+
+    for(Eigen::Index k = 0; k < states.cols(); ++k)
+    {
+        if(!inBox(states.col(k)))
+            continue;
+
+        evaluate(states.col(k), control);
+        max_error = std::fmax(max_error, (control - controls.col(k)).lpNorm<Eigen::Infinity>());
+        validated.push_back(k);
+    }
+
+    /** the policy is trusted only near the states it was checked on */
+    m_support.resize(dim_x(), validated.size());
+    for(size_t j = 0; j < validated.size(); ++j)
+        normalize(states.col(validated[j]), m_support.col(j));
+    m_radius = radius;
+
+    m_tolerance = tolerance;
+    m_max_error = validated.empty() ? std::numeric_limits<double>::infinity() : max_error;
+    m_validated = m_max_error <= tolerance;
+    return m_max_error;
+}
+
+bool KitePolicy::inBox(const Eigen::Ref<const Eigen::VectorXd> &state) const
+{
+    return (state.array() >= m_domain_lb.array()).all() && (state.array() <= m_domain_ub.array()).all();
+}
+
+bool KitePolicy::nearSupport(const Eigen::Ref<const Eigen::VectorXd> &normalized) const
+{
+    for(Eigen::Index j = 0; j < m_support.cols(); ++j)
+    {
+        if((m_support.col(j) - normalized).lpNorm<Eigen::Infinity>() <= m_radius)
+            return true;
+    }
+    return false;
+}
+
+bool KitePolicy::inDomain(const Eigen::Ref<const Eigen::VectorXd> &state) const
+{
+    if(!m_validated || !inBox(state))
+        return false;
+
+    Eigen::VectorXd normalized(state.size());
+    normalize(state, normalized);
+    return nearSupport(normalized);
+}
+
+bool KitePolicy::evaluate(const Eigen::Ref<const Eigen::VectorXd> &state, Eigen::Ref<Eigen::VectorXd> control)
+{
+    /** no allocations : workspace is reserved on fit/load */
+    normalize(state, m_input);
+    m_hidden.noalias() = m_W1 * m_input;
+    m_hidden += m_b1;
+    m_hidden = m_hidden.array().tanh();
+
+    control = m_b2;
+    control.noalias() += m_W2 * m_hidden;
+    control = control.cwiseMax(m_lbu).cwiseMin(m_ubu);
+
+    return m_validated && inBox(state) && nearSupport(m_input);
+}
+
+void KitePolicy::save(const std::string &filename) const
+{
+    YAML::Emitter out;
+    out << YAML::BeginMap;
+    out << YAML::Key << "dim_x"     << YAML::Value << dim_x();
+    out << YAML::Key << "dim_u"     << YAML::Value << dim_u();
+    out << YAML::Key << "num_hidden" << YAML::Value << static_cast<int>(m_W1.rows());
+    out << YAML::Key << "validated" << YAML::Value << m_validated;
+    out << YAML::Key << "max_error" << YAML::Value << m_max_error;
+    out << YAML::Key << "tolerance" << YAML::Value << m_tolerance;
+    out << YAML::Key << "domain_lb" << YAML::Value << YAML::Flow << to_vector(m_domain_lb);
+    out << YAML::Key << "domain_ub" << YAML::Value << YAML::Flow << to_vector(m_domain_ub);
+    out << YAML::Key << "radius"    << YAML::Value << m_radius;
+    out << YAML::Key << "num_support" << YAML::Value << static_cast<int>(m_support.cols());
+    out << YAML::Key << "support"   << YAML::Value << YAML::Flow << to_vector(m_support);
+    out << YAML::Key << "lbu"       << YAML::Value << YAML::Flow << to_vector(m_lbu);
+    out << YAML::Key << "ubu"       << YAML::Value << YAML::Flow << to_vector(m_ubu);
+    out << YAML::Key << "W1"        << YAML::Value << YAML::Flow << to_vector(m_W1);
+    out << YAML::Key << "b1"        << YAML::Value << YAML::Flow << to_vector(m_b1);
+    out << YAML::Key << "W2"        << YAML::Value << YAML::Flow << to_vector(m_W2);
+    out << YAML::Key << "b2"        << YAML::Value << YAML::Flow << to_vector(m_b2);
+    out << YAML::EndMap;
+
+    std::ofstream fout(filename);
+    fout << out.c_str();
+}
+
+void KitePolicy::load(const std::string &filename)
+{
+    YAML::Node config = YAML::LoadFile(filename);
+    int nx = config["dim_x"].as<int>();
+    int nu = config["dim_u"].as<int>();
+    int nh = config["num_hidden"].as<int>();
+
+    m_validated = config["validated"].as<bool>();
+    m_max_error = config["max_error"].as<double>();
+    m_tolerance = config["tolerance"].as<double>();
+    m_domain_lb = from_node(config["domain_lb"], nx, 1);
+    m_domain_ub = from_node(config["domain_ub"], nx, 1);
+    m_radius    = config["radius"].as<double>();
+    m_support   = from_node(config["support"], nx, config["num_support"].as<int>());
+    m_lbu = from_node(config["lbu"], nu, 1);
+    m_ubu = from_node(config["ubu"], nu, 1);
+    m_W1  = from_node(config["W1"], nh, nx);
+    m_b1  = from_node(config["b1"], nh, 1);
+    m_W2  = from_node(config["W2"], nu, nh);
+    m_b2  = from_node(config["b2"], nu, 1);
+
+    if(!m_validated)
+        std::cerr << "KitePolicy: policy " << filename << " is not validated, max error: " << m_max_error << "\n";
+
+    allocate();
+}
@@ -0,0 +1,77 @@
+#ifndef KITEPOLICY_H
+#define KITEPOLICY_H
+
+#include "eigen3/Eigen/Dense"
+#include <string>
+
+/** Explicit approximation of the NMPF control law generated offline:
+ *  u = sat( W2 * tanh( W1 * xn + b1 ) + b2 ), xn - state normalized to the box of the training data.
+ *  The policy is empirically validated, not certified : its domain is the set of states within a radius
+ *  (infinity norm, normalized units) of the held-out samples on which the error was checked, so the
+ *  unsampled parts of the training box are left to the online solver.
+ *  Depends only on Eigen and yaml-cpp so it can be built for small companion computers.
+ */
+class KitePolicy
+{
+public:
+    KitePolicy();
+    KitePolicy(const std::string &filename);
+    virtual ~KitePolicy(){}
+
+    /** fit a random feature network: hidden layer is drawn randomly, output layer by ridge regression
+     *  states   : [dim_x x N] training states
+     *  controls : [dim_u x N] optimal controls
+     */
+    void fit(const Eigen::MatrixXd &states, const Eigen::MatrixXd &controls, const int &num_hidden,
+             const double &regularization = 1e-6, const unsigned &seed = 42);
+
+    /** validate the policy on held-out samples inside the training box, returns the max absolute control error;
+     *  the samples become the support of the validated domain with the given radius */
+    double validate(const Eigen::MatrixXd &states, const Eigen::MatrixXd &controls, const double &tolerance,
+                    const double &radius = 0.1);
+
+    /** check if state lies in the validated domain */
+    bool inDomain(const Eigen::Ref<const Eigen::VectorXd> &state) const;
+
+    /** evaluate policy; returns false if the state is outside the validated domain
+     *  and the caller should fall back to the online solver */
+    bool evaluate(const Eigen::Ref<const Eigen::VectorXd> &state, Eigen::Ref<Eigen::VectorXd> control);
+
+    void setControlBounds(const Eigen::VectorXd &lbu, const Eigen::VectorXd &ubu){m_lbu = lbu; m_ubu = ubu;}
+
+    void save(const std::string &filename) const;
+    void load(const std::string &filename);
+
+    int dim_x() const {return static_cast<int>(m_W1.cols());}
+    int dim_u() const {return static_cast<int>(m_W2.rows());}
+    bool validated() const {return m_validated;}
+    double maxError() const {return m_max_error;}
+
+private:
+    /** box of the training data, defines the normalization */
+    Eigen::VectorXd m_domain_lb, m_domain_ub;
+    /** validated domain : normalized held-out states and coverage radius */
+    Eigen::MatrixXd m_support;
+    double m_radius;
+
+    /** network weights */
+    Eigen::MatrixXd m_W1, m_W2;
+    Eigen::VectorXd m_b1, m_b2;
+
+    /** control saturation */
+    Eigen::VectorXd m_lbu, m_ubu;
+
+    double m_max_error;
+    double m_tolerance;
+    bool   m_validated;
+
+    /** evaluation workspace */
+    Eigen::VectorXd m_input, m_hidden;
+
+    void normalize(const Eigen::Ref<const Eigen::VectorXd> &state, Eigen::Ref<Eigen::VectorXd> normalized) const;
+    bool inBox(const Eigen::Ref<const Eigen::VectorXd> &state) const;
+    bool nearSupport(const Eigen::Ref<const Eigen::VectorXd> &normalized) const;
+    void allocate();
+};
+
+#endif // KITEPOLICY_H
@@ -1,5 +1,12 @@
 #include "kiteEKF.h"
+#include "kiteUKF.h"
+#include "kiteMHE.h"
+#include "mocap_frame.hpp"
+#include "kite_replay.hpp"
 #include "kiteNMPF.h"
+#include "kiteLQR.h"
+#include "kitePolicy.h"
+#include "riccati.hpp"
 
 #define BOOST_TEST_TOOLS_UNDER_DEBUGGER
 #define BOOST_TEST_MODULE kite_control_test
@@ -7,6 +14,7 @@
 #include <fstream>
 #include "pseudospectral/chebyshev.hpp"
 #include <unordered_set>
+#include <random>
 
 using namespace casadi;
 
@@ -85,6 +93,388 @@ BOOST_AUTO_TEST_CASE( ekf_test )
     BOOST_CHECK(true);
 }
 
+BOOST_AUTO_TEST_CASE( ekf_oosm_test )
+{
+    std::string kite_config_file = "umx_radian.yaml";
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_config_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+
+    DM x_init = DM::vertcat({6.0026, -0.3965, 0.1705, 0.4414, -0.2068, 0.9293,
+                             1.4634, -3.1765, -1.7037, -0.5486, -0.2354, -0.2922, -0.7471});
+    DM pose = DM::vertcat({1.4522, -3.1274, -1.7034, -0.5455, -0.2382, -0.2922, -0.7485});
+
+    /** five poses 10 ms apart, the control changes at every sample but the third : a late pose is fused
+     *  with the control of the preceding one */
+    const double t0 = 100.0;
+    const double dt = 0.01;
+    std::vector<double> times;
+    DMVector poses, controls;
+    for(int i = 0; i < 5; ++i)
+    {
+        times.push_back(t0 + (i + 1) * dt);
+        DM y = pose;
+        y(Slice(0,3)) += DM({0.02 * i, -0.01 * i, 0.005 * i});
+        poses.push_back(y);
+        int j = (i == 2) ? 1 : i;
+        controls.push_back(DM({0.1 * j, 0.02 * j, -0.02 * j}));
+    }
+
+    KiteEKF in_order(kite_props, algo_props);
+    in_order.setEstimation(x_init);
+    in_order.setTime(t0);
+    for(int i = 0; i < 5; ++i)
+    {
+        in_order.setControl(controls[i]);
+        BOOST_CHECK(in_order.estimate(poses[i], times[i]));
+    }
+
+    /** sample 2 arrives last, while another control is applied */
+    KiteEKF out_of_order(kite_props, algo_props);
+    out_of_order.setEstimation(x_init);
+    out_of_order.setTime(t0);
+    for(int i : {0, 1, 3, 4})
+    {
+        out_of_order.setControl(controls[i]);
+        BOOST_CHECK(out_of_order.estimate(poses[i], times[i]));
+    }
+    out_of_order.setControl(DM({1.0, -0.1, 0.1}));
+    BOOST_CHECK(out_of_order.estimate(poses[2], times[2]));
+
+    double state_error = DM::norm_inf(in_order.getEstimation() - out_of_order.getEstimation()).nonzeros()[0];
+    double cov_error = DM::norm_inf(in_order.getEstimationCovariance() - out_of_order.getEstimationCovariance()).nonzeros()[0];
+    std::cout << "EKF_OOSM_TEST state error: " << state_error << " covariance error: " << cov_error << "\n";
+    BOOST_CHECK(state_error < 1e-9);
+    BOOST_CHECK(cov_error < 1e-9);
+    BOOST_CHECK(out_of_order.getTimeStamp() == times[4]);
+
+    /** late measurement without history : dropped, the estimate is untouched */
+    KiteEKF no_history(kite_props, algo_props);
+    no_history.setHistorySize(0);
+    no_history.setEstimation(x_init);
+    no_history.setTime(t0);
+    BOOST_CHECK(no_history.estimate(poses[1], times[1]));
+    DM before = no_history.getEstimation();
+    BOOST_CHECK(!no_history.estimate(poses[0], times[0]));
+    BOOST_CHECK(DM::norm_inf(no_history.getEstimation() - before).nonzeros()[0] == 0);
+    BOOST_CHECK(no_history.getTimeStamp() == times[1]);
+}
+
+BOOST_AUTO_TEST_CASE( ekf_core_test )
+{
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    RigidBodyKinematics rigid_body = RigidBodyKinematics(algo_props);
+    Function fTransition = rigid_body.getNumericTransition();
+
+    DM x_est = DM::vertcat({6.0026, -0.3965, 0.1705, 0.4414, -0.2068, 0.9293,
+                            1.4634, -3.1765, -1.7037, -0.5486, -0.2354, -0.2922, -0.7471});
+    DM measurement = DM::vertcat({1.4522, -3.1274, -1.7034, -0.5455, -0.2382, -0.2922, -0.7485});
+    DM control = DM::zeros(3);
+    double dt = 0.0084;
+
+    KiteEKF estimator(fTransition);
+    estimator.setControl(control);
+    estimator.setEstimation(x_est);
+    DM P0 = estimator.getEstimationCovariance();
+    estimator._estimate(measurement, dt);
+
+    /** reference : EKF equations on casadi matrices */
+    DMVector step = fTransition(DMVector{x_est, control, dt});
+    DM A = step[1];
+    DM W = KiteEKF::DEFAULT_PROCESS_COVARIANCE;
+    DM V = KiteEKF::DEFAULT_MEASUREMENT_COVARIANCE;
+    DM H = KiteEKF::DEFAULT_MEASUREMENT_MATRIX;
+
+    DM P = DM::mtimes(DM::mtimes(A, P0), A.T()) + W;
+    DM S = DM::mtimes(DM::mtimes(H, P), H.T()) + V;
+    DM K = DM::solve(S, DM::mtimes(H, P)).T();
+    DM x = step[0] + DM::mtimes(K, measurement - DM::mtimes(H, step[0]));
+    DM IKH = DM::eye(13) - DM::mtimes(K, H);
+    P = DM::mtimes(DM::mtimes(IKH, P), IKH.T()) + DM::mtimes(DM::mtimes(K, V), K.T());
+
+    double state_error = DM::norm_inf(estimator.getEstimation() - x).nonzeros()[0];
+    double cov_error = DM::norm_inf(estimator.getEstimationCovariance() - P).nonzeros()[0];
+    std::cout << "EKF_CORE_TEST state error: " << state_error << " covariance error: " << cov_error << "\n";
+    BOOST_CHECK(state_error < 1e-9);
+    BOOST_CHECK(cov_error < 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE( transition_test )
+{
+    std::string kite_config_file = "umx_radian.yaml";
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_config_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    KiteDynamics kite = KiteDynamics(kite_props, algo_props);
+
+    /** reference : symbolic jacobian of the RK4 step */
+    SX x  = kite.getSymbolicState();
+    SX u  = kite.getSymbolicControl();
+    SX dt = SX::sym("dt");
+    Function dynamics = Function("dynamics", {x, u}, {kite.getSymbolicDynamics()});
+    SX x_next = kmath::rk4_symbolic(x, u, dynamics, dt);
+    Function reference = Function("reference", {x, u, dt}, {x_next, SX::jacobian(x_next, x)});
+
+    DM state = DM::vertcat({6.0026, -0.3965, 0.1705, 0.4414, -0.2068, 0.9293,
+                            1.4634, -3.1765, -1.7037, -0.5486, -0.2354, -0.2922, -0.7471});
+    DM control = DM::vertcat({0.3, 0.05, -0.05});
+    DMVector fused = kite.getNumericTransition()(DMVector{state, control, 0.0084});
+    DMVector exact = reference(DMVector{state, control, 0.0084});
+
+    double state_error = DM::norm_inf(fused[0] - exact[0]).nonzeros()[0];
+    double phi_error = DM::norm_inf(DM::densify(fused[1]) - DM::densify(exact[1])).nonzeros()[0];
+    std::cout << "TRANSITION_TEST state error: " << state_error << " transition matrix error: " << phi_error << "\n";
+    BOOST_CHECK(state_error < 1e-12);
+    BOOST_CHECK(phi_error < 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE( ukf_test )
+{
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    RigidBodyKinematics rigid_body = RigidBodyKinematics(algo_props);
+    Function fTransition = rigid_body.getNumericTransition();
+
+    /** kite at rest, estimate initialized off the measured pose */
+    DM pose = DM::vertcat({1.4522, -3.1274, -1.7034, -0.5455, -0.2382, -0.2922, -0.7485});
+    pose(Slice(3,7)) /= DM::norm_2(pose(Slice(3,7)));
+    DM x_init = DM::vertcat({DM::zeros(6), pose(Slice(0,3)) + 0.1, -0.5486, -0.2354, -0.2922, -0.7471});
+
+    /** batched sigma-point propagation : serial and threaded evaluations agree */
+    KiteUKF serial(fTransition, "serial");
+    KiteUKF threaded(fTransition, "thread");
+    for(KiteUKF *filter : {&serial, &threaded})
+    {
+        filter->setControl(DM::zeros(3));
+        filter->setEstimation(x_init);
+        filter->setTime(0.0);
+    }
+
+    double max_norm_error = 0;
+    for(int k = 1; k <= 100; ++k)
+    {
+        BOOST_CHECK(serial.estimate(pose, 0.01 * k));
+        BOOST_CHECK(threaded.estimate(pose, 0.01 * k));
+        DM x = serial.getEstimation();
+        max_norm_error = std::max(max_norm_error, std::fabs(DM::norm_2(x(Slice(9,13))).nonzeros()[0] - 1));
+    }
+
+    DM x = serial.getEstimation();
+    DM P = serial.getEstimationCovariance();
+    double pose_error = DM::norm_inf(x(Slice(6,9)) - pose(Slice(0,3))).nonzeros()[0];
+    double batch_error = DM::norm_inf(x - threaded.getEstimation()).nonzeros()[0];
+    std::cout << "UKF_TEST pose error: " << pose_error << " quaternion norm error: " << max_norm_error
+              << " serial / thread difference: " << batch_error << "\n";
+
+    BOOST_CHECK(P.size1() == 12 && P.size2() == 12);
+    BOOST_CHECK(DM::norm_inf(P - P.T()).nonzeros()[0] < 1e-12);
+    BOOST_CHECK(max_norm_error < 1e-9);
+    BOOST_CHECK(pose_error < 1e-2);
+    BOOST_CHECK(batch_error < 1e-12);
+
+    /** indefinite estimation covariance : not propagated, reset to the process covariance */
+    KiteUKF broken(fTransition, "serial");
+    broken.setEstimation(x_init);
+    broken.setTime(0.0);
+    broken.setEstimationCovariance(-DM::eye(12));
+    DM before = broken.getEstimation();
+    BOOST_CHECK(!broken.estimate(pose, 0.01));
+    BOOST_CHECK(DM::norm_inf(broken.getEstimation() - before).nonzeros()[0] == 0);
+    BOOST_CHECK(DM::norm_inf(broken.getEstimationCovariance() - KiteUKF::DEFAULT_PROCESS_COVARIANCE).nonzeros()[0] < 1e-12);
+    BOOST_CHECK(broken.getTimeStamp() == 0.0);
+    BOOST_CHECK(broken.estimate(pose, 0.01));
+
+    /** indefinite innovation covariance : update skipped */
+    broken.setMeasurementCovariance(-DM::eye(6));
+    BOOST_CHECK(!broken.estimate(pose, 0.02));
+}
+
+BOOST_AUTO_TEST_CASE( mekf_test )
+{
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    RigidBodyKinematics rigid_body = RigidBodyKinematics(algo_props);
+
+    DM pose = DM::vertcat({1.4522, -3.1274, -1.7034, -0.5455, -0.2382, -0.2922, -0.7485});
+    pose(Slice(3,7)) /= DM::norm_2(pose(Slice(3,7)));
+    DM x_init = DM::vertcat({DM::zeros(6), pose(Slice(0,3)) + 0.1, -0.5486, -0.2354, -0.2922, -0.7471});
+
+    KiteEKF estimator(rigid_body.getNumericTransition());
+    estimator.setMultiplicative(true);
+    estimator.setControl(DM::zeros(3));
+    estimator.setEstimation(x_init);
+    estimator.setTime(0.0);
+
+    /** 100 Hz poses, a 0.5 s dropout after the first second : the filter only predicts */
+    double t = 0;
+    double max_norm_error = 0;
+    double max_asymmetry = 0;
+    DM P_steady, P_dropout;
+    for(int k = 0; k < 300; ++k)
+    {
+        t += 0.01;
+        if((k >= 100) && (k < 150))
+        {
+            estimator.propagate(0.01);
+            estimator.setTime(t);
+        }
+        else
+            BOOST_CHECK(estimator.estimate(pose, t));
+
+        DM x = estimator.getEstimation();
+        DM P = estimator.getEstimationCovariance();
+        max_norm_error = std::max(max_norm_error, std::fabs(DM::norm_2(x(Slice(9,13))).nonzeros()[0] - 1));
+        max_asymmetry = std::max(max_asymmetry, DM::norm_inf(P - P.T()).nonzeros()[0]);
+        if(k == 99)
+            P_steady = P;
+        else if(k == 149)
+            P_dropout = P;
+    }
+
+    DM P = estimator.getEstimationCovariance();
+    double trace_steady = DM::trace(P_steady).nonzeros()[0];
+    double recovery = DM::norm_inf(P - P_steady).nonzeros()[0] / DM::norm_inf(P_steady).nonzeros()[0];
+    std::cout << "MEKF_TEST trace before / after dropout: " << trace_steady << " / " << DM::trace(P_dropout)
+              << " relative covariance recovery error: " << recovery << "\n";
+
+    BOOST_CHECK(P.size1() == 12 && P.size2() == 12);
+    BOOST_CHECK(max_norm_error < 1e-12);
+    BOOST_CHECK(max_asymmetry == 0);
+    BOOST_CHECK(DM::trace(P_dropout).nonzeros()[0] > trace_steady);
+    BOOST_CHECK(recovery < 1e-2);
+    BOOST_CHECK(DM::norm_inf(estimator.getEstimation()(Slice(6,9)) - pose(Slice(0,3))).nonzeros()[0] < 1e-2);
+}
+
+/** field layout of sensor_msgs::MultiDOFJointState used by the state packing */
+namespace state_message
+{
+    struct Vector3 {double x, y, z;};
+    struct Quaternion {double x, y, z, w;};
+    struct Twist {Vector3 linear, angular;};
+    struct Transform {Vector3 translation; Quaternion rotation;};
+    struct MultiDOFJointState {std::vector<Twist> twist; std::vector<Transform> transforms;};
+}
+
+BOOST_AUTO_TEST_CASE( mhe_test )
+{
+    std::string kite_config_file = "umx_radian.yaml";
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_config_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    KiteDynamics kite(kite_props, algo_props, true);
+    Function dynamics = kite.getNumericDynamics();
+    DM params = KiteMHE::nominal_parameters(kite_props);
+
+    /** reference flight : RK4 at 100 Hz with constant control, poses at every step */
+    DM x = DM::vertcat({6.0026, -0.3965, 0.1705, 0.4414, -0.2068, 0.9293,
+                        1.4634, -3.1765, -1.7037, -0.5486, -0.2354, -0.2922, -0.7471});
+    DM u = DM({0.1, 0.02, -0.02});
+    const double dt = 0.01;
+    DMVector states;
+    for(int k = 0; k <= 40; ++k)
+    {
+        states.push_back(x);
+        DM k1 = dynamics(DMVector{x, u, params})[0];
+        DM k2 = dynamics(DMVector{x + 0.5 * dt * k1, u, params})[0];
+        DM k3 = dynamics(DMVector{x + 0.5 * dt * k2, u, params})[0];
+        DM k4 = dynamics(DMVector{x + dt * k3, u, params})[0];
+        x = x + (dt / 6) * (k1 + 2 * k2 + 2 * k3 + k4);
+    }
+
+    KiteMHE mhe(dynamics, 0.2);
+    mhe.setParameters(params);
+    mhe.setParameterBounds(params - 0.1 * DM::fabs(params), params + 0.1 * DM::fabs(params));
+    mhe.setEstimation(states[0]);
+    kmath::NLPSettings settings = mhe.getNLPSettings();
+    settings.max_iter = 20;
+    mhe.setNLPSettings(settings);
+    mhe.createNLP();
+
+    /** the window is not covered yet */
+    for(int k = 0; k <= 10; ++k)
+    {
+        mhe.addMeasurement(states[k](Slice(6, 13)), k * dt);
+        mhe.addControl(u, k * dt);
+    }
+    BOOST_CHECK(!mhe.estimate(10 * dt));
+
+    /** first window, then shifted windows warm started from the previous solution */
+    for(int k = 11; k <= 40; ++k)
+    {
+        mhe.addMeasurement(states[k](Slice(6, 13)), k * dt);
+        mhe.addControl(u, k * dt);
+        if((k == 20) || (k == 30) || (k == 40))
+        {
+            BOOST_CHECK(mhe.estimate(k * dt));
+            BOOST_CHECK(mhe.initialized());
+            BOOST_CHECK_CLOSE(mhe.getTimeStamp(), k * dt, 1e-9);
+
+            DM error = mhe.getEstimation() - states[k];
+            double pose_error = DM::norm_inf(error(Slice(6, 13))).nonzeros()[0];
+            double velocity_error = DM::norm_inf(error(Slice(0, 3))).nonzeros()[0];
+            std::cout << "MHE_TEST t: " << k * dt << " pose error: " << pose_error << " velocity error: " << velocity_error << "\n";
+            BOOST_CHECK(pose_error < 1e-2);
+            BOOST_CHECK(velocity_error < 0.5);
+            BOOST_CHECK(DM::norm_inf(mhe.getOptimalTrajectory()(Slice(), 0) - mhe.getEstimation()).nonzeros()[0] < 1e-2);
+        }
+    }
+
+    /** parameters stay in their box */
+    DM estimated = mhe.getParameters();
+    BOOST_CHECK(estimated.size1() == KiteMHE::NP);
+    BOOST_CHECK(DM::mmax(DM::fabs(estimated - params) - 0.1 * DM::fabs(params)).nonzeros()[0] < 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( state_message_test )
+{
+    /** ekf_node packing : corrected estimate to /kite_state, unpacked by nmpf_node and the state bus */
+    mocap::State estimate;
+    estimate << 6.0026, -0.3965, 0.1705, 0.4414, -0.2068, 0.9293,
+                1.4634, -3.1765, -1.7037, -0.5486, -0.2354, -0.2922, -0.7471;
+    mocap::State corrected = estimate - mocap::state_correction();
+
+    state_message::MultiDOFJointState msg;
+    mocap::state_to_message(corrected, msg);
+    BOOST_CHECK(msg.twist.size() == 1 && msg.transforms.size() == 1);
+    BOOST_CHECK(msg.twist[0].linear.x == corrected(0));
+    BOOST_CHECK(msg.twist[0].angular.z == corrected(5));
+    BOOST_CHECK(msg.transforms[0].translation.x == corrected(6));
+    BOOST_CHECK(msg.transforms[0].rotation.w == corrected(9));
+    BOOST_CHECK(msg.transforms[0].rotation.z == corrected(12));
+
+    mocap::State unpacked = mocap::message_to_state(msg);
+    BOOST_CHECK(unpacked == corrected);
+    BOOST_CHECK((unpacked + mocap::state_correction() - estimate).cwiseAbs().maxCoeff() < 1e-15);
+}
+
+BOOST_AUTO_TEST_CASE( replay_order_test )
+{
+    /** pose 0.03 arrived after 0.04 : replayed late unless sorted */
+    replay::Table poses    = {{0.01, 1}, {0.02, 2}, {0.04, 4}, {0.03, 3}, {0.05, 5}};
+    replay::Table controls = {{0.00, 0}, {0.02, 2}, {0.045, 4}, {0.06, 6}};
+
+    std::vector<replay::Record> records = replay::merge(poses, controls);
+    std::vector<std::pair<bool, double>> order;
+    for(const replay::Record &record : records)
+        order.push_back({record.control, record.t});
+    std::vector<std::pair<bool, double>> expected = {{true, 0.00}, {false, 0.01}, {true, 0.02}, {false, 0.02},
+                                                     {false, 0.04}, {false, 0.03}, {true, 0.045}, {false, 0.05}};
+    BOOST_CHECK(order == expected);
+    BOOST_CHECK(poses[records[5].index][1] == 3);
+
+    replay::sort_by_stamp(poses);
+    records = replay::merge(poses, controls);
+    BOOST_CHECK(records.size() == 8);
+    BOOST_CHECK(!records[4].control && (records[4].t == 0.03));
+    BOOST_CHECK(!records[5].control && (records[5].t == 0.04));
+}
+
 
 BOOST_AUTO_TEST_CASE( lqr_test )
 {
@@ -149,6 +539,319 @@ BOOST_AUTO_TEST_CASE( lqr_test )
     BOOST_CHECK(true);
 }
 
+BOOST_AUTO_TEST_CASE( lqr_table_test )
+{
+    /** synthetic table : reference speed and thrust grow along the path, gain on the velocity error only */
+    const int N = 8;
+    Eigen::MatrixXd x_ref = Eigen::MatrixXd::Zero(13, N);
+    Eigen::MatrixXd u_ref = Eigen::MatrixXd::Zero(3, N);
+    std::vector<Eigen::MatrixXd> gains(N, Eigen::MatrixXd::Zero(3, 12));
+    std::vector<bool> stable(N, true);
+    for(int i = 0; i < N; ++i)
+    {
+        x_ref(0, i) = 3.0 + 0.1 * i;
+        x_ref(9, i) = 1.0;
+        u_ref(0, i) = 0.1 + 0.005 * i;
+        gains[i](0, 0) = 0.01 * (i + 1);
+    }
+    stable[5] = false;
+
+    KiteLQR lqr;
+    lqr.setTable(0, 2 * M_PI, x_ref, u_ref, gains, stable);
+    const double step = 2 * M_PI / N;
+    Eigen::VectorXd control(3);
+
+    /** reference control on the reference state */
+    BOOST_CHECK(lqr.evaluate(x_ref.col(2), 2 * step, control));
+    BOOST_CHECK_CLOSE(control(0), u_ref(0, 2), 1e-6);
+
+    /** linear interpolation between grid points */
+    Eigen::VectorXd state = 0.5 * (x_ref.col(2) + x_ref.col(3));
+    state(0) += 1.0;
+    lqr.evaluate(state, 2.5 * step, control);
+    BOOST_CHECK_CLOSE(control(0), 0.5 * (u_ref(0, 2) + u_ref(0, 3)) - 0.035, 1e-6);
+
+    /** closed path : theta wraps around, last interval interpolates back to the first point */
+    lqr.evaluate(x_ref.col(1), 2 * M_PI + step, control);
+    BOOST_CHECK_CLOSE(control(0), u_ref(0, 1), 1e-6);
+    lqr.evaluate(0.5 * (x_ref.col(N - 1) + x_ref.col(0)), -0.5 * step, control);
+    BOOST_CHECK_CLOSE(control(0), 0.5 * (u_ref(0, N - 1) + u_ref(0, 0)), 1e-6);
+
+    /** attitude error : q and -q give the same control */
+    state = x_ref.col(2);
+    state.tail<4>() << -1, 0, 0, 0;
+    lqr.evaluate(state, 2 * step, control);
+    BOOST_CHECK_CLOSE(control(0), u_ref(0, 2), 1e-6);
+
+    /** unstable linearizations are reported */
+    BOOST_CHECK(!lqr.evaluate(x_ref.col(5), 5 * step, control));
+
+    /** saturation */
+    Eigen::VectorXd lbu(3), ubu(3);
+    lbu << 0.1, -0.12, -0.12;
+    ubu << 0.15, 0.12, 0.12;
+    lqr.setControlBounds(lbu, ubu);
+    state = x_ref.col(2);
+    state(0) -= 100.0;
+    lqr.evaluate(state, 2 * step, control);
+    BOOST_CHECK_CLOSE(control(0), 0.15, 1e-6);
+
+    /** file round trip */
+    lqr.save("lqr_table_test.yaml");
+    KiteLQR loaded("lqr_table_test.yaml");
+    Eigen::VectorXd loaded_control(3);
+    state = 0.3 * x_ref.col(6) + 0.7 * x_ref.col(7);
+    lqr.evaluate(state, 6.7 * step, control);
+    loaded.evaluate(state, 6.7 * step, loaded_control);
+    BOOST_CHECK_SMALL((control - loaded_control).norm(), 1e-9);
+    BOOST_CHECK_EQUAL(loaded.size(), N);
+
+    /** evaluation time */
+    const int num_evaluations = 10000;
+    kite_utils::time_point start = kite_utils::get_time();
+    for(int k = 0; k < num_evaluations; ++k)
+        lqr.evaluate(state, k * 1e-3, control);
+    kite_utils::time_point finish = kite_utils::get_time();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(finish - start);
+    std::cout << "LQR table evaluation : " << static_cast<double>(duration.count()) / num_evaluations << " [us] \n";
+}
+
+BOOST_AUTO_TEST_CASE( policy_test )
+{
+    /** smooth map on two clusters of the plane : the gap between them is in the training box but never sampled */
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> distribution(0.5, 1.0);
+    auto sample = [&](const int &num, Eigen::MatrixXd &states, Eigen::MatrixXd &controls)
+    {
+        states.resize(2, num);
+        controls.resize(2, num);
+        for(int k = 0; k < num; ++k)
+        {
+            double sign = (k % 2) ? 1.0 : -1.0;
+            states.col(k) << sign * distribution(generator), 2 * distribution(generator) - 1.5;
+            controls.col(k) << std::sin(states(0, k)) + 0.5 * states(1, k), states(0, k) * states(1, k);
+        }
+    };
+    Eigen::MatrixXd X_train, U_train, X_val, U_val;
+    sample(2000, X_train, U_train);
+    sample(500, X_val, U_val);
+
+    KitePolicy policy;
+    policy.setControlBounds(Eigen::Vector2d(-2, -2), Eigen::Vector2d(2, 2));
+    policy.fit(X_train, U_train, 100);
+    BOOST_CHECK(!policy.validated());
+    double max_error = policy.validate(X_val, U_val, 0.05, 0.1);
+    std::cout << "POLICY_TEST max validation error: " << max_error << "\n";
+    BOOST_CHECK(max_error < 0.05);
+    BOOST_CHECK(policy.validated());
+
+    Eigen::VectorXd control(2);
+    BOOST_CHECK(policy.evaluate(X_val.col(0), control));
+    BOOST_CHECK((control - U_val.col(0)).lpNorm<Eigen::Infinity>() < 0.05);
+    /** outside the training box, and inside it but away from the validated samples */
+    BOOST_CHECK(!policy.evaluate(Eigen::Vector2d(2.0, 0.0), control));
+    BOOST_CHECK(!policy.evaluate(Eigen::Vector2d(0.0, 0.0), control));
+    BOOST_CHECK(!policy.inDomain(Eigen::Vector2d(0.0, 0.0)));
+
+    /** save / load round trip */
+    policy.save("policy_test.yaml");
+    KitePolicy loaded("policy_test.yaml");
+    BOOST_CHECK(loaded.validated());
+    BOOST_CHECK_EQUAL(loaded.maxError(), policy.maxError());
+    Eigen::VectorXd loaded_control(2);
+    for(int k = 0; k < 20; ++k)
+    {
+        BOOST_CHECK_EQUAL(loaded.evaluate(X_val.col(k), loaded_control), policy.evaluate(X_val.col(k), control));
+        BOOST_CHECK((loaded_control - control).lpNorm<Eigen::Infinity>() < 1e-12);
+    }
+    BOOST_CHECK(!loaded.evaluate(Eigen::Vector2d(0.0, 0.0), control));
+}
+
+BOOST_AUTO_TEST_CASE( riccati_test )
+{
+    typedef kmath::oc::RiccatiSolver<2, 2> Solver;
+    Solver::MatrixX A, Q;
+    Solver::MatrixB B;
+    Solver::MatrixU R;
+    A << 1, 1, 4, -2;
+    B.setIdentity();
+    Q.setIdentity();
+    R.setIdentity();
+
+    /** against the dynamic solver */
+    Solver riccati(Q, R);
+    BOOST_CHECK(riccati.care(A, B));
+    Eigen::MatrixXd K = kmath::oc::lqr(kmath::LinearSystem(A, B, Eigen::MatrixXd()), Q, R, Eigen::MatrixXd::Zero(2, 2));
+    BOOST_CHECK_SMALL((riccati.gain() - K).norm(), 1e-4);
+    BOOST_CHECK_SMALL(riccati.residual(), 1e-8);
+    BOOST_CHECK(!riccati.warm_started());
+
+    /** unstable complex pair : shift of the Bass gain from the real part of the 2x2 Schur block */
+    Solver::MatrixX Ao;
+    Ao << 0.5, 10, -20, 0.5;
+    Solver oscillator(Q, R);
+    BOOST_CHECK(oscillator.care(Ao, B));
+    BOOST_CHECK_SMALL(oscillator.residual(), 1e-8);
+    BOOST_CHECK((Ao - B * oscillator.gain()).eigenvalues().real().maxCoeff() < 0);
+
+    /** slowly varying linearization : warm start from the previous gain */
+    typedef kmath::oc::RiccatiSolver<12, 3> KiteSolver;
+    KiteSolver::MatrixX Ak = KiteSolver::MatrixX::Random() - 0.5 * KiteSolver::MatrixX::Identity();
+    KiteSolver::MatrixB Bk = KiteSolver::MatrixB::Random();
+    KiteSolver kite_riccati(KiteSolver::MatrixX::Identity(), 10 * KiteSolver::MatrixU::Identity());
+    BOOST_CHECK(kite_riccati.care(Ak, Bk));
+    const int cold_iterations = kite_riccati.iterations();
+
+    kite_utils::time_point start = kite_utils::get_time();
+    for(int k = 0; k < 10; ++k)
+    {
+        Ak(0, 0) += 1e-3;
+        BOOST_CHECK(kite_riccati.care(Ak, Bk));
+        BOOST_CHECK(kite_riccati.warm_started());
+        BOOST_CHECK(kite_riccati.iterations() < cold_iterations);
+    }
+    kite_utils::time_point finish = kite_utils::get_time();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(finish - start);
+    std::cout << "Warm started CARE [12 x 3] : " << static_cast<double>(duration.count()) / 10 << " [us] \n";
+
+    KiteSolver::MatrixX X = kite_riccati.solution();
+    KiteSolver::MatrixX residual = Ak.transpose() * X + X * Ak - 0.1 * X * Bk * Bk.transpose() * X + KiteSolver::MatrixX::Identity();
+    BOOST_CHECK_SMALL(residual.norm(), 1e-6);
+    BOOST_CHECK((Ak - Bk * kite_riccati.gain()).eigenvalues().real().maxCoeff() < 0);
+
+    /** discrete time : closed loop inside the unit circle */
+    KiteSolver::MatrixX Ad = KiteSolver::MatrixX::Identity() + 0.02 * Ak;
+    KiteSolver::MatrixB Bd = 0.02 * Bk;
+    BOOST_CHECK(kite_riccati.dare(Ad, Bd));
+    BOOST_CHECK_SMALL(kite_riccati.residual(), 1e-6);
+    BOOST_CHECK((Ad - Bd * kite_riccati.gain()).eigenvalues().cwiseAbs().maxCoeff() < 1);
+    Ad(0, 0) += 1e-4;
+    BOOST_CHECK(kite_riccati.dare(Ad, Bd));
+    BOOST_CHECK(kite_riccati.warm_started());
+}
+
+BOOST_AUTO_TEST_CASE( path_projection_test )
+{
+    std::string kite_config_file = "umx_radian.yaml";
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_config_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, algo_props);
+    Function path = nmpf_utils::circular_path();
+    KiteNMPF controller(kite, path);
+
+    /** orbit center and normal */
+    auto point = [&](const double &theta){std::vector<double> p = path(DMVector{DM(theta)})[0].nonzeros();
+                                           return Eigen::Vector3d(p[0], p[1], p[2]);};
+    Eigen::Vector3d center = 0.5 * (point(0) + point(M_PI));
+    Eigen::Vector3d normal = (point(0) - center).cross(point(0.5 * M_PI) - center).normalized();
+
+    /** points off the path : outside the orbit and off its plane, the closest point is at theta */
+    const double period = 2 * M_PI;
+    struct Case {double theta; double guess; double expected;};
+    std::vector<Case> cases = {{0.3, 0.0, 0.3}, {2.0, 2.0, 2.0}, {4.5, 4.0, 4.5},
+                               {0.3, 2 * period, 0.3 + 2 * period},
+                               /** near the wrap point, on both sides */
+                               {period - 1e-3, 0.0, -1e-3}, {period - 1e-3, period, period - 1e-3},
+                               {1e-3, period, period + 1e-3}, {1e-3, 0.0, 1e-3}};
+    for(const Case &test : cases)
+    {
+        Eigen::Vector3d p = center + 1.2 * (point(test.theta) - center) + 0.3 * normal;
+        double theta = controller.findClosestPointOnPath(DM(std::vector<double>(p.data(), p.data() + 3)), DM(test.guess)).nonzeros()[0];
+        std::cout << "PATH_PROJECTION_TEST theta: " << test.theta << " guess: " << test.guess << " found: " << theta << "\n";
+        BOOST_CHECK(std::fabs(theta - test.expected) < 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( quaternion_test )
+{
+    /** numeric versions against the symbolic reference */
+    DM q_dm = DM::vertcat({0.3, 0.5, -0.2, 0.7});
+    q_dm = q_dm / DM::norm_2(q_dm);
+    DM v_dm = DM::vertcat({1.0, 2.0, 3.0});
+    DM p_dm = DM::vertcat({0.9, -0.1, 0.3, 0.2});
+
+    std::vector<double> ref_transform = DM(kmath::quat_transform(SX(q_dm), SX(v_dm))).nonzeros();
+    std::vector<double> ref_multiply  = DM(kmath::quat_multiply(SX(q_dm), SX(p_dm))).nonzeros();
+
+    Eigen::Vector4d q = Eigen::Vector4d::Map(q_dm.ptr());
+    Eigen::Vector4d p = Eigen::Vector4d::Map(p_dm.ptr());
+    Eigen::Vector3d v = Eigen::Vector3d::Map(v_dm.ptr());
+
+    std::vector<double> dm_transform = kmath::quat_transform(q_dm, v_dm).nonzeros();
+    Eigen::Vector3d eig_transform = kmath::quat_transform(q, v);
+    Eigen::Vector3d rot_transform = kmath::quat_rotation_matrix(q) * v;
+    double raw_transform[3];
+    kmath::quat_transform(q.data(), v.data(), raw_transform);
+    Eigen::Vector4d eig_multiply = kmath::quat_multiply(q, p);
+
+    double error = 0;
+    for(int i = 0; i < 3; ++i)
+        error = std::max(error, std::max(std::fabs(dm_transform[i] - ref_transform[i]),
+                         std::max(std::fabs(eig_transform(i) - ref_transform[i]),
+                         std::max(std::fabs(rot_transform(i) - ref_transform[i]), std::fabs(raw_transform[i] - ref_transform[i])))));
+    for(int i = 0; i < 4; ++i)
+        error = std::max(error, std::fabs(eig_multiply(i) - ref_multiply[i]));
+
+    /** batched versions against the single ones */
+    const int N = 1000;
+    Eigen::Matrix<double, Eigen::Dynamic, 4> Q1 = Eigen::MatrixXd::Random(N, 4);
+    Eigen::Matrix<double, Eigen::Dynamic, 4> Q2 = Eigen::MatrixXd::Random(N, 4);
+    Eigen::Matrix<double, Eigen::Dynamic, 4> Q;
+    Eigen::Matrix<double, Eigen::Dynamic, 3> V = Eigen::MatrixXd::Random(N, 3), W;
+
+    kite_utils::time_point start = kite_utils::get_time();
+    kmath::quat_multiply_batch(Q1, Q2, Q);
+    kmath::quat_transform_batch(q, V, W);
+    kite_utils::time_point finish = kite_utils::get_time();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(finish - start);
+    std::cout << "Batched quaternion operations [" << N << "] : " << duration.count() << " [microseconds] \n";
+
+    for(int i = 0; i < N; ++i)
+    {
+        error = std::max(error, (Q.row(i).transpose() - kmath::quat_multiply(Q1.row(i).transpose(), Q2.row(i).transpose())).norm());
+        error = std::max(error, (W.row(i).transpose() - kmath::quat_transform(q, V.row(i).transpose())).norm());
+    }
+
+    BOOST_CHECK(error < 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE( nlp_telemetry_test )
+{
+    /** stats key names of different CasADi versions */
+    Dict old_stats = {{"return_status", "Solve_Succeeded"}, {"iter_count", 12}, {"t_wall_eval_f", 0.001},
+                      {"t_wall_eval_grad_f", 0.002}, {"t_wall_eval_g", 0.003}, {"t_wall_eval_jac_g", 0.004},
+                      {"t_wall_eval_h", 0.005}, {"t_wall_mainloop", 0.025}};
+    Dict new_stats = {{"return_status", "Maximum_Iterations_Exceeded"}, {"success", false}, {"iter_count", 40},
+                      {"t_wall_nlp_f", 0.001}, {"t_wall_nlp_hess_l", 0.005}, {"t_wall_total", 0.010}};
+
+    kmath::NLPTelemetry old_telemetry = kmath::nlp_telemetry(old_stats);
+    BOOST_CHECK(old_telemetry.success);
+    BOOST_CHECK_EQUAL(old_telemetry.iter_count, 12);
+    BOOST_CHECK_CLOSE(old_telemetry.t_eval_jac_g, 4.0, 1e-9);
+    BOOST_CHECK_CLOSE(old_telemetry.t_solver_overhead, 10.0, 1e-9);
+
+    kmath::NLPTelemetry new_telemetry = kmath::nlp_telemetry(new_stats);
+    BOOST_CHECK(!new_telemetry.success);
+    BOOST_CHECK_EQUAL(new_telemetry.return_status, "Maximum_Iterations_Exceeded");
+    BOOST_CHECK_CLOSE(new_telemetry.t_eval_hess, 5.0, 1e-9);
+    BOOST_CHECK(new_telemetry.t_eval_g < 0);
+    BOOST_CHECK_CLOSE(new_telemetry.t_solver_overhead, 4.0, 1e-9);
+
+    /** equality and one-sided constraints */
+    DM g   = DM::vertcat({0.1, -2.0, 3.0});
+    DM lbg = DM::vertcat({0.0, -1.0, -DM::inf(1)});
+    DM ubg = DM::vertcat({0.0, 1.0, 2.5});
+    BOOST_CHECK_CLOSE(kmath::constraint_violation(g, lbg, ubg), 1.0, 1e-9);
+    BOOST_CHECK_EQUAL(kmath::constraint_violation(DM::zeros(3), DM(0), DM(0)), 0.0);
+
+    /** concurrent solver instances */
+    BOOST_CHECK(kmath::nlp_thread_safe(kmath::nlp_settings_from_string("ipopt:ma97")));
+    BOOST_CHECK(!kmath::nlp_thread_safe(kmath::nlp_settings_from_string("ipopt:mumps")));
+    BOOST_CHECK(kmath::nlp_thread_safe(kmath::nlp_settings_from_string("sqpmethod:qpoases")));
+}
+
 SX ode(const SX &x, const SX &u, const SX &p)
 {
     SX f = SX::zeros(2,1);
@@ -0,0 +1,233 @@
+#include "kite.h"
+#include "nlp_backend.h"
+#include "yaml-cpp/yaml.h"
+
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace casadi;
+
+/** Multi-experiment identification of the aerodynamic coefficients (KiteDynamics(props, algo, true)).
+ *  Every flight record is cut into segments of equal length; a segment is transcribed by multiple shooting
+ *  with one shooting node per sample and RK4 substeps in between. All segments share the parameter vector.
+ *  The segment cost and continuity constraints are one casadi Function mapped over the segments with thread
+ *  parallelization, so the NLP graph does not grow with the number of flights and the evaluation uses all cores.
+ *  Parameters are warm started from the kite parameter file, the shooting nodes from the measured states;
+ *  the identified coefficients are written to a copy of the parameter file.
+ *
+ *  dataset file:
+ *    segment_length: 50                # samples per segment, shorter flight tails are dropped
+ *    substeps: 2                       # RK4 steps per sample
+ *    regularization: 0.01              # relative deviation from the initial parameters
+ *    flights:
+ *      - state: flight1_state.txt      # 13 values per line [v, w, r, q], forward time
+ *        control: flight1_control.txt  # 3 values per line [T, dE, dR]
+ *        dt: 0.02                      # sampling time [s]
+ *
+ *  usage: kite_identification kite_params.yaml dataset.yaml kite_params_id.yaml [num_threads] [nlp_backend]
+ */
+
+namespace
+{
+    const int DIMX = 13;
+    const int DIMU = 3;
+    const int DIMP = 21;
+
+    /** identified coefficients in KiteDynamics parameter order, with the box relative to the initial value */
+    struct Coefficient
+    {
+        std::string name;
+        double lower;
+        double upper;
+    };
+
+    const std::vector<Coefficient> COEFFICIENTS = {
+        {"CL0", 0.1, 0.1},  {"CLa_total", 0.05, 0.1}, {"CD0_total", 0.1, 0.25}, {"CYb", 0.5, 0.5},
+        {"Cm0", 0.5, 0.5},  {"Cma", 0.1, 0.3},        {"Cnb", 0.5, 0.5},        {"Clb", 0.5, 0.5},
+        {"CLq", 0.2, 0.2},  {"Cmq", 0.3, 0.3},        {"CYr", 0.3, 0.3},        {"Cnr", 0.5, 0.5},
+        {"Clr", 0.5, 0.5},  {"CYp", 0.5, 0.5},        {"Clp", 0.5, 0.5},        {"Cnp", 0.3, 1.0},
+        {"CLde", 0.5, 0.5}, {"CYdr", 0.5, 0.5},       {"Cmde", 0.5, 0.5},       {"Cndr", 0.5, 0.5},
+        {"Cldr", 0.5, 0.5}};
+
+    /** fitting weights of the state components */
+    const std::vector<double> STATE_WEIGHTS = {1e3, 1e2, 1e2, 1e2, 1e2, 1e2, 1e1, 1e1, 1e2, 1e2, 1e2, 1e2, 1e2};
+
+    /** whitespace separated samples, one per line : [dim x N] */
+    DM load_samples(const std::string &filename, const int &dim)
+    {
+        std::ifstream file(filename, std::ios::in);
+        if(file.fail())
+            throw std::runtime_error("kite_identification: could not open data file: " + filename);
+
+        std::vector<double> values;
+        double entry;
+        while(file >> entry)
+            values.push_back(entry);
+
+        const int num_samples = static_cast<int>(values.size()) / dim;
+        values.resize(num_samples * dim);
+        return DM::reshape(DM(values), dim, num_samples);
+    }
+
+    /** cost and shooting gaps of one segment : Function({X[13 x L], U[3 x L], Y[13 x L], p, dt}) -> (cost, gaps) */
+    Function segment_function(const Function &dynamics, const int &length, const int &substeps, const double &cost_scale)
+    {
+        SX X  = SX::sym("X", DIMX, length);
+        SX U  = SX::sym("U", DIMU, length);
+        SX Y  = SX::sym("Y", DIMX, length);
+        SX p  = SX::sym("p", DIMP);
+        SX dt = SX::sym("dt");
+
+        SX W = SX(DM(STATE_WEIGHTS));
+        SX cost = 0;
+        SXVector gaps;
+        const SX h = dt / substeps;
+        for(int k = 0; k < length; ++k)
+        {
+            SX error = X(Slice(), k) - Y(Slice(), k);
+            cost += cost_scale * SX::dot(W * error, error);
+            if(k == length - 1)
+                break;
+
+            /** RK4 over one sample, control held */
+            SX x = X(Slice(), k);
+            SX u = U(Slice(), k);
+            for(int i = 0; i < substeps; ++i)
+            {
+                SX k1 = dynamics(SXVector{x, u, p})[0];
+                SX k2 = dynamics(SXVector{x + 0.5 * h * k1, u, p})[0];
+                SX k3 = dynamics(SXVector{x + 0.5 * h * k2, u, p})[0];
+                SX k4 = dynamics(SXVector{x + h * k3, u, p})[0];
+                x = x + (h / 6) * (k1 + 2 * k2 + 2 * k3 + k4);
+            }
+            gaps.push_back(x - X(Slice(), k + 1));
+        }
+
+        return Function("segment", {X, U, Y, p, dt}, {cost, SX::vertcat(gaps)});
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 4)
+    {
+        std::cerr << "usage: kite_identification kite_params.yaml dataset.yaml kite_params_id.yaml [num_threads] [nlp_backend] \n";
+        return 1;
+    }
+    std::string kite_params_file = argv[1];
+    std::string dataset_file     = argv[2];
+    std::string output_file      = argv[3];
+    int num_threads = (argc > 4) ? std::atoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+    std::string nlp_backend = (argc > 5) ? argv[5] : "ipopt:ma97";
+
+    /** segment the flights */
+    YAML::Node dataset = YAML::LoadFile(dataset_file);
+    const int length   = dataset["segment_length"] ? dataset["segment_length"].as<int>() : 50;
+    const int substeps = dataset["substeps"] ? dataset["substeps"].as<int>() : 2;
+    const double regularization = dataset["regularization"] ? dataset["regularization"].as<double>() : 1e-2;
+
+    DMVector measured, controls;
+    std::vector<double> sampling_times;
+    for(const YAML::Node &flight : dataset["flights"])
+    {
+        DM states  = load_samples(flight["state"].as<std::string>(), DIMX);
+        DM control = load_samples(flight["control"].as<std::string>(), DIMU);
+        const double dt = flight["dt"] ? flight["dt"].as<double>() : 0.02;
+
+        const int num_samples = std::min(states.size2(), control.size2());
+        for(int start = 0; start + length <= num_samples; start += length)
+        {
+            measured.push_back(states(Slice(), Slice(start, start + length)));
+            controls.push_back(control(Slice(), Slice(start, start + length)));
+            sampling_times.push_back(dt);
+        }
+        std::cout << flight["state"].as<std::string>() << " : " << num_samples << " samples \n";
+    }
+
+    const int num_segments = static_cast<int>(measured.size());
+    if(num_segments == 0)
+        throw std::runtime_error("kite_identification: no segment of " + std::to_string(length) + " samples in the dataset");
+    std::cout << num_segments << " segments of " << length << " samples, " << num_threads << " threads \n";
+
+    /** initial parameters and bounds from the current parameter file */
+    YAML::Node config = YAML::LoadFile(kite_params_file);
+    DM REF_P = DM::zeros(DIMP), LBP = DM::zeros(DIMP), UBP = DM::zeros(DIMP);
+    for(int i = 0; i < DIMP; ++i)
+    {
+        double value = config["aerodynamic"][COEFFICIENTS[i].name].as<double>();
+        REF_P(i) = value;
+        LBP(i) = value - COEFFICIENTS[i].lower * std::fabs(value);
+        UBP(i) = value + COEFFICIENTS[i].upper * std::fabs(value);
+    }
+
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_params_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    KiteDynamics kite(kite_props, algo_props, true);
+
+    /** mapped segments : inputs and outputs are concatenated horizontally over the segments */
+    Function segment = segment_function(kite.getNumericDynamics(), length, substeps, 1.0 / (num_segments * length));
+    Function segments = segment.map(num_segments, "thread", num_threads);
+
+    DM Y  = DM::horzcat(measured);
+    DM U  = DM::horzcat(controls);
+    DM DT = DM(sampling_times).T();
+
+    MX X = MX::sym("X", DIMX, num_segments * length);
+    MX P = MX::sym("P", DIMP);
+    MXVector out = segments(MXVector{X, MX(U), MX(Y), MX::repmat(P, 1, num_segments), MX(DT)});
+
+    MX deviation = (P - REF_P) / MX(DM::fmax(DM::fabs(REF_P), 1e-3));
+    MX cost = MX::sum2(out[0]) + regularization * MX::dot(deviation, deviation);
+    MX gaps = MX::vec(out[1]);
+
+    MXDict nlp = {{"x", MX::vertcat({MX::vec(X), P})}, {"f", cost}, {"g", gaps}};
+    kmath::NLPSettings settings = kmath::nlp_settings_from_string(nlp_backend);
+    settings.max_iter    = 500;
+    settings.tol         = 1e-6;
+    settings.print_level = 5;
+    Function solver = kmath::nlp_solver("identification", nlp, settings);
+
+    /** state box of the identification experiments */
+    DM LBX = DM::vertcat({2.0, -DM::inf(2), -4 * M_PI * DM::ones(3), -DM::inf(3), -1.05 * DM::ones(4)});
+    DM UBX = DM::vertcat({DM::inf(3), 4 * M_PI * DM::ones(3), DM::inf(3), 1.05 * DM::ones(4)});
+
+    DMDict arg;
+    arg["x0"]  = DM::vertcat({DM::vec(Y), REF_P});
+    arg["lbx"] = DM::vertcat({DM::repmat(LBX, num_segments * length, 1), LBP});
+    arg["ubx"] = DM::vertcat({DM::repmat(UBX, num_segments * length, 1), UBP});
+    arg["lbg"] = DM::zeros(gaps.size1());
+    arg["ubg"] = DM::zeros(gaps.size1());
+
+    DMDict res = solver(arg);
+    Dict stats = solver.stats();
+    DM result = res.at("x");
+    DM params = result(Slice(result.size1() - DIMP, result.size1()));
+    std::vector<double> params_vec = params.nonzeros();
+    std::vector<double> ref_vec = REF_P.nonzeros();
+
+    /** per segment fit : outliers point at bad records */
+    DM X_opt = DM::reshape(result(Slice(0, DIMX * num_segments * length)), DIMX, num_segments * length);
+    DMVector fit = segments(DMVector{X_opt, U, Y, DM::repmat(params, 1, num_segments), DT});
+    std::vector<double> segment_cost = fit[0].nonzeros();
+    auto worst = std::max_element(segment_cost.begin(), segment_cost.end());
+    std::cout << "Solver: " << (kmath::nlp_converged(stats) ? "converged" : "NOT converged")
+              << ", cost: " << res.at("f").nonzeros()[0] << ", worst segment: " << std::distance(segment_cost.begin(), worst)
+              << " (" << *worst << ") \n";
+
+    for(int i = 0; i < DIMP; ++i)
+    {
+        std::cout << std::setw(10) << COEFFICIENTS[i].name << " : " << std::setw(12) << ref_vec[i] << " -> " << std::setw(12) << params_vec[i] << "\n";
+        config["aerodynamic"][COEFFICIENTS[i].name] = params_vec[i];
+    }
+
+    std::ofstream fout(output_file);
+    fout << config;
+    std::cout << "Identified parameters saved to: " << output_file << "\n";
+
+    return kmath::nlp_converged(stats) ? 0 : 1;
+}
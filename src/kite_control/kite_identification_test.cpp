@@ -350,5 +350,41 @@ BOOST_AUTO_TEST_CASE( first_id_test )
     BOOST_CHECK(true);
 }
 
+BOOST_AUTO_TEST_CASE( collocate_id_cost_test )
+{
+    /** data in forward time has to match the reversed collocation nodes */
+    const int num_segments = 2;
+    const int poly_order   = 4;
+    const int dimx         = 2;
+    const int num_nodes    = num_segments * poly_order + 1;
+
+    Chebyshev<SX, poly_order, num_segments, dimx, 1, 0> spectral;
+    SX x = SX::sym("x", dimx);
+    SX y = SX::sym("y", dimx);
+    Function IdCost = Function("IdCost", {x, y}, {SX::sumRows(pow(x - y, 2))});
+
+    DM data = DM::zeros(dimx, num_nodes);
+    DM trajectory = DM::zeros(dimx * num_nodes);
+    for(int n = 0; n < num_nodes; ++n)
+    {
+        data(Slice(), num_nodes - 1 - n) = DM({static_cast<double>(n), 1.0 - n});
+        trajectory(Slice(n * dimx, (n + 1) * dimx)) = DM({static_cast<double>(n), 1.0 - n});
+    }
+
+    SX cost = spectral.CollocateIdCost(IdCost, data, 0, 1.0);
+    Function CostFunc = Function("cost", {spectral.VarX()}, {cost});
+    double fit   = CostFunc(DMVector{trajectory})[0].nonzeros()[0];
+    double unfit = CostFunc(DMVector{trajectory + 1})[0].nonzeros()[0];
+
+    /** symbolic data gives the same cost */
+    SX sym_data = SX::sym("data", dimx, num_nodes);
+    SX sym_cost = spectral.CollocateIdCost(IdCost, sym_data, 0, 1.0);
+    Function SymCostFunc = Function("sym_cost", {spectral.VarX(), sym_data}, {sym_cost});
+    double sym_unfit = SymCostFunc(DMVector{trajectory + 1, data})[0].nonzeros()[0];
+
+    BOOST_CHECK_SMALL(fit, 1e-12);
+    BOOST_CHECK_CLOSE(unfit, 2.0, 1e-6);
+    BOOST_CHECK_CLOSE(sym_unfit, unfit, 1e-6);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
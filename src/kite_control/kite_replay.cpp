@@ -0,0 +1,413 @@
+#include "kiteNMPF.h"
+#include "kiteEKF.h"
+#include "mocap_frame.hpp"
+#include "flight_log.h"
+#include "kite_replay.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+
+using namespace casadi;
+
+/** Deterministic replay of recorded flights through the estimator and the controller, no ROS required
+ *
+ *  usage: kite_replay pose.log [control.log] [--params kite_params.yaml] [--out replay.txt] [--speed k]
+ *                     [--control-rate 14] [--delay 0.1] [--history 50] [--multiplicative] [--sort]
+ *
+ *  pose.log    : simple_logger pose stream (.oklog), its text export (t x y z qw qx qy qz) or rosbag_parser csv
+ *  control.log : simple_logger control stream (.oklog), its text export (t ch0 ch1 ch2 ch3) or rosbag_parser csv of /chatter
+ *
+ *  Records are replayed in logged (arrival) order, late poses included, and the two logs are merged by their
+ *  time stamps (see kite_replay.hpp); --sort orders each log by time stamp first. The virtual clock follows the
+ *  latest stamp replayed : as fast as possible by default, paced at k times real time with --speed k.
+ *  The estimator is set up as in ekf_node, the controller (only with --params) as in nmpf_node with the
+ *  estimator prediction over the transport delay, ticking at --control-rate on the virtual clock. The output contains no wall clock values and can be diffed :
+ *      est t state[13]                          - after every pose, as published on /kite_state
+ *      ctl t thrust elevator rudder status iter - after every controller tick
+ */
+
+namespace
+{
+    typedef replay::Table Table;
+
+    std::vector<std::string> split(const std::string &line, const char &delimiter)
+    {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while(std::getline(stream, field, delimiter))
+            fields.push_back(field);
+        return fields;
+    }
+
+    Table read_oklog(const std::string &filename, const size_t &num_columns)
+    {
+        flight_log::FlightLogReader reader(filename);
+        if(reader.columns().size() < num_columns)
+            throw std::runtime_error("kite_replay: unexpected number of columns in log: " + filename);
+
+        Table table(reader.rows(), std::vector<double>(num_columns));
+        for(size_t c = 0; c < num_columns; ++c)
+        {
+            std::vector<double> values = reader.columnValues(c);
+            for(size_t r = 0; r < values.size(); ++r)
+                table[r][c] = values[r];
+        }
+        return table;
+    }
+
+    /** whitespace separated rows, lines starting with '#' are skipped */
+    Table read_text(std::ifstream &file, const size_t &num_columns)
+    {
+        Table table;
+        std::string line;
+        while(std::getline(file, line))
+        {
+            if(line.empty() || line[0] == '#')
+                continue;
+            std::istringstream stream(line);
+            std::vector<double> row;
+            double value;
+            while(stream >> value)
+                row.push_back(value);
+
+            if(row.size() < num_columns)
+                throw std::runtime_error("kite_replay: unexpected number of columns in log: " + std::to_string(row.size()));
+            row.resize(num_columns);
+            table.push_back(row);
+        }
+        return table;
+    }
+
+    /** rosbag_parser output : ';' separated, named columns, time_stamp in nanoseconds
+     *  PoseStamped : header stamp (secs, nsecs) if present, then position x y z and orientation x y z w
+     *  Int16MultiArray : "data" holds the list of channels
+     */
+    Table read_csv(std::ifstream &file, const std::string &header_line, const size_t &num_columns)
+    {
+        const std::vector<std::string> header = split(header_line, ';');
+        auto index_of = [&header](const std::string &name, const size_t &from) -> int
+        {
+            std::vector<std::string>::const_iterator it = std::find(header.begin() + std::min(from, header.size()), header.end(), name);
+            return (it == header.end()) ? -1 : static_cast<int>(std::distance(header.begin(), it));
+        };
+
+        const int stamp = index_of("time_stamp", 0), secs = index_of("secs", 0), nsecs = index_of("nsecs", 0);
+        const int data = index_of("data", 0);
+        std::vector<int> pose_index;
+        if(num_columns == 8)
+        {
+            const int x = index_of("x", 0), y = index_of("y", 0), z = index_of("z", 0);
+            const int qx = index_of("x", x + 1), qy = index_of("y", y + 1), qz = index_of("z", z + 1), qw = index_of("w", 0);
+            pose_index = {x, y, z, qw, qx, qy, qz};
+            if(std::find(pose_index.begin(), pose_index.end(), -1) != pose_index.end())
+                throw std::runtime_error("kite_replay: csv log is not a pose log");
+        }
+        else if(data < 0)
+        {
+            throw std::runtime_error("kite_replay: csv log is not a control log");
+        }
+
+        Table table;
+        std::string line;
+        while(std::getline(file, line))
+        {
+            std::vector<std::string> fields = split(line, ';');
+            if(fields.size() < header.size())
+                continue;
+
+            std::vector<double> row;
+            if((secs >= 0) && (nsecs >= 0))
+                row.push_back(std::stod(fields[secs]) + 1e-9 * std::stod(fields[nsecs]));
+            else
+                row.push_back(1e-9 * std::stod(fields[stamp]));
+
+            if(num_columns == 8)
+            {
+                for(const int &index : pose_index)
+                    row.push_back(std::stod(fields[index]));
+            }
+            else
+            {
+                std::string list = fields[data];
+                std::replace(list.begin(), list.end(), '[', ' ');
+                std::replace(list.begin(), list.end(), ']', ' ');
+                for(const std::string &value : split(list, ','))
+                    row.push_back(std::stod(value));
+            }
+
+            if(row.size() < num_columns)
+                throw std::runtime_error("kite_replay: unexpected number of columns in log: " + std::to_string(row.size()));
+            row.resize(num_columns);
+            table.push_back(row);
+        }
+        return table;
+    }
+
+    /** rows [t, values...] in logged order */
+    Table read_log(const std::string &filename, const size_t &num_columns)
+    {
+        Table table;
+        if((filename.size() > 6) && (filename.compare(filename.size() - 6, 6, ".oklog") == 0))
+        {
+            table = read_oklog(filename, num_columns);
+        }
+        else
+        {
+            std::ifstream file(filename);
+            if(!file.is_open())
+                throw std::runtime_error("kite_replay: could not open log file: " + filename);
+
+            std::string first_line;
+            std::getline(file, first_line);
+            if(first_line.find(';') != std::string::npos)
+            {
+                table = read_csv(file, first_line, num_columns);
+            }
+            else
+            {
+                file.seekg(0);
+                table = read_text(file, num_columns);
+            }
+        }
+
+        return table;
+    }
+
+    /** estimation as published by ekf_node */
+    DM published_state(const DM &estimation)
+    {
+        DM state = estimation;
+        mocap::State::Map(state.ptr()) -= mocap::state_correction();
+        return state;
+    }
+
+    void write_row(FILE *out, const char *tag, const double &t, const std::vector<double> &values)
+    {
+        std::fprintf(out, "%s %.6f", tag, t);
+        for(const double &value : values)
+            std::fprintf(out, " %.9f", value);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::vector<std::string> positional;
+    std::string out_file, params_file;
+    double speed = 0, control_rate = 14, transport_delay = 0.1;
+    int history_size = 50;
+    bool multiplicative = false;
+    bool sort = false;
+
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        if(args[i] == "--multiplicative")
+            multiplicative = true;
+        else if(args[i] == "--sort")
+            sort = true;
+        else if((args[i] == "--out") && (i + 1 < args.size()))
+            out_file = args[++i];
+        else if((args[i] == "--params") && (i + 1 < args.size()))
+            params_file = args[++i];
+        else if((args[i] == "--speed") && (i + 1 < args.size()))
+            speed = std::stod(args[++i]);
+        else if((args[i] == "--control-rate") && (i + 1 < args.size()))
+            control_rate = std::stod(args[++i]);
+        else if((args[i] == "--delay") && (i + 1 < args.size()))
+            transport_delay = std::stod(args[++i]);
+        else if((args[i] == "--history") && (i + 1 < args.size()))
+            history_size = std::stoi(args[++i]);
+        else
+            positional.push_back(args[i]);
+    }
+
+    if(positional.empty() || (positional.size() > 2) || (control_rate <= 0))
+    {
+        std::cerr << "usage: kite_replay pose.log [control.log] [--params kite_params.yaml] [--out replay.txt] [--speed k]\n"
+                  << "                   [--control-rate 14] [--delay 0.1] [--history 50] [--multiplicative] [--sort]\n";
+        return 1;
+    }
+
+    Table poses, controls;
+    try
+    {
+        poses = read_log(positional[0], 8);
+        if(positional.size() > 1)
+            controls = read_log(positional[1], 5);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if(sort)
+    {
+        replay::sort_by_stamp(poses);
+        replay::sort_by_stamp(controls);
+    }
+
+    FILE *out = out_file.empty() ? stdout : std::fopen(out_file.c_str(), "w");
+    if(!out)
+    {
+        std::cerr << "kite_replay: could not create output file: " << out_file << "\n";
+        return 1;
+    }
+
+    /** estimator set up as in ekf_node */
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    RigidBodyKinematics rigid_body = RigidBodyKinematics(algo_props);
+    KiteEKF filter(rigid_body.getNumericTransition());
+    filter.setHistorySize(history_size);
+    filter.setMultiplicative(multiplicative);
+
+    /** controller set up as in nmpf_node */
+    std::shared_ptr<KiteNMPF> controller;
+    if(!params_file.empty())
+    {
+        KiteProperties kite_props = kite_utils::LoadProperties(params_file);
+        std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, algo_props);
+        controller = std::make_shared<KiteNMPF>(kite, nmpf_utils::circular_path());
+        nmpf_utils::default_setup(*controller);
+        controller->createNLP();
+    }
+
+    DM control = DM::zeros(3);
+    std::vector<mocap::Pose> pending;
+    std::vector<double> pending_time;
+    bool initialized = false;
+    double next_tick = 0;
+    int num_estimates = 0, num_dropped = 0, num_ticks = 0, num_failed = 0;
+
+    const std::vector<replay::Record> records = replay::merge(poses, controls);
+    double t0 = records.empty() ? 0.0 : records.front().t;
+    double t_end = t0;
+    for(const replay::Record &record : records)
+    {
+        t0 = std::min(t0, record.t);
+        t_end = std::max(t_end, record.t);
+    }
+    double clock = t0;
+    const std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+
+    /** controller tick at virtual time t, same augmentation as KiteNMPF_Node::compute_control */
+    auto control_tick = [&](const double &t)
+    {
+        filter.setControl(control);
+        DM predicted_state = published_state(filter.getPrediction(t + transport_delay));
+        DM opt_traj = controller->getOptimalTrajetory();
+        DM augmented_state;
+
+        if(!opt_traj.is_empty())
+        {
+            augmented_state = DM::vertcat({predicted_state, opt_traj(Slice(13, opt_traj.size1()), opt_traj.size2() - 3)});
+            if(!kmath::nlp_converged(controller->getStats()))
+                augmented_state(13) = controller->findClosestPointOnPath(predicted_state(Slice(6,9)), augmented_state(13));
+        }
+        else
+        {
+            DM closest_point = controller->findClosestPointOnPath(predicted_state(Slice(6,9)));
+            augmented_state = DM::vertcat({predicted_state, closest_point, 0});
+        }
+
+        /** same zero-speed workaround as in nmpf_node */
+        if(augmented_state(0).nonzeros()[0] < 2.1)
+            augmented_state(0) = 2.1;
+
+        controller->computeControl(augmented_state);
+
+        Dict stats = controller->getStats();
+        DM opt_ctl = controller->getOptimalControl();
+        DM tick_control = opt_ctl(Slice(0,3), opt_ctl.size2() - 1);
+        std::string status = static_cast<std::string>(stats["return_status"]);
+        int iter = stats["iter_count"];
+        num_failed += kmath::nlp_converged(stats) ? 0 : 1;
+        ++num_ticks;
+
+        write_row(out, "ctl", t, tick_control.nonzeros());
+        std::fprintf(out, " %s %d\n", status.c_str(), iter);
+    };
+
+    /** records in logged order, merged by time stamp (see kite_replay.hpp) */
+    for(const replay::Record &record : records)
+    {
+        const bool is_control = record.control;
+        const std::vector<double> &row = is_control ? controls[record.index] : poses[record.index];
+        const double t = row[0];
+
+        /** the virtual clock does not go back on late records */
+        clock = std::max(clock, t);
+        if(speed > 0)
+            std::this_thread::sleep_until(wall_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                              std::chrono::duration<double>((clock - t0) / speed)));
+
+        /** controller ticks due before this record */
+        while(controller && initialized && (next_tick <= clock))
+        {
+            control_tick(next_tick);
+            next_tick += 1.0 / control_rate;
+        }
+
+        if(is_control)
+        {
+            /** throttle, elevator, rudder channels as read by ekf_node */
+            control = DM::vertcat({row[1], row[3], row[4]});
+            continue;
+        }
+
+        const mocap::Pose measurement = mocap::optitrack2world(mocap::Pose::Map(row.data() + 1));
+
+        if(!initialized)
+        {
+            /** initialize kite state based on 2 pose measurements at least 10 ms apart */
+            pending.push_back(measurement);
+            pending_time.push_back(t);
+            if(t - pending_time.front() < 0.01)
+                continue;
+
+            DM init_state = DM::zeros(13);
+            mocap::State::Map(init_state.ptr()) = mocap::initial_state(pending.front(), pending.back(), t - pending_time.front());
+            filter.setTime(t);
+            filter.setEstimation(init_state);
+            initialized = true;
+            next_tick = t;
+            write_row(out, "est", t, published_state(init_state).nonzeros());
+            std::fprintf(out, "\n");
+            continue;
+        }
+
+        DM observation = DM::zeros(7);
+        mocap::Pose::Map(observation.ptr()) = measurement;
+        filter.setControl(control);
+        if(!filter.estimate(observation, t))
+        {
+            ++num_dropped;
+            continue;
+        }
+
+        ++num_estimates;
+        write_row(out, "est", filter.getTimeStamp(), published_state(filter.getEstimation()).nonzeros());
+        std::fprintf(out, "\n");
+    }
+
+    if(out != stdout)
+        std::fclose(out);
+
+    /** summary : wall clock values only here */
+    const double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    const double log_time = t_end - t0;
+    std::cerr << "kite_replay: " << poses.size() << " poses, " << controls.size() << " controls, "
+              << num_estimates << " estimates, " << num_dropped << " dropped, "
+              << num_ticks << " controller ticks, " << num_failed << " failed \n"
+              << "kite_replay: " << log_time << " [s] of flight replayed in " << wall_time << " [s] ("
+              << ((wall_time > 0) ? log_time / wall_time : 0.0) << "x real time) \n";
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef KITE_REPLAY_HPP
+#define KITE_REPLAY_HPP
+
+#include <vector>
+#include <algorithm>
+
+/** Record order of kite_replay : logs are replayed in the order they were written (arrival order), so late
+ *  poses reach the estimator late as in flight and go through the out-of-sequence fusion. Sorting by
+ *  time stamp is optional.
+ */
+namespace replay
+{
+    /** rows [t, values...] */
+    typedef std::vector<std::vector<double>> Table;
+
+    struct Record
+    {
+        bool control;
+        size_t index;
+        double t;
+    };
+
+    /** rows sorted by time stamp, equal stamps keep their logged order */
+    inline void sort_by_stamp(Table &table)
+    {
+        std::stable_sort(table.begin(), table.end(), [](const std::vector<double> &a, const std::vector<double> &b){return a[0] < b[0];});
+    }
+
+    /** processing order of the two logs : each log keeps its row order, a control goes first if its stamp is not
+     *  later than the next pose, as it was applied before. Controls after the last pose are not replayed */
+    inline std::vector<Record> merge(const Table &poses, const Table &controls)
+    {
+        std::vector<Record> records;
+        records.reserve(poses.size() + controls.size());
+        size_t p = 0, c = 0;
+        while(p < poses.size())
+        {
+            if((c < controls.size()) && (controls[c][0] <= poses[p][0]))
+            {
+                records.push_back(Record{true, c, controls[c][0]});
+                ++c;
+            }
+            else
+            {
+                records.push_back(Record{false, p, poses[p][0]});
+                ++p;
+            }
+        }
+        return records;
+    }
+}
+
+#endif // KITE_REPLAY_HPP
@@ -0,0 +1,232 @@
+#include "kiteNMPF.h"
+#include "kiteLQR.h"
+#include "riccati.hpp"
+
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+using namespace casadi;
+
+/** Offline generation of the gain-scheduled LQR table (see kiteLQR.h):
+ *  1. trim point on the reference path for each grid value of the path parameter : the kite is placed on the path
+ *     and the velocity, angular rate, attitude and controls are chosen to fly along it at the reference speed
+ *  2. linearization of KiteDynamics at the trim point, reduced to the 12 error states of KiteLQR
+ *  3. LQR gains with kmath::oc::RiccatiSolver, warm started from the previous grid point, and closed loop stability check
+ *  The trim NLP and the linearization are formulated once on the main thread, which also builds one solver and
+ *  function instance per worker. Grid points are split in contiguous chunks between worker threads, which only
+ *  evaluate their instances and warm start the trim search from the previous grid point.
+ *
+ *  usage: lqr_generator kite_params.yaml lqr_table.yaml [num_points] [num_threads]
+ */
+
+struct GainTable
+{
+    Eigen::MatrixXd x_ref;
+    Eigen::MatrixXd u_ref;
+    std::vector<Eigen::MatrixXd> gains;
+    /** not std::vector<bool> : threads write neighbouring entries */
+    std::vector<int> stable;
+};
+
+/** reference speed along the path, as in nmpf_utils::default_setup */
+static const double VEL_REF = 4.0;
+
+/** error state weights [dv, dw, dr, dtheta] and control weights [T, dE, dR] */
+static const std::vector<double> Q_DIAG = {1.0, 1.0, 1.0, 0.5, 0.5, 0.5, 5.0, 5.0, 5.0, 2.0, 2.0, 2.0};
+static const std::vector<double> R_DIAG = {44.4, 14.6, 14.6};
+
+/** left quaternion product matrix : q * p = L(q) p */
+static Eigen::Matrix4d quat_left(const Eigen::Ref<const Eigen::Vector4d> &q)
+{
+    Eigen::Matrix4d L;
+    L << q(0), -q(1), -q(2), -q(3),
+         q(1),  q(0), -q(3),  q(2),
+         q(2),  q(3),  q(0), -q(1),
+         q(3), -q(2),  q(1),  q(0);
+    return L;
+}
+
+/** per worker instances of the numeric functions, built on the main thread : CasADi symbolics and solver
+ *  construction are not thread safe, workers only evaluate */
+struct TrimContext
+{
+    Function solver;
+    Function path;
+    Function linearization;
+};
+
+/** trim NLP : z = [v, w, q, u], p = theta */
+SXDict trim_nlp(const Function &dynamics, const Function &path)
+{
+    SX v = SX::sym("v", 3);
+    SX w = SX::sym("w", 3);
+    SX q = SX::sym("q", 4);
+    SX u = SX::sym("u", 3);
+    SX theta = SX::sym("theta");
+
+    SX r      = path(SXVector{theta})[0];
+    SX dr     = SX::jacobian(r, theta);
+    SX ddr    = SX::jacobian(dr, theta);
+    SX tangent = dr / SX::norm_2(dr);
+    /** angular rate of the path frame at the reference speed, in the world and body frames */
+    SX w_path = VEL_REF * SX::cross(dr, ddr) / pow(SX::norm_2(dr), 3);
+    SX qw = kmath::quat_multiply(kmath::quat_inverse(q), SX::vertcat({0, w_path}));
+    SX w_body = kmath::quat_multiply(qw, q)(Slice(1,4), 0);
+
+    SX x = SX::vertcat({v, w, r, q});
+    SX f = dynamics(SXVector{x, u})[0];
+    SX residual = SX::vertcat({f(Slice(0,6)), f(Slice(6,9)) - VEL_REF * tangent, w - w_body});
+
+    SX z = SX::vertcat({v, w, q, u});
+    return SXDict{{"x", z}, {"p", theta}, {"f", SX::dot(residual, residual)}, {"g", SX::dot(q, q)}};
+}
+
+void trim_worker(TrimContext &context, const DM &lbz, const DM &ubz, DM z0, const double &theta_min, const double &theta_max,
+                 const int &num_points, const int &first, const int &last, GainTable &table)
+{
+    Function &solver = context.solver;
+    Function &path = context.path;
+    Function &linearization = context.linearization;
+
+    typedef kmath::oc::RiccatiSolver<KiteLQR::DIM_E, 3> Riccati;
+    Riccati::MatrixX Q = Eigen::VectorXd::Map(Q_DIAG.data(), KiteLQR::DIM_E).asDiagonal();
+    Riccati::MatrixU R = Eigen::Vector3d::Map(R_DIAG.data()).asDiagonal();
+    std::unique_ptr<Riccati> riccati(new Riccati(Q, R));
+
+    for(int k = first; k < last; ++k)
+    {
+        const double th = theta_min + k * (theta_max - theta_min) / num_points;
+        DMDict res = solver(DMDict{{"x0", z0}, {"p", th}, {"lbx", lbz}, {"ubx", ubz}, {"lbg", 1.0}, {"ubg", 1.0}});
+        bool converged = kmath::nlp_converged(solver.stats());
+
+        DM zopt = res.at("x");
+        z0 = zopt;
+        DM x_trim = DM::vertcat({zopt(Slice(0,6)), DM(path(DMVector{DM(th)})[0]), zopt(Slice(6,10))});
+        DM u_trim = zopt(Slice(10,13));
+        DMVector jac = linearization(DMVector{x_trim, u_trim});
+        DM A_dm = DM::densify(jac[0]);
+        DM B_dm = DM::densify(jac[1]);
+
+        Eigen::VectorXd xk = Eigen::VectorXd::Map(x_trim.ptr(), KiteLQR::DIM_X);
+        Eigen::MatrixXd A  = Eigen::MatrixXd::Map(A_dm.ptr(), KiteLQR::DIM_X, KiteLQR::DIM_X);
+        Eigen::MatrixXd B  = Eigen::MatrixXd::Map(B_dm.ptr(), KiteLQR::DIM_X, 3);
+
+        /** error state maps : x = x_ref + E e, e = P (x - x_ref) to first order, q = q_ref * [1, dtheta / 2] */
+        Eigen::Vector4d q_ref = xk.tail<4>();
+        Eigen::Vector4d q_inv(q_ref(0), -q_ref(1), -q_ref(2), -q_ref(3));
+        Eigen::MatrixXd E = Eigen::MatrixXd::Zero(KiteLQR::DIM_X, KiteLQR::DIM_E);
+        Eigen::MatrixXd P = Eigen::MatrixXd::Zero(KiteLQR::DIM_E, KiteLQR::DIM_X);
+        E.topLeftCorner(9, 9).setIdentity();
+        P.topLeftCorner(9, 9).setIdentity();
+        E.bottomRightCorner(4, 3) = 0.5 * quat_left(q_ref).rightCols(3);
+        P.bottomRightCorner(3, 4) = 2.0 * quat_left(q_inv).bottomRows(3);
+
+        Riccati::MatrixX A_r = P * A * E;
+        Riccati::MatrixB B_r = P * B;
+        bool solved = riccati->care(A_r, B_r);
+        Eigen::MatrixXd K = riccati->gain();
+
+        bool stable = converged && solved && K.allFinite();
+        if(stable)
+        {
+            Eigen::VectorXcd poles = Eigen::EigenSolver<Eigen::MatrixXd>(A_r - B_r * K).eigenvalues();
+            stable = (poles.real().array() < 0).all();
+        }
+        else
+        {
+            K = Eigen::MatrixXd::Zero(3, KiteLQR::DIM_E);
+            riccati->reset();
+        }
+
+        table.x_ref.col(k) = xk;
+        table.u_ref.col(k) = Eigen::Vector3d::Map(u_trim.ptr());
+        table.gains[k] = K;
+        table.stable[k] = stable;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string kite_params_file = (argc > 1) ? argv[1] : "umx_radian.yaml";
+    std::string table_file       = (argc > 2) ? argv[2] : "lqr_table.yaml";
+    int num_points  = (argc > 3) ? std::atoi(argv[3]) : 72;
+    int num_threads = (argc > 4) ? std::atoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::max(1, std::min(num_threads, num_points));
+
+    const double theta_min = 0;
+    const double theta_max = 2 * M_PI;
+
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_params_file);
+    std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, AlgorithmProperties{RK4, 0.02});
+    Function dynamics = kite->getNumericDynamics();
+
+    /** control bounds of the orbit tracking experiments */
+    KiteNMPF reference(kite, nmpf_utils::circular_path());
+    nmpf_utils::default_setup(reference);
+    std::vector<double> lbu = reference.getLBU().nonzeros();
+    std::vector<double> ubu = reference.getUBU().nonzeros();
+
+    DM lbz = DM::vertcat({2.0, -DM::inf(2), -4 * M_PI * DM::ones(3), -1.01 * DM::ones(4), lbu[0], lbu[1], lbu[2]});
+    DM ubz = DM::vertcat({DM::inf(3), 4 * M_PI * DM::ones(3), 1.01 * DM::ones(4), ubu[0], ubu[1], ubu[2]});
+    DM z0  = DM::vertcat({VEL_REF, 0, 0, DM::zeros(3), 1, 0, 0, 0, 0.5 * (lbu[0] + ubu[0]), 0, 0});
+
+    /** trim NLP and linearization, formulated once */
+    SXDict nlp = trim_nlp(dynamics, nmpf_utils::circular_path());
+    kmath::NLPSettings settings;
+    settings.tol      = 1e-10;
+    settings.max_iter = 500;
+
+    SX X = kite->getSymbolicState();
+    SX U = kite->getSymbolicControl();
+    SX F = kite->getSymbolicDynamics();
+    SX A = SX::jacobian(F, X);
+    SX B = SX::jacobian(F, U);
+
+    /** @attention : solver instances run concurrently, the linear solver has to be thread safe (ma97) */
+    if((num_threads > 1) && !kmath::nlp_thread_safe(settings))
+    {
+        std::cout << "lqr_generator: " << kmath::nlp_settings_to_string(settings) << " is not thread safe, using 1 thread \n";
+        num_threads = 1;
+    }
+    std::vector<TrimContext> contexts;
+    for(int i = 0; i < num_threads; ++i)
+    {
+        TrimContext context;
+        context.solver = kmath::nlp_solver("trim_" + std::to_string(i), nlp, settings);
+        context.path = nmpf_utils::circular_path();
+        context.linearization = Function("linearization_" + std::to_string(i), {X, U}, {A, B});
+        contexts.push_back(context);
+    }
+
+    GainTable table;
+    table.x_ref = Eigen::MatrixXd::Zero(KiteLQR::DIM_X, num_points);
+    table.u_ref = Eigen::MatrixXd::Zero(3, num_points);
+    table.gains.resize(num_points);
+    table.stable.resize(num_points);
+
+    /** parallel trim and linearization : threads write disjoint columns */
+    std::vector<std::thread> workers;
+    for(int i = 0; i < num_threads; ++i)
+    {
+        int first = (i * num_points) / num_threads;
+        int last  = ((i + 1) * num_points) / num_threads;
+        workers.emplace_back(trim_worker, std::ref(contexts[i]), std::cref(lbz), std::cref(ubz), z0,
+                             theta_min, theta_max, num_points, first, last, std::ref(table));
+    }
+    for(std::thread &worker : workers)
+        worker.join();
+
+    KiteLQR lqr;
+    std::vector<bool> stable(table.stable.begin(), table.stable.end());
+    lqr.setTable(theta_min, theta_max, table.x_ref, table.u_ref, table.gains, stable);
+
+    lqr.setControlBounds(Eigen::VectorXd::Map(lbu.data(), 3), Eigen::VectorXd::Map(ubu.data(), 3));
+    lqr.save(table_file);
+
+    int num_stable = static_cast<int>(std::count(stable.begin(), stable.end(), true));
+    std::cout << "Gain table with " << num_points << " points, stabilized: " << num_stable << "\n";
+    std::cout << "Gain table saved to: " << table_file << "\n";
+
+    return (num_stable == num_points) ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+#include "kiteNMPF.h"
+#include "yaml-cpp/yaml.h"
+
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <cmath>
+
+using namespace casadi;
+
+/** Replay of recorded states through KiteNMPF::computeControl
+ *
+ *  usage: nmpf_bench kite_params.yaml corpus.txt [--out report.yaml] [--label name] [--cold] [--starts K]
+ *                    [--backend ipopt:mumps]
+ *         nmpf_bench --compare baseline.yaml candidate.yaml [--threshold 0.1]
+ *
+ *  corpus : one state per line, whitespace separated
+ *           13 columns - kite state, path parameter is initialized by the closest point search
+ *           14 columns - time stamp followed by the kite state
+ *           15 columns - augmented state [kite state, theta, theta_dot]
+ */
+
+namespace
+{
+    struct BenchReport
+    {
+        std::string label;
+        std::string backend;
+        int num_samples = 0;
+        double p50 = 0, p90 = 0, p99 = 0, max = 0, mean = 0;
+        double mean_iter = 0;
+        int max_iter = 0;
+        double failure_rate = 0;
+        double path_error_mean = 0, path_error_max = 0;
+        double velocity_error_mean = 0, velocity_error_max = 0;
+        std::map<std::string, int> status;
+    };
+
+    double percentile(std::vector<double> sorted, const double &p)
+    {
+        if(sorted.empty())
+            return 0;
+        std::sort(sorted.begin(), sorted.end());
+        double rank = p * (sorted.size() - 1);
+        size_t lo = static_cast<size_t>(std::floor(rank));
+        size_t hi = static_cast<size_t>(std::ceil(rank));
+        return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+    }
+
+    std::vector<std::vector<double>> read_corpus(const std::string &filename)
+    {
+        std::vector<std::vector<double>> corpus;
+        std::ifstream file(filename);
+        if(!file.is_open())
+            throw std::runtime_error("nmpf_bench: could not open corpus file: " + filename);
+
+        std::string line;
+        while(std::getline(file, line))
+        {
+            if(line.empty() || line[0] == '#')
+                continue;
+            std::istringstream stream(line);
+            std::vector<double> row;
+            double value;
+            while(stream >> value)
+                row.push_back(value);
+
+            if((row.size() < 13) || (row.size() > 15))
+                throw std::runtime_error("nmpf_bench: unexpected number of columns in corpus: " + std::to_string(row.size()));
+            corpus.push_back(row);
+        }
+        return corpus;
+    }
+
+    void write_report(const BenchReport &report, const std::string &filename)
+    {
+        YAML::Emitter out;
+        out << YAML::BeginMap;
+        out << YAML::Key << "label"        << YAML::Value << report.label;
+        out << YAML::Key << "backend"      << YAML::Value << report.backend;
+        out << YAML::Key << "num_samples"  << YAML::Value << report.num_samples;
+        out << YAML::Key << "solve_time_ms" << YAML::Value << YAML::BeginMap;
+        out << YAML::Key << "p50"  << YAML::Value << report.p50;
+        out << YAML::Key << "p90"  << YAML::Value << report.p90;
+        out << YAML::Key << "p99"  << YAML::Value << report.p99;
+        out << YAML::Key << "max"  << YAML::Value << report.max;
+        out << YAML::Key << "mean" << YAML::Value << report.mean;
+        out << YAML::EndMap;
+        out << YAML::Key << "iter_count" << YAML::Value << YAML::BeginMap;
+        out << YAML::Key << "mean" << YAML::Value << report.mean_iter;
+        out << YAML::Key << "max"  << YAML::Value << report.max_iter;
+        out << YAML::EndMap;
+        out << YAML::Key << "failure_rate"  << YAML::Value << report.failure_rate;
+        out << YAML::Key << "return_status" << YAML::Value << YAML::BeginMap;
+        for(const auto &entry : report.status)
+            out << YAML::Key << entry.first << YAML::Value << entry.second;
+        out << YAML::EndMap;
+        out << YAML::Key << "tracking" << YAML::Value << YAML::BeginMap;
+        out << YAML::Key << "path_error_mean"     << YAML::Value << report.path_error_mean;
+        out << YAML::Key << "path_error_max"      << YAML::Value << report.path_error_max;
+        out << YAML::Key << "velocity_error_mean" << YAML::Value << report.velocity_error_mean;
+        out << YAML::Key << "velocity_error_max"  << YAML::Value << report.velocity_error_max;
+        out << YAML::EndMap;
+        out << YAML::EndMap;
+
+        if(filename.empty())
+        {
+            std::cout << out.c_str() << "\n";
+            return;
+        }
+        std::ofstream fout(filename);
+        fout << out.c_str() << "\n";
+    }
+
+    BenchReport read_report(const std::string &filename)
+    {
+        YAML::Node config = YAML::LoadFile(filename);
+        BenchReport report;
+        report.label        = config["label"].as<std::string>();
+        report.backend      = config["backend"] ? config["backend"].as<std::string>() : "";
+        report.num_samples  = config["num_samples"].as<int>();
+        report.p50          = config["solve_time_ms"]["p50"].as<double>();
+        report.p90          = config["solve_time_ms"]["p90"].as<double>();
+        report.p99          = config["solve_time_ms"]["p99"].as<double>();
+        report.max          = config["solve_time_ms"]["max"].as<double>();
+        report.mean         = config["solve_time_ms"]["mean"].as<double>();
+        report.mean_iter    = config["iter_count"]["mean"].as<double>();
+        report.max_iter     = config["iter_count"]["max"].as<int>();
+        report.failure_rate = config["failure_rate"].as<double>();
+        report.path_error_mean     = config["tracking"]["path_error_mean"].as<double>();
+        report.path_error_max      = config["tracking"]["path_error_max"].as<double>();
+        report.velocity_error_mean = config["tracking"]["velocity_error_mean"].as<double>();
+        report.velocity_error_max  = config["tracking"]["velocity_error_max"].as<double>();
+        return report;
+    }
+
+    /** print relative changes, returns the number of metrics regressed by more than threshold */
+    int compare_reports(const BenchReport &base, const BenchReport &cand, const double &threshold)
+    {
+        std::vector<std::pair<std::string, std::pair<double, double>>> metrics = {
+            {"solve_time_p50_ms",   {base.p50, cand.p50}},
+            {"solve_time_p90_ms",   {base.p90, cand.p90}},
+            {"solve_time_p99_ms",   {base.p99, cand.p99}},
+            {"solve_time_max_ms",   {base.max, cand.max}},
+            {"iter_count_mean",     {base.mean_iter, cand.mean_iter}},
+            {"failure_rate",        {base.failure_rate, cand.failure_rate}},
+            {"path_error_mean",     {base.path_error_mean, cand.path_error_mean}},
+            {"velocity_error_mean", {base.velocity_error_mean, cand.velocity_error_mean}}};
+
+        int regressions = 0;
+        std::cout << "metric: " << base.label << " -> " << cand.label << "\n";
+        for(const auto &metric : metrics)
+        {
+            double a = metric.second.first;
+            double b = metric.second.second;
+            double change = (std::fabs(a) > 0) ? (b - a) / std::fabs(a) : ((b > 0) ? 1.0 : 0.0);
+            bool regressed = change > threshold;
+            regressions += regressed ? 1 : 0;
+            std::cout << metric.first << ": " << a << " -> " << b << " (" << 100 * change << "%)"
+                      << (regressed ? " REGRESSION" : "") << "\n";
+        }
+        return regressions;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::vector<std::string> positional;
+    std::string out_file, label, backend = "ipopt:ma97";
+    double threshold = 0.1;
+    bool compare = false, cold = false;
+    int num_starts = 1;
+
+    for(size_t i = 0; i < args.size(); ++i)
+    {
+        if(args[i] == "--compare")
+            compare = true;
+        else if(args[i] == "--cold")
+            cold = true;
+        else if((args[i] == "--out") && (i + 1 < args.size()))
+            out_file = args[++i];
+        else if((args[i] == "--label") && (i + 1 < args.size()))
+            label = args[++i];
+        else if((args[i] == "--threshold") && (i + 1 < args.size()))
+            threshold = std::stod(args[++i]);
+        else if((args[i] == "--backend") && (i + 1 < args.size()))
+            backend = args[++i];
+        else if((args[i] == "--starts") && (i + 1 < args.size()))
+            num_starts = std::stoi(args[++i]);
+        else
+            positional.push_back(args[i]);
+    }
+
+    if(positional.size() != 2)
+    {
+        std::cerr << "usage: nmpf_bench kite_params.yaml corpus.txt [--out report.yaml] [--label name] [--cold] [--starts K]"
+                  << " [--backend ipopt:mumps]\n"
+                  << "       nmpf_bench --compare baseline.yaml candidate.yaml [--threshold 0.1]\n";
+        return 1;
+    }
+
+    if(compare)
+        return compare_reports(read_report(positional[0]), read_report(positional[1]), threshold) > 0 ? 2 : 0;
+
+    /** controller set up as in nmpf_node */
+    KiteProperties kite_props = kite_utils::LoadProperties(positional[0]);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, algo_props);
+
+    KiteNMPF controller(kite, nmpf_utils::circular_path());
+    nmpf_utils::default_setup(controller);
+    controller.setMultiStart(num_starts);
+    controller.setNLPSettings(kmath::nlp_settings_from_string(backend, controller.getNLPSettings()));
+    controller.createNLP();
+
+    std::vector<std::vector<double>> corpus = read_corpus(positional[1]);
+
+    BenchReport report;
+    report.backend = kmath::nlp_settings_to_string(controller.getNLPSettings());
+    report.label   = label.empty() ? report.backend : label;
+    std::vector<double> solve_time;
+    double theta = 0;
+    int num_failed = 0;
+
+    for(const std::vector<double> &row : corpus)
+    {
+        DM augmented_state;
+        if(row.size() == 15)
+        {
+            augmented_state = DM(row);
+        }
+        else
+        {
+            DM state = DM(std::vector<double>(row.end() - 13, row.end()));
+            theta = controller.findClosestPointOnPath(state(Slice(6,9)), theta).nonzeros()[0];
+            augmented_state = DM::vertcat({state, theta, 0});
+        }
+
+        /** same zero-speed workaround as in nmpf_node */
+        if(augmented_state(0).nonzeros()[0] < 2.1)
+            augmented_state(0) = 2.1;
+
+        if(cold)
+            controller.disableWarmStart();
+
+        auto start = std::chrono::steady_clock::now();
+        controller.computeControl(augmented_state);
+        auto finish = std::chrono::steady_clock::now();
+        solve_time.push_back(std::chrono::duration<double, std::milli>(finish - start).count());
+
+        Dict stats = controller.getStats();
+        std::string status = static_cast<std::string>(stats["return_status"]);
+        report.status[status] += 1;
+        if(!kmath::nlp_converged(stats))
+            ++num_failed;
+
+        int iter = stats["iter_count"];
+        report.mean_iter += iter;
+        report.max_iter = std::max(report.max_iter, iter);
+
+        double path_error = controller.getPathError();
+        double vel_error  = controller.getVelocityError();
+        report.path_error_mean     += path_error;
+        report.path_error_max       = std::max(report.path_error_max, path_error);
+        report.velocity_error_mean += vel_error;
+        report.velocity_error_max   = std::max(report.velocity_error_max, vel_error);
+
+        /** keep the path parameter consistent with the solution for the next closest point search */
+        theta = controller.getVirtState();
+    }
+
+    report.num_samples = static_cast<int>(solve_time.size());
+    if(report.num_samples > 0)
+    {
+        double n = report.num_samples;
+        report.p50  = percentile(solve_time, 0.50);
+        report.p90  = percentile(solve_time, 0.90);
+        report.p99  = percentile(solve_time, 0.99);
+        report.max  = *std::max_element(solve_time.begin(), solve_time.end());
+        report.mean = std::accumulate(solve_time.begin(), solve_time.end(), 0.0) / n;
+        report.mean_iter /= n;
+        report.failure_rate = num_failed / n;
+        report.path_error_mean /= n;
+        report.velocity_error_mean /= n;
+    }
+
+    write_report(report, out_file);
+    return 0;
+}
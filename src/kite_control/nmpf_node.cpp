@@ -7,7 +7,38 @@ using namespace casadi;
 void KiteNMPF_Node::filterCallback(const sensor_msgs::MultiDOFJointState::ConstPtr &msg)
 {
     //boost::unique_lock<boost::mutex> scoped_lock(m_mutex, boost::try_to_lock);
-    DM estimation = convertToDM(*msg);
+    update_state(convertToDM(*msg));
+}
+
+void KiteNMPF_Node::poll_state_bus()
+{
+    if(shm_state_name.empty())
+        return;
+
+    /** the estimator may start later : open the segment on demand */
+    if(!state_bus)
+    {
+        try
+        {
+            state_bus = std::make_shared<ShmStateChannel>(shm_state_name, ShmStateChannel::READER);
+        }
+        catch(const std::runtime_error &e)
+        {
+            ROS_WARN_THROTTLE(5.0, "%s", e.what());
+            return;
+        }
+    }
+
+    StateRecord record;
+    if(state_bus->readNew(record, last_state_sequence))
+    {
+        last_state_sequence = record.sequence;
+        update_state(DM(std::vector<double>(record.state, record.state + 13)));
+    }
+}
+
+void KiteNMPF_Node::update_state(const DM &estimation)
+{
     /** prevent outliers*/
     std::vector<double> estim = estimation.nonzeros();
     if((std::fabs(estim[3]) >= 4) || (std::fabs(estim[4]) >= 7) || (std::fabs(estim[5]) >= 4))
@@ -26,53 +57,46 @@ KiteNMPF_Node::KiteNMPF_Node(const ros::NodeHandle &_nh, const KiteProperties &k
 {
     std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, algo_props);
 
-    /** @badcode : parametrize path outside NMPF node  constructor*/
-    SX x = SX::sym("x");
-    double radius   = 2.65;
-    double altitude = 0.00;
-    SX Path = SX::vertcat(SXVector{radius * cos(x), radius * sin(x), altitude});
-    /** rotate path */
-    SX q_rot = SX::vertcat({cos(M_PI / 8), 0, sin(M_PI / 8), 0});
-    SX q_rot_inv = kmath::quat_inverse(q_rot);
-    SX qP_tmp = kmath::quat_multiply(q_rot_inv, SX::vertcat({0, Path}));
-    SX qP_q = kmath::quat_multiply(qP_tmp, q_rot);
-    Path = qP_q(Slice(1,4), 0);
-    Function path = Function("path", {x}, {Path});
+    /** orbit used in the tracking experiments */
+    Function path = nmpf_utils::circular_path();
 
     controller = std::make_shared<KiteNMPF>(kite, path);
     nh = std::make_shared<ros::NodeHandle>(_nh);
-    /** set control constraints */
-    double angle_sat = kmath::deg2rad(7.0);
-    DM lbu = DM::vertcat({0.1, -angle_sat, -angle_sat, -5});
-    DM ubu = DM::vertcat({0.15, angle_sat, angle_sat, 5});
-
-    /** scaling matrices */
-    DM ScaleX  = DM::diag(DM({0.1, 1/3.0, 1/3.0, 1/2.0, 1/5.0, 1/2.0, 1/3.0, 1/3.0, 1/3.0, 1.0, 1.0, 1.0, 1.0, 1/6.28, 1/6.28}));
-    DM ScaleU = DM::diag(DM({1/0.15, 1/0.2618, 1/0.2618, 1/5.0}));
-    controller->setControlScaling(ScaleU);
-    controller->setStateScaling(ScaleX);
+    nmpf_utils::default_setup(*controller);
 
-    controller->setLBU(lbu);
-    controller->setUBU(ubu);
+    /** parallel solves from alternative initial guesses */
+    int num_starts;
+    double multistart_deadline;
+    nh->param<int>("num_starts", num_starts, 1);
+    nh->param<double>("multistart_deadline", multistart_deadline, 0.05);
+    controller->setMultiStart(num_starts, multistart_deadline);
 
-    /** set variable constraints */
-    DM lbx = DM::vertcat({2.0, -DM::inf(1), -DM::inf(1), -4 * M_PI, -4 * M_PI, -4 * M_PI, -DM::inf(1), -DM::inf(1), -DM::inf(1),
-                         -1.01, -1.01, -1.01, -1.01, -DM::inf(1), -DM::inf(1)});
-
-    DM ubx = DM::vertcat({DM::inf(1), DM::inf(1), DM::inf(1), 4 * M_PI, 4 * M_PI, 4 * M_PI, DM::inf(1), DM::inf(1), DM::inf(1),
-                          1.01, 1.01, 1.01, 1.01, DM::inf(1), DM::inf(1)});
-
-    controller->setLBX(lbx);
-    controller->setUBX(ubx);
-
-    DM vel_ref = 4.0;
-    controller->setReferenceVelocity(vel_ref);
+    /** NLP backend, e.g. "ipopt:mumps", "sqpmethod:qpoases" */
+    std::string nlp_backend;
+    nh->param<std::string>("nlp_backend", nlp_backend, "ipopt:ma97");
+    controller->setNLPSettings(kmath::nlp_settings_from_string(nlp_backend, controller->getNLPSettings()));
 
     /** create NLP */
     controller->createNLP();
 
+    /** LQR backup, empty table disables, zero deadline : only on failed solves */
+    std::string lqr_table;
+    nh->param<std::string>("lqr_table", lqr_table, "");
+    nh->param<double>("fallback_deadline", fallback_deadline, 0.0);
+    if(!lqr_table.empty())
+    {
+        fallback = std::make_shared<KiteLQR>(lqr_table);
+        std::vector<double> lbu = controller->getLBU().nonzeros();
+        std::vector<double> ubu = controller->getUBU().nonzeros();
+        fallback->setControlBounds(Eigen::VectorXd::Map(lbu.data(), fallback->dim_u()),
+                                   Eigen::VectorXd::Map(ubu.data(), fallback->dim_u()));
+    }
+    fallback_active = false;
+    solve_pending = false;
+
     /** create solver for delay compensation */
     nh->param<double>("delay", transport_delay, 0.1);
+    nh->param<std::string>("prediction_source", prediction_source, "");
 
     Dict opts;
     opts["tf"]         = transport_delay;
@@ -88,8 +112,22 @@ KiteNMPF_Node::KiteNMPF_Node(const ros::NodeHandle &_nh, const KiteProperties &k
     traj_pub       = nh->advertise<sensor_msgs::MultiDOFJointState>("/opt_traj", 10);
     diagnostic_pub = nh->advertise<openkite::mpc_diagnostic>("/mpc_diagnostic", 10);
 
-    std::string state_topic = "/kite_state";
-    state_sub = nh->subscribe(state_topic, 100, &KiteNMPF_Node::filterCallback, this);
+    /** the estimator predicts the state over the delay : ekf_node prediction_lookahead should match */
+    std::string state_topic = (prediction_source == "topic") ? "/kite_state_predicted" : "/kite_state";
+    state_sub = nh->subscribe(state_topic, 100, &KiteNMPF_Node::filterCallback, this,
+                              ros::TransportHints().tcpNoDelay());
+    trace_sub = nh->subscribe("/kite_state_trace", 100, &KiteNMPF_Node::traceCallback, this,
+                              ros::TransportHints().tcpNoDelay());
+    if(prediction_source == "service")
+        predict_client = nh->serviceClient<openkite::predict_state>("/ekf_node/predict_state", true);
+
+    /** shared memory segments, empty disables */
+    std::string shm_control;
+    nh->param<std::string>("shm_state", shm_state_name, "");
+    nh->param<std::string>("shm_control", shm_control, "");
+    if(!shm_control.empty())
+        control_bus = std::make_shared<ShmControlChannel>(shm_control, ShmControlChannel::WRITER);
+    last_state_sequence = 0;
 
     m_initialized = false;
     comp_time_ms = 0.0;
@@ -99,20 +137,7 @@ KiteNMPF_Node::KiteNMPF_Node(const ros::NodeHandle &_nh, const KiteProperties &k
 DM KiteNMPF_Node::convertToDM(const sensor_msgs::MultiDOFJointState &_value)
 {
     DM value = DM::zeros(13);
-    value[0] = _value.twist.back().linear.x;
-    value[1] = _value.twist.back().linear.y;
-    value[2] = _value.twist.back().linear.z;
-    value[3] = _value.twist.back().angular.x;
-    value[4] = _value.twist.back().angular.y;
-    value[5] = _value.twist.back().angular.z;
-    value[6] = _value.transforms.back().translation.x;
-    value[7] = _value.transforms.back().translation.y;
-    value[8] = _value.transforms.back().translation.z;
-    value[9] = _value.transforms.back().rotation.w;
-    value[10] = _value.transforms.back().rotation.x;
-    value[11] = _value.transforms.back().rotation.y;
-    value[12] = _value.transforms.back().rotation.z;
-
+    mocap::State::Map(value.ptr()) = mocap::message_to_state(_value);
     return value;
 }
 
@@ -120,9 +145,22 @@ DM KiteNMPF_Node::convertToDM(const sensor_msgs::MultiDOFJointState &_value)
 void KiteNMPF_Node::publish()
 {
     /** pack estimation to ROS message */
-    DM opt_ctl = controller->getOptimalControl();
-    control    = opt_ctl(Slice(0,3), opt_ctl.size2() - 1);
-    std::vector<double> controls = control.get_nonzeros();
+    std::vector<double> controls;
+    if(!solve_pending)
+    {
+        DM opt_ctl = controller->getOptimalControl();
+        control    = opt_ctl(Slice(0,3), opt_ctl.size2() - 1);
+        controls   = control.get_nonzeros();
+    }
+    fallback_active = fallback_control(controls);
+    if(fallback_active)
+        control = DM(controls);
+    else if(solve_pending && !control.is_empty())
+    {
+        /** past the deadline and the LQR is not stabilizing here : hold the last command */
+        ROS_WARN_THROTTLE(1.0, "nmpf_node: NMPF missed the deadline, no LQR fallback, holding the last command");
+        controls = control.get_nonzeros();
+    }
     openkite::aircraft_controls control_msg;
 
     if(!controls.empty())
@@ -131,10 +169,51 @@ void KiteNMPF_Node::publish()
         control_msg.thrust = controls[0];
         control_msg.elevator = controls[1];
         control_msg.rudder = controls[2];
+        control_msg.trace = trace;
 
         /** publish current control */
         control_pub.publish(control_msg);
+
+        if(control_bus)
+        {
+            ControlRecord record;
+            record.t_stamp = control_msg.header.stamp.toSec();
+            record.control[0] = controls[0];
+            record.control[1] = controls[1];
+            record.control[2] = controls[2];
+            record.control[3] = 0.0;
+            control_bus->write(record);
+        }
+    }
+}
+
+std::vector<double> KiteNMPF_Node::lqr_control(const DM &augmented_state)
+{
+    if(!fallback)
+        return std::vector<double>();
+
+    std::vector<double> state = augmented_state.nonzeros();
+    Eigen::VectorXd command(fallback->dim_u());
+    if(!fallback->evaluate(Eigen::VectorXd::Map(state.data(), KiteLQR::DIM_X), state[13], command))
+    {
+        ROS_WARN_THROTTLE(1.0, "nmpf_node: LQR fallback is not stabilizing at theta = %f", state[13]);
+        return std::vector<double>();
     }
+    return std::vector<double>(command.data(), command.data() + command.size());
+}
+
+bool KiteNMPF_Node::fallback_control(std::vector<double> &controls)
+{
+    if(lqr_command.empty())
+        return false;
+
+    bool missed_deadline = solve_pending;
+    if(!missed_deadline && kmath::nlp_converged(controller->getStats()) && !controls.empty())
+        return false;
+
+    ROS_WARN_THROTTLE(1.0, "nmpf_node: NMPF %s, LQR fallback", missed_deadline ? "missed the deadline" : "did not converge");
+    controls = lqr_command;
+    return true;
 }
 
 void KiteNMPF_Node::publish_trajectory()
@@ -193,42 +272,97 @@ void KiteNMPF_Node::publish_mpc_diagnostic()
     openkite::mpc_diagnostic diag_msg;
     diag_msg.header.stamp = ros::Time::now();
 
-    diag_msg.pos_error    = controller->getPathError();
     diag_msg.comp_time_ms = comp_time_ms * 1000;
+    diag_msg.trace        = trace;
+    diag_msg.lqr_fallback = fallback_active;
+    diag_msg.deadline_missed = solve_pending;
+
+    /** the controller is busy with a late solve */
+    if(solve_pending)
+    {
+        diag_msg.return_status = "Solve_Pending";
+        diagnostic_pub.publish(diag_msg);
+        return;
+    }
+
+    diag_msg.pos_error    = controller->getPathError();
     diag_msg.virt_state   = controller->getVirtState();
     diag_msg.vel_error    = controller->getVelocityError();
 
-    /** dummy output */
-    diag_msg.cost         = 0;
+    /** solver telemetry of the last solve */
+    kmath::NLPTelemetry telemetry = controller->getTelemetry();
+    diag_msg.cost                 = telemetry.objective;
+    diag_msg.objective            = telemetry.objective;
+    diag_msg.constraint_violation = telemetry.constraint_violation;
+    diag_msg.iter_count           = telemetry.iter_count;
+    diag_msg.return_status        = telemetry.return_status;
+    diag_msg.t_eval_f_ms          = telemetry.t_eval_f;
+    diag_msg.t_eval_grad_f_ms     = telemetry.t_eval_grad_f;
+    diag_msg.t_eval_g_ms          = telemetry.t_eval_g;
+    diag_msg.t_eval_jac_g_ms      = telemetry.t_eval_jac_g;
+    diag_msg.t_eval_hess_ms       = telemetry.t_eval_hess;
+    diag_msg.t_solver_overhead_ms = telemetry.t_solver_overhead;
+    diag_msg.t_total_ms           = telemetry.t_total;
     diagnostic_pub.publish(diag_msg);
 }
 
+/** state at the time the control is applied */
+DM KiteNMPF_Node::predict_state(const DM &state)
+{
+    openkite::predict_state prediction;
+    prediction.request.lookahead = transport_delay;
+    if(prediction_source == "topic")
+        return state;
+    else if((prediction_source == "service") && predict_client.call(prediction) && prediction.response.valid)
+        return convertToDM(prediction.response.state);
+    else
+        return solver->solve(state, control, transport_delay);
+}
+
+bool KiteNMPF_Node::solve_running()
+{
+    if(!solve_pending)
+        return false;
+    if(solve_result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return true;
+
+    /** late solve returned : its solution warm starts this cycle */
+    solve_result.get();
+    solve_pending = false;
+    return false;
+}
+
 void KiteNMPF_Node::compute_control()
 {
-    /** augment state with pseudo state*/
-    DM augmented_state;
-    DM opt_traj = controller->getOptimalTrajetory();
+    trace = latest_trace;
+    trace.t_nmpf_input = ros::Time::now().toSec();
 
     /** make local copy */
     DM local_copy = kite_state;
 
+    /** the last solve is still running : LQR on the new state, path parameter of the last cycle */
+    if(solve_running())
+    {
+        control_state = DM::vertcat({predict_state(local_copy), control_state(Slice(13, control_state.size1()))});
+        lqr_command = lqr_control(control_state);
+        trace.t_nmpf_output = ros::Time::now().toSec();
+        return;
+    }
+
+    /** augment state with pseudo state*/
+    DM augmented_state;
+    DM opt_traj = controller->getOptimalTrajetory();
+
     if(!opt_traj.is_empty())
     {
         /** transport delay compensation */
-        DM predicted_state = solver->solve(local_copy, control, transport_delay);
+        DM predicted_state = predict_state(local_copy);
         //std::cout << "virtual state : " << opt_traj << "\n";
         augmented_state = DM::vertcat({predicted_state, opt_traj(Slice(13, opt_traj.size1()), opt_traj.size2() - 3)});
 
-        Dict stats = controller->getStats();
-        std::string solve_status = static_cast<std::string>(stats["return_status"]);
-
-//        Dict stats = controller->getStats();
-//        std::string solve_status = static_cast<std::string>(stats["return_status"]);
-//        if(solve_status.compare("Solve_Succeeded") != 0)
-//        {
-//            std::cout << "REINIT! \n";
-//            augmented_state(13) = controller->findClosestPointOnPath(kite_state(Slice(6,9)), augmented_state(13));
-//        }
+        /** re-anchor virtual state after a failed solve */
+        if(!kmath::nlp_converged(controller->getStats()))
+            augmented_state(13) = controller->findClosestPointOnPath(predicted_state(Slice(6,9)), augmented_state(13));
     }
     else
     {
@@ -241,8 +375,19 @@ void KiteNMPF_Node::compute_control()
     DM minimal_speed = DM(2.1);
     if (augmented_state(0, 0).nonzeros()[0] < minimal_speed.nonzeros()[0])
         augmented_state(0, 0) = minimal_speed;
+    control_state = augmented_state;
+
+    /** backup command first, so that it is ready when the deadline passes */
+    lqr_command = lqr_control(augmented_state);
+
     /** compute control */
-    controller->computeControl(augmented_state);
+    solve_result = std::async(std::launch::async, [this, augmented_state](){controller->computeControl(augmented_state);});
+    bool bounded = (fallback_deadline > 0) && !lqr_command.empty();
+    if(bounded && (solve_result.wait_for(std::chrono::duration<double>(fallback_deadline)) == std::future_status::timeout))
+        solve_pending = true;
+    else
+        solve_result.get();
+    trace.t_nmpf_output = ros::Time::now().toSec();
 }
 
 int main(int argc, char **argv)
@@ -269,6 +414,7 @@ int main(int argc, char **argv)
     while (ros::ok())
     {
         ros::spinOnce();
+        tracker.poll_state_bus();
 
         if(tracker.is_initialized())
         {
@@ -280,7 +426,7 @@ int main(int argc, char **argv)
             tracker.comp_time_ms = finish - start;
             std::cout << "Control computational delay: " << finish - start << "\n";
 
-            if(broadcast_trajectory)
+            if(broadcast_trajectory && !tracker.is_solve_pending())
                 tracker.publish_trajectory();
         }
         else
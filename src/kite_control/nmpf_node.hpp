@@ -7,10 +7,16 @@
 #include "openkite/aircraft_controls.h"
 #include "geometry_msgs/PoseStamped.h"
 #include "openkite/mpc_diagnostic.h"
+#include "openkite/predict_state.h"
+#include "openkite/latency_trace.h"
 
 #include "boost/thread/mutex.hpp"
+#include <future>
 #include "kiteNMPF.h"
+#include "kiteLQR.h"
 #include "integrator.h"
+#include "shm_state_bus.hpp"
+#include "mocap_frame.hpp"
 
 class KiteNMPF_Node
 {
@@ -21,6 +27,9 @@ public:
 
     ros::Time last_computed_control;
     void filterCallback(const sensor_msgs::MultiDOFJointState::ConstPtr &msg);
+    void traceCallback(const openkite::latency_trace::ConstPtr &msg){latest_trace = *msg;}
+    /** take the latest estimate from shared memory if "shm_state" is set */
+    void poll_state_bus();
 
     //void compute_control(const geometry_msgs::PoseStamped &_pose);
     void compute_control();
@@ -30,6 +39,8 @@ public:
 
     void initialize(){m_initialized = true;}
     bool is_initialized(){return m_initialized;}
+    /** a solve is still running past its deadline : the controller must not be queried */
+    bool is_solve_pending(){return solve_pending;}
 
     boost::mutex m_mutex;
     double comp_time_ms;
@@ -42,6 +53,18 @@ private:
     ros::Publisher  traj_pub;
     ros::Publisher  diagnostic_pub;
     ros::Subscriber state_sub;
+    ros::Subscriber trace_sub;
+
+    /** latency tracing : the last mocap sample fused by the estimator, and the one behind the current control */
+    openkite::latency_trace latest_trace;
+    openkite::latency_trace trace;
+    ros::ServiceClient predict_client;
+
+    /** same-host transport, alongside the ROS topics */
+    std::string shm_state_name;
+    std::shared_ptr<ShmStateChannel> state_bus;
+    std::shared_ptr<ShmControlChannel> control_bus;
+    uint64_t last_state_sequence;
 
     /** handle instance to access node params */
     std::shared_ptr<ros::NodeHandle> nh;
@@ -49,10 +72,31 @@ private:
     std::shared_ptr<KiteNMPF> controller;
     std::shared_ptr<ODESolver> solver;
 
+    /** gain-scheduled LQR backup, used when the solve fails or misses the deadline ("lqr_table" param) */
+    std::shared_ptr<KiteLQR> fallback;
+    double fallback_deadline;
+    bool fallback_active;
+    /** augmented state of the last solve */
+    casadi::DM control_state;
+    /** LQR command computed at cycle start, empty if not stabilizing */
+    std::vector<double> lqr_command;
+    std::vector<double> lqr_control(const casadi::DM &augmented_state);
+    bool fallback_control(std::vector<double> &controls);
+
+    /** the solve runs asynchronously : past the deadline the LQR command is published and the solve is left running,
+     *  the controller is not touched until it returns and its late result only warm starts the next cycle */
+    std::future<void> solve_result;
+    bool solve_pending;
+    bool solve_running();
+    casadi::DM predict_state(const casadi::DM &state);
+
     bool m_initialized;
     double transport_delay;
+    /** delay compensation : "" own integration, "topic" /kite_state_predicted, "service" predict_state */
+    std::string prediction_source;
 
     casadi::DM convertToDM(const sensor_msgs::MultiDOFJointState &_value);
+    void update_state(const casadi::DM &estimation);
 };
 
 
@@ -0,0 +1,196 @@
+#include "kiteNMPF.h"
+#include "kitePolicy.h"
+#include "integrator.h"
+
+#include <thread>
+#include <random>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+
+using namespace casadi;
+
+/** Offline generation of an explicit NMPF policy:
+ *  1. closed-loop rollouts of the NMPF on the simulator from perturbed initial states
+ *     (each worker thread owns a controller and simulator instance; all of them are built on the main thread
+ *     beforehand, since casadi symbolics and solver construction are not thread-safe, workers only evaluate)
+ *  2. random feature network fit on the collected (state, control) pairs
+ *  3. empirical validation on held-out samples, which also bound the domain where the policy is used
+ *
+ *  usage: policy_generator kite_params.yaml policy.yaml [num_threads] [num_rollouts] [rollout_length]
+ */
+
+struct PolicySamples
+{
+    std::vector<std::vector<double>> states;
+    std::vector<std::vector<double>> controls;
+};
+
+/** default initial state used in the simulator launch file */
+static const std::vector<double> SEED_STATE = {4.4, 0.44, 1.73, 0.81, -1.73, -1.53, -0.46, -2.68, 0.64,
+                                               -0.0289, 0.1587, 0.4304, 0.8881};
+
+/** closed loop of one worker */
+struct RolloutContext
+{
+    std::shared_ptr<KiteNMPF> controller;
+    std::shared_ptr<ODESolver> simulator;
+    double dt;
+};
+
+/** builds the controller NLP and the simulator : main thread only */
+RolloutContext make_rollout_context(const KiteProperties &kite_props)
+{
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+    std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, algo_props);
+
+    RolloutContext context;
+    context.controller = std::make_shared<KiteNMPF>(kite, nmpf_utils::circular_path());
+    nmpf_utils::default_setup(*context.controller);
+    context.controller->createNLP();
+
+    context.dt = 0.05;
+    Dict opts;
+    opts["tf"]     = context.dt;
+    opts["method"] = IntType::RK4;
+    context.simulator = std::make_shared<ODESolver>(kite->getNumericDynamics(), opts);
+
+    return context;
+}
+
+void rollout_worker(RolloutContext &context, const int &num_rollouts, const int &rollout_length,
+                    const unsigned &seed, PolicySamples &samples)
+{
+    KiteNMPF &controller = *context.controller;
+    ODESolver &simulator = *context.simulator;
+    const double dt = context.dt;
+
+    std::mt19937 generator(seed);
+    std::normal_distribution<double> state_noise(0.0, 1.0);
+    std::normal_distribution<double> control_noise(0.0, 0.01);
+    const std::vector<double> noise_level = {0.5, 0.2, 0.2, 0.3, 0.3, 0.3, 0.2, 0.2, 0.2, 0.05, 0.05, 0.05, 0.05};
+
+    for(int r = 0; r < num_rollouts; ++r)
+    {
+        /** perturbed initial state */
+        DM state = DM::zeros(13);
+        for(int i = 0; i < 13; ++i)
+            state(i) = SEED_STATE[i] + noise_level[i] * state_noise(generator);
+        state(Slice(9,13)) = state(Slice(9,13)) / DM::norm_2(state(Slice(9,13)));
+
+        controller.disableWarmStart();
+        DM theta = controller.findClosestPointOnPath(state(Slice(6,9)));
+        DM augmented_state = DM::vertcat({state, theta, 0});
+
+        for(int k = 0; k < rollout_length; ++k)
+        {
+            controller.computeControl(augmented_state);
+            bool converged = kmath::nlp_converged(controller.getStats());
+
+            DM opt_ctl  = controller.getOptimalControl();
+            DM opt_traj = controller.getOptimalTrajetory();
+            DM control  = opt_ctl(Slice(0, opt_ctl.size1()), opt_ctl.size2() - 1);
+
+            if(converged)
+            {
+                samples.states.push_back(augmented_state.nonzeros());
+                samples.controls.push_back(control.nonzeros());
+            }
+
+            /** excite the closed loop to widen the sampled region */
+            DM applied = control(Slice(0,3));
+            for(int i = 0; i < 3; ++i)
+                applied(i) += control_noise(generator);
+
+            state = simulator.solve(state, applied, dt);
+            std::vector<double> state_vec = state.nonzeros();
+            if(state_vec.empty() || !std::isfinite(DM::norm_inf(state).nonzeros()[0]) || state_vec[0] < 2.0)
+                break;
+
+            augmented_state = DM::vertcat({state, opt_traj(Slice(13, opt_traj.size1()), opt_traj.size2() - 3)});
+            if(!converged)
+                augmented_state(13) = controller.findClosestPointOnPath(state(Slice(6,9)), augmented_state(13));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string kite_params_file = (argc > 1) ? argv[1] : "umx_radian.yaml";
+    std::string policy_file      = (argc > 2) ? argv[2] : "nmpf_policy.yaml";
+    int num_threads    = (argc > 3) ? std::atoi(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+    int num_rollouts   = (argc > 4) ? std::atoi(argv[4]) : 20;
+    int rollout_length = (argc > 5) ? std::atoi(argv[5]) : 100;
+
+    const int    num_hidden = 200;
+    const double tolerance  = 0.02;
+
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_params_file);
+
+    /** parallel closed-loop sampling : solvers are built sequentially, the rollouts run in parallel */
+    std::vector<RolloutContext> contexts;
+    for(int i = 0; i < num_threads; ++i)
+        contexts.push_back(make_rollout_context(kite_props));
+
+    std::vector<PolicySamples> samples(num_threads);
+    std::vector<std::thread> workers;
+    int rollouts_per_thread = std::max(1, num_rollouts / num_threads);
+    for(int i = 0; i < num_threads; ++i)
+        workers.emplace_back(rollout_worker, std::ref(contexts[i]), rollouts_per_thread, rollout_length,
+                             static_cast<unsigned>(i + 1), std::ref(samples[i]));
+    for(std::thread &worker : workers)
+        worker.join();
+
+    std::vector<std::vector<double>> states, controls;
+    for(const PolicySamples &s : samples)
+    {
+        states.insert(states.end(), s.states.begin(), s.states.end());
+        controls.insert(controls.end(), s.controls.begin(), s.controls.end());
+    }
+
+    if(states.size() < 10)
+    {
+        std::cerr << "Not enough converged samples to fit a policy: " << states.size() << "\n";
+        return 1;
+    }
+
+    /** shuffle and split into training and validation sets */
+    std::vector<size_t> order(states.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(0));
+
+    const int nx = states.front().size();
+    const int nu = controls.front().size();
+    const int num_train = static_cast<int>(0.8 * states.size());
+    Eigen::MatrixXd X(nx, states.size()), U(nu, states.size());
+    for(size_t k = 0; k < order.size(); ++k)
+    {
+        X.col(k) = Eigen::VectorXd::Map(states[order[k]].data(), nx);
+        U.col(k) = Eigen::VectorXd::Map(controls[order[k]].data(), nu);
+    }
+
+    /** store the sampled states : may be reused as a benchmark corpus */
+    std::ofstream sample_file("policy_samples.txt", std::ios::out);
+    sample_file << X.transpose() << "\n";
+    sample_file.close();
+
+    KitePolicy policy;
+    std::shared_ptr<KiteDynamics> kite = std::make_shared<KiteDynamics>(kite_props, AlgorithmProperties{RK4, 0.02});
+    KiteNMPF reference(kite, nmpf_utils::circular_path());
+    nmpf_utils::default_setup(reference);
+    std::vector<double> lbu = reference.getLBU().nonzeros();
+    std::vector<double> ubu = reference.getUBU().nonzeros();
+    policy.setControlBounds(Eigen::VectorXd::Map(lbu.data(), nu), Eigen::VectorXd::Map(ubu.data(), nu));
+
+    policy.fit(X.leftCols(num_train), U.leftCols(num_train), num_hidden);
+    double max_error = policy.validate(X.rightCols(X.cols() - num_train), U.rightCols(U.cols() - num_train), tolerance);
+    policy.save(policy_file);
+
+    std::cout << "Policy fitted on " << num_train << " samples, validated on " << X.cols() - num_train << "\n";
+    std::cout << "Max validation error: " << max_error << " validated: " << policy.validated() << "\n";
+    std::cout << "Policy saved to: " << policy_file << "\n";
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef EKF_CORE_HPP
+#define EKF_CORE_HPP
+
+#include "function_evaluator.h"
+#include "eigen3/Eigen/Dense"
+#include <algorithm>
+
+/** Fixed-size extended Kalman filter: no heap allocations in propagate() and update().
+ *  transition : Function({x, u, dt}) -> {x_next, Phi}, single model pass per step (preferred)
+ *  or
+ *  integrator : RK4 Function({x, u, dt}) or CVODES integrator({x0, p}) with fixed horizon
+ *  jacobian   : Function({x, u}) -> df/dx, Phi is approximated by I + J * dt
+ */
+template<int NX, int NU, int NY>
+class EKFCore
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double, NX, 1>  state_t;
+    typedef Eigen::Matrix<double, NU, 1>  control_t;
+    typedef Eigen::Matrix<double, NY, 1>  measurement_t;
+    typedef Eigen::Matrix<double, NX, NX> state_cov_t;
+    typedef Eigen::Matrix<double, NY, NY> measurement_cov_t;
+    typedef Eigen::Matrix<double, NY, NX> measurement_matrix_t;
+    typedef Eigen::Matrix<double, NX, NY> gain_t;
+
+    EKFCore();
+    /** evaluators hold pointers to the member buffers : rebind on copy */
+    EKFCore(const EKFCore &other);
+    EKFCore& operator=(const EKFCore &other);
+    virtual ~EKFCore(){}
+
+    void setModel(const casadi::Function &integrator, const casadi::Function &jacobian);
+    void setModel(const casadi::Function &transition);
+
+    void propagate(const double &dt);
+    /** state propagation only, the transition matrix is left in transitionMatrix() */
+    void propagateState(const double &dt);
+    /** returns false and leaves the estimate untouched if the innovation covariance is not positive definite */
+    bool update(const measurement_t &measurement);
+    /** state prediction only : the estimate and covariance are left untouched */
+    void predict(const double &dt, state_t &prediction);
+
+    const state_cov_t& transitionMatrix() const {return m_A;}
+
+    state_t x;
+    state_cov_t P;
+    control_t u;
+
+    state_cov_t W;
+    measurement_cov_t V;
+    measurement_matrix_t H;
+
+private:
+    kmath::FunctionEvaluator m_integrator;
+    kmath::FunctionEvaluator m_jacobian;
+    bool m_transition;
+    bool m_fixed_step;
+    double m_dt;
+
+    /** workspace */
+    state_t m_x_next;
+    state_cov_t m_A, m_AP, m_IKH;
+    gain_t m_PHt, m_K;
+    measurement_cov_t m_S;
+    measurement_t m_innovation;
+    Eigen::LLT<measurement_cov_t> m_llt;
+
+    void symmetrize();
+};
+
+template<int NX, int NU, int NY>
+EKFCore<NX, NU, NY>::EKFCore() : m_transition(false), m_fixed_step(false), m_dt(0)
+{
+    x.setZero();
+    u.setZero();
+    P.setIdentity();
+    W.setIdentity();
+    V.setIdentity();
+    H.setZero();
+}
+
+template<int NX, int NU, int NY>
+EKFCore<NX, NU, NY>::EKFCore(const EKFCore &other) : EKFCore()
+{
+    *this = other;
+}
+
+template<int NX, int NU, int NY>
+EKFCore<NX, NU, NY>& EKFCore<NX, NU, NY>::operator=(const EKFCore &other)
+{
+    if(this == &other)
+        return *this;
+
+    x = other.x; P = other.P; u = other.u;
+    W = other.W; V = other.V; H = other.H;
+    if(other.m_transition)
+        setModel(other.m_integrator.function());
+    else if(other.m_integrator.initialized())
+        setModel(other.m_integrator.function(), other.m_jacobian.function());
+    return *this;
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::setModel(const casadi::Function &integrator, const casadi::Function &jacobian)
+{
+    m_transition = false;
+    m_integrator = kmath::FunctionEvaluator(integrator);
+    m_jacobian   = kmath::FunctionEvaluator(jacobian);
+
+    /** integrator with fixed horizon : {x0, p} */
+    std::vector<std::string> names = integrator.name_in();
+    auto x0 = std::find(names.begin(), names.end(), "x0");
+    auto p  = std::find(names.begin(), names.end(), "p");
+    m_fixed_step = (x0 != names.end());
+    if(m_fixed_step)
+    {
+        m_integrator.setInput(std::distance(names.begin(), x0), x.data());
+        if(p != names.end())
+            m_integrator.setInput(std::distance(names.begin(), p), u.data());
+        m_integrator.setOutput(integrator.index_out("xf"), m_x_next.data());
+    }
+    else
+    {
+        m_integrator.setInput(0, x.data());
+        m_integrator.setInput(1, u.data());
+        m_integrator.setInput(2, &m_dt);
+        m_integrator.setOutput(0, m_x_next.data());
+    }
+
+    m_jacobian.setInput(0, x.data());
+    m_jacobian.setInput(1, u.data());
+    m_jacobian.setOutput(0, m_A.data());
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::setModel(const casadi::Function &transition)
+{
+    m_transition = true;
+    m_fixed_step = false;
+    m_integrator = kmath::FunctionEvaluator(transition);
+    m_jacobian   = kmath::FunctionEvaluator();
+
+    m_integrator.setInput(0, x.data());
+    m_integrator.setInput(1, u.data());
+    m_integrator.setInput(2, &m_dt);
+    m_integrator.setOutput(0, m_x_next.data());
+    m_integrator.setOutput(1, m_A.data());
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::symmetrize()
+{
+    for(int i = 0; i < NX; ++i)
+        for(int j = i + 1; j < NX; ++j)
+            P(i, j) = P(j, i) = 0.5 * (P(i, j) + P(j, i));
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::propagateState(const double &dt)
+{
+    m_dt = dt;
+
+    if(m_transition)
+    {
+        /** state and exact transition matrix in one pass */
+        m_integrator.eval();
+    }
+    else
+    {
+        /** linearize at the current estimate before it is overwritten */
+        m_jacobian.eval();
+        m_A *= dt;
+        m_A.diagonal().array() += 1.0;
+        m_integrator.eval();
+    }
+    x = m_x_next;
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::propagate(const double &dt)
+{
+    propagateState(dt);
+
+    /** P = A * P * A' + W */
+    m_AP.noalias() = m_A * P;
+    P.noalias() = m_AP * m_A.transpose();
+    P += W;
+    symmetrize();
+}
+
+template<int NX, int NU, int NY>
+void EKFCore<NX, NU, NY>::predict(const double &dt, state_t &prediction)
+{
+    /** in transition mode Phi is written to the workspace and discarded */
+    m_dt = dt;
+    m_integrator.eval();
+    prediction = m_x_next;
+}
+
+template<int NX, int NU, int NY>
+bool EKFCore<NX, NU, NY>::update(const measurement_t &measurement)
+{
+    /** innovation and its covariance */
+    m_innovation = measurement;
+    m_innovation.noalias() -= H * x;
+    m_PHt.noalias() = P * H.transpose();
+    m_S.noalias() = H * m_PHt;
+    m_S += V;
+
+    /** Kalman gain : K = P * H' * S^-1 via Cholesky of S */
+    m_llt.compute(m_S);
+    if(m_llt.info() != Eigen::Success)
+        return false;
+    m_K.transpose() = m_llt.solve(m_PHt.transpose());
+
+    x.noalias() += m_K * m_innovation;
+
+    /** Joseph form : P = (I - K * H) * P * (I - K * H)' + K * V * K' */
+    m_IKH.setIdentity();
+    m_IKH.noalias() -= m_K * H;
+    m_AP.noalias() = m_IKH * P;
+    P.noalias() = m_AP * m_IKH.transpose();
+    m_PHt.noalias() = m_K * V;
+    P.noalias() += m_PHt * m_K.transpose();
+    symmetrize();
+    return true;
+}
+
+#endif // EKF_CORE_HPP
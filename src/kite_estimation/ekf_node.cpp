@@ -4,26 +4,69 @@ using namespace casadi;
 
 void KiteEKF_Node::filterCallback(const geometry_msgs::PoseStamped::ConstPtr &msg)
 {
-    /** update measurement */
+    /** runs on the pose queue thread : estimation is triggered by the measurement arrival */
+    ros::Time received = ros::Time::now();
+    boost::unique_lock<boost::mutex> scoped_lock(m_mutex);
     last_measurement_arrived = (*msg).header.stamp;
-    //boost::unique_lock<boost::mutex> scoped_lock(m_mutex);
-    /** @todo: revise sending mechanism instead */
-    if ( !measurements.empty() )
-    {
-        double time_lapsed = (last_measurement_arrived - measurements.back().header.stamp).toSec();
-        if( time_lapsed >= 0.01 )
-        {
-            measurements.push_back(*msg);
-            //std::cout << "callback: measurement came at: " << last_measurement_arrived
-            //          << " it was: " << convertToDM(*msg) << "\n";
-        }
-    }
-    else
+    last_measurement_received = received;
+    measurements.push_back(*msg);
+
+    if(!m_initialized)
     {
-        measurements.push_back(*msg);
-        //std::cout << "callback: first measurement came at: " << last_measurement_arrived
-        //          << " it was: " << convertToDM(*msg) << "\n";
+        initialize();
+        return;
     }
+
+    filter->setControl(control);
+    estimate();
+    publish(filter->getEstimation(), ros::Time(filter->getTimeStamp()));
+
+    trace.t_ekf_update = ros::Time::now().toSec();
+    trace_pub.publish(trace);
+}
+
+double KiteEKF_Node::predictionTime(const ros::Time &stamp) const
+{
+    /** the filter runs on the mocap stamps : carry over the time elapsed since the last measurement was received */
+    return filter->getTimeStamp() + (stamp - last_measurement_received).toSec();
+}
+
+void KiteEKF_Node::predictCallback(const ros::TimerEvent &event)
+{
+    /** never delay the estimator : skip the prediction if an update is running */
+    boost::unique_lock<boost::mutex> scoped_lock(m_mutex, boost::try_to_lock);
+    if(!scoped_lock || !m_initialized || (predicted_pub.getNumSubscribers() == 0))
+        return;
+
+    /** predict only between measurements and not too far ahead */
+    ros::Time ahead = ros::Time::now() + ros::Duration(prediction_lookahead);
+    double horizon = predictionTime(ahead) - filter->getTimeStamp();
+    if((horizon <= 0) || (horizon > max_prediction + std::max(0.0, prediction_lookahead)))
+        return;
+
+    /** predictions have their own topic : /kite_state, the state bus and the logs carry estimates only */
+    filter->setControl(control);
+    predicted_pub.publish(toMessage(filter->getPrediction(predictionTime(ahead)), ahead));
+}
+
+bool KiteEKF_Node::predictService(openkite::predict_state::Request &request, openkite::predict_state::Response &response)
+{
+    boost::unique_lock<boost::mutex> scoped_lock(m_mutex);
+    ros::Time stamp = request.stamp.isZero() ? ros::Time::now() : request.stamp;
+    stamp += ros::Duration(request.lookahead);
+    response.valid = m_initialized;
+    if(!response.valid)
+        return true;
+
+    /** the horizon is bounded by the lookahead on top of the regular prediction limit */
+    double horizon = predictionTime(stamp) - filter->getTimeStamp();
+    response.valid = (horizon <= max_prediction + std::max(0.0, request.lookahead));
+    if(!response.valid)
+        return true;
+
+    filter->setControl(control);
+    response.state = toMessage(filter->getPrediction(predictionTime(stamp)), stamp);
+    return true;
 }
 
 void KiteEKF_Node::controlCallback(const std_msgs::Int16MultiArray::ConstPtr &msg)
@@ -31,14 +74,17 @@ void KiteEKF_Node::controlCallback(const std_msgs::Int16MultiArray::ConstPtr &ms
     double throttle = static_cast<double>(msg->data[0]);
     double elevator = static_cast<double>(msg->data[2]);
     double rudder = static_cast<double>(msg->data[3]);
+    boost::unique_lock<boost::mutex> scoped_lock(m_mutex);
     control = DM::vertcat({throttle, elevator, rudder});
 }
 
-KiteEKF_Node::KiteEKF_Node(const ros::NodeHandle &_nh, const Function &Integrator, const Function &Jacobian)
+KiteEKF_Node::KiteEKF_Node(const ros::NodeHandle &_nh, const Function &Transition)
 {
     /** @redo model initialization*/
     nh = std::make_shared<ros::NodeHandle>(_nh);
-    measurements.set_capacity(2);
+    int queue_size;
+    nh->param<int>("measurement_queue", queue_size, 64);
+    measurements.set_capacity(std::max(2, queue_size));
 
     kite_state.twist.resize(1);
     kite_state.transforms.resize(1);
@@ -50,53 +96,78 @@ KiteEKF_Node::KiteEKF_Node(const ros::NodeHandle &_nh, const Function &Integrato
     brf_rotation = DMVector{0.0, -1.0, 0.0, 0.0};
 
     /** create filter object */
-    filter = std::make_shared<KiteEKF>(Integrator, Jacobian);
+    filter = std::make_shared<KiteEKF>(Transition);
+
+    int history_size;
+    nh->param<int>("history_size", history_size, 50);
+    filter->setHistorySize(history_size);
+
+    /** error-state filter with a 3-parameter attitude error */
+    bool multiplicative;
+    nh->param<bool>("multiplicative", multiplicative, false);
+    filter->setMultiplicative(multiplicative);
 
     /** initialize subscribers and publishers */
     state_pub = nh->advertise<sensor_msgs::MultiDOFJointState>("/kite_state", 100);
+    predicted_pub = nh->advertise<sensor_msgs::MultiDOFJointState>("/kite_state_predicted", 100);
+    trace_pub = nh->advertise<openkite::latency_trace>("/kite_state_trace", 100);
+    predict_srv = nh->advertiseService("predict_state", &KiteEKF_Node::predictService, this);
+
+    /** shared memory segment name, empty disables */
+    std::string shm_state;
+    nh->param<std::string>("shm_state", shm_state, "");
+    if(!shm_state.empty())
+        state_bus = std::make_shared<ShmStateChannel>(shm_state, ShmStateChannel::WRITER);
 
     /** @todo : parametrize topics */
     std::string pose_topic = "/optitrack_client/Kite/pose";
     std::string control_topic = "/chatter";
 
-    pose_sub = nh->subscribe(pose_topic, 1000, &KiteEKF_Node::filterCallback, this);
+    /** pose measurements are served by a dedicated queue and thread */
+    ros::SubscribeOptions pose_opts = ros::SubscribeOptions::create<geometry_msgs::PoseStamped>(pose_topic, 1000,
+                                      boost::bind(&KiteEKF_Node::filterCallback, this, _1), ros::VoidPtr(), &pose_queue);
+    pose_opts.transport_hints = ros::TransportHints().tcpNoDelay();
+    pose_sub = nh->subscribe(pose_opts);
+    pose_spinner = std::make_shared<ros::AsyncSpinner>(1, &pose_queue);
+
     control_sub = nh->subscribe(control_topic, 1000, &KiteEKF_Node::controlCallback, this);
 
+    /** predict-only outputs between measurements */
+    double predict_rate;
+    nh->param<double>("predict_rate", predict_rate, 200.0);
+    nh->param<double>("max_prediction", max_prediction, 0.05);
+    nh->param<double>("prediction_lookahead", prediction_lookahead, 0.0);
+    if(predict_rate > 0)
+        predict_timer = nh->createTimer(ros::Duration(1.0 / predict_rate), &KiteEKF_Node::predictCallback, this);
+
     m_initialized = false;
 }
 
+void KiteEKF_Node::start()
+{
+    pose_spinner->start();
+}
+
 void KiteEKF_Node::initialize()
 {
-    /** initialize kite state based on 2 sequential pose measurements */
-    if (measurements.size() == 2)
+    /** initialize kite state based on 2 pose measurements at least 10 ms apart */
+    if ((measurements.size() >= 2) && ((measurements.back().header.stamp - measurements.front().header.stamp).toSec() >= 0.01))
     {
         DM m_prev, m_new;
         double dt;
 
-        /** @todo: work out proper mutex lock */
-        //boost::unique_lock<boost::mutex> scoped_lock(m_mutex);
-        m_prev = optitrack2world(convertToDM(measurements[0]));
-        m_new = optitrack2world(convertToDM(measurements[1]));
-        dt = measurements[1].header.stamp.toSec() - measurements[0].header.stamp.toSec();
-
-        std::cout << "time: " << measurements[0].header.stamp << " meas_prev: " << m_prev << "\n";
-        std::cout << "time: " << measurements[1].header.stamp << " meas_new: " << m_new << "\n";
+        m_prev = optitrack2world(convertToDM(measurements.front()));
+        m_new = optitrack2world(convertToDM(measurements.back()));
+        dt = measurements.back().header.stamp.toSec() - measurements.front().header.stamp.toSec();
 
-        /** linear velocity estimation */
-        DM rdot = ( m_new(Slice(0, 3), 0) - m_prev(Slice(0, 3), 0) ) / dt;
-        SX att = m_prev( Slice(3, 7), 0);
-        DM att_inv = kmath::quat_inverse(att);
+        std::cout << "time: " << measurements.front().header.stamp << " meas_prev: " << m_prev << "\n";
+        std::cout << "time: " << measurements.back().header.stamp << " meas_new: " << m_new << "\n";
 
-        SX rdot_b = kmath::quat_multiply(att_inv, SX::vertcat({0, rdot}));
-        DM v_body = kmath::quat_multiply(rdot_b, att);
-        v_body = v_body(Slice(1, 4), 0);
-
-        /** estimate angular rates */
-        SX att2 = m_new( Slice(3, 7), 0);
-        DM dq = kmath::quat_multiply(SX(att_inv), att2);
-        DM identity = DM::vertcat({1,0,0,0});
-        DM qw = (2.0 / dt) * (dq - identity);
-        DM w_body = qw(Slice(1, 4), 0);
+        /** linear velocity and angular rates estimation */
+        const mocap::State init = mocap::initial_state(mocap::Pose::Map(m_prev.ptr()), mocap::Pose::Map(m_new.ptr()), dt);
+        DM v_body = DM::zeros(3), w_body = DM::zeros(3);
+        Eigen::Vector3d::Map(v_body.ptr()) = init.segment<3>(0);
+        Eigen::Vector3d::Map(w_body.ptr()) = init.segment<3>(3);
 
         std::cout << "Initialized at: " << v_body << " " << w_body << "\n";
 
@@ -108,9 +179,9 @@ void KiteEKF_Node::initialize()
         kite_state.twist[0].linear.y = v_brf[1];
         kite_state.twist[0].linear.z = v_brf[2];
 
-        kite_state.twist[0].angular.x = w_brf[3];
-        kite_state.twist[0].angular.y = w_brf[4];
-        kite_state.twist[0].angular.z = w_brf[5];
+        kite_state.twist[0].angular.x = w_brf[0];
+        kite_state.twist[0].angular.y = w_brf[1];
+        kite_state.twist[0].angular.z = w_brf[2];
 
         kite_state.transforms[0].translation.x = pose_irf[0];
         kite_state.transforms[0].translation.y = pose_irf[1];
@@ -125,6 +196,7 @@ void KiteEKF_Node::initialize()
         filter->setTime( measurements.back().header.stamp.toSec() );
         /** initialize filter */
         filter->setEstimation( DM::vertcat({v_body, w_body, m_new}) );
+        measurements.clear();
 
         m_initialized = true;
     }
@@ -147,70 +219,64 @@ DM KiteEKF_Node::convertToDM(const geometry_msgs::PoseStamped &_value)
 
 DM KiteEKF_Node::optitrack2world(const DM &opt_pose)
 {
-    DM position = opt_pose(Slice(0, 3), 0);
-    DM attitude = opt_pose(Slice(3, 7), 0);
-
-    DM tmp = kmath::quat_multiply(attitude, DM::vertcat({0, brf_offset}));
-    DM offset_b = kmath::quat_multiply(tmp, kmath::quat_inverse(attitude));
-    position += offset_b(Slice(1, 4), 0);
+    mocap::MocapFrame frame;
+    frame.brf_offset   = Eigen::Vector3d::Map(brf_offset.ptr());
+    frame.brf_rotation = Eigen::Vector4d::Map(brf_rotation.ptr());
 
     /** transform to world ref frame */
-    tmp = kmath::quat_multiply(brf_rotation, DM::vertcat({0, position}));
-    DM world_pos = kmath::quat_multiply(tmp, kmath::quat_inverse(brf_rotation));
-    world_pos = world_pos(Slice(1, 4), 0);
-
-    tmp = kmath::quat_multiply(brf_rotation, attitude);
-    DM world_att = kmath::quat_multiply(tmp, kmath::quat_inverse(brf_rotation));
-
-    /** @todo : remove this hack */
-    world_pos(2) = world_pos(2) + 2.77;
-
-    return DM::vertcat({world_pos, world_att});
+    DM world_pose = DM::zeros(7);
+    mocap::Pose::Map(world_pose.ptr()) = mocap::optitrack2world(mocap::Pose::Map(opt_pose.ptr()), frame);
+    return world_pose;
 }
 
 void KiteEKF_Node::estimate()
 {
-    //get observation
-    DM observation = optitrack2world(convertToDM(measurements.back()));
-    double tstamp = measurements.back().header.stamp.toSec();
-    filter->estimate(observation, tstamp);
+    /** fuse all pending measurements in arrival order */
+    while(!measurements.empty())
+    {
+        DM observation = optitrack2world(convertToDM(measurements.front()));
+        double tstamp = measurements.front().header.stamp.toSec();
 
-    /** update filter time */
-    filter->setTime(tstamp);
+        /** the pose stamp is the VRPN receive time unless the client uses the server time */
+        trace.header.stamp   = measurements.front().header.stamp;
+        trace.trace_id       = measurements.front().header.seq;
+        trace.t_vrpn_receive = tstamp;
+        measurements.pop_front();
+
+        if(!filter->estimate(observation, tstamp))
+            ROS_WARN_THROTTLE(1.0, "ekf_node: measurement dropped, older than the filter history or singular innovation covariance");
+    }
 }
 
-void KiteEKF_Node::publish()
+void KiteEKF_Node::publish(const DM &estimation, const ros::Time &stamp)
 {
-    /** pack estimation to ROS message */
-    DM correction = DM({0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
-                        -0.09, -0.1247, -0.0418, 0.0, 0.0, 0.0, 0.0}) +
-            DM({0.0, 0.0, 0.0, 0.0, 0.0, 0.0,
-                                    -0.02, 0.01, -0.0418, 0.0, 0.0, 0.0, 0.0});
-    DM corrected_estim = filter->getEstimation() - correction;
-    //std::cout << "Estimated distance: " << DM::norm_2(corrected_estim(Slice(6,9))) << "\n";
-    std::vector<double> state_vec = corrected_estim.nonzeros();
+    kite_state = toMessage(estimation, stamp);
 
-    kite_state.header.stamp = ros::Time::now();
-
-    kite_state.twist[0].linear.x = state_vec[0];
-    kite_state.twist[0].linear.y = state_vec[1];
-    kite_state.twist[0].linear.z = state_vec[2];
+    /** publish current state estimation */
+    state_pub.publish(kite_state);
 
-    kite_state.twist[0].angular.x = state_vec[3];
-    kite_state.twist[0].angular.y = state_vec[4];
-    kite_state.twist[0].angular.z = state_vec[5];
+    if(state_bus)
+    {
+        StateRecord record;
+        record.t_stamp = stamp.toSec();
+        mocap::State::Map(record.state) = mocap::message_to_state(kite_state);
+        state_bus->write(record);
+    }
+}
 
-    kite_state.transforms[0].translation.x = state_vec[6];
-    kite_state.transforms[0].translation.y = state_vec[7];
-    kite_state.transforms[0].translation.z = state_vec[8];
+sensor_msgs::MultiDOFJointState KiteEKF_Node::toMessage(const DM &estimation, const ros::Time &stamp)
+{
+    /** pack estimation to ROS message */
+    mocap::State corrected_estim = mocap::State::Map(estimation.ptr()) - mocap::state_correction();
 
-    kite_state.transforms[0].rotation.w = state_vec[9];
-    kite_state.transforms[0].rotation.x = state_vec[10];
-    kite_state.transforms[0].rotation.y = state_vec[11];
-    kite_state.transforms[0].rotation.z = state_vec[12];
+    sensor_msgs::MultiDOFJointState state_msg;
+    state_msg.joint_names.resize(1);
+    state_msg.header.frame_id = "kite";
+    state_msg.joint_names[0] = "lox";
+    state_msg.header.stamp = stamp;
+    mocap::state_to_message(corrected_estim, state_msg);
 
-    /** publish current state estimation */
-    state_pub.publish(kite_state);
+    return state_msg;
 }
 
 int main(int argc, char **argv)
@@ -218,9 +284,6 @@ int main(int argc, char **argv)
     ros::init(argc, argv, "ekf_node");
     ros::NodeHandle n("~");
 
-    unsigned tries = 0;
-    unsigned locks = 0;
-
     /** create a kite object */
     std::string kite_params_file;
     n.param<std::string>("kite_params", kite_params_file, "./umx_radian.yaml");
@@ -234,36 +297,15 @@ int main(int argc, char **argv)
     /** create a rigid body topic */
     RigidBodyKinematics rigid_body = RigidBodyKinematics(algo_props);
 
-    Function fIntegrator = rigid_body.getNumericIntegrator();
-    Function fJacobian = rigid_body.getNumericJacobian();
+    /** RK4 step with exact transition matrix */
+    Function fTransition = rigid_body.getNumericTransition();
 
     /** create an EKF instance */
-    KiteEKF_Node filter(n, fIntegrator, fJacobian);
-    ros::Rate loop_rate(50); /** 50 Hz */
+    KiteEKF_Node filter(n, fTransition);
 
-    while (ros::ok())
-    {
-        //std::cout << "TRIES: " << tries << " LOCKS: " << locks << "\n";
-
-        /** Some complicated logic here please */
-        if (!filter.initialized())
-        {   std::cout << "CANNOT INITIALIZE \n";
-            //boost::unique_lock<boost::mutex> scoped_lock(filter.m_mutex);
-            filter.initialize();
-        }
-        else
-        {
-            /** perform estimation */
-            //tries++;
-            //boost::unique_lock<boost::mutex> scoped_lock(filter.m_mutex);
-            ///locks++;
-            filter.estimate();
-            filter.publish();
-        }
-
-        ros::spinOnce();
-        loop_rate.sleep();
-    }
+    /** estimation runs on the pose callbacks, the main thread serves controls and predictions */
+    filter.start();
+    ros::spin();
 
     return 0;
 }
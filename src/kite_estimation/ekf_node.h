@@ -6,30 +6,41 @@
 #include "geometry_msgs/PoseStamped.h"
 #include "sensor_msgs/MultiDOFJointState.h"
 #include "std_msgs/Int16MultiArray.h"
+#include "openkite/predict_state.h"
+#include "openkite/latency_trace.h"
+#include "ros/callback_queue.h"
+#include "ros/spinner.h"
 
 #include "boost/thread/mutex.hpp"
 #include "boost/circular_buffer.hpp"
 
 #include "kiteEKF.h"
+#include "mocap_frame.hpp"
+#include "shm_state_bus.hpp"
 #include "sstream"
 
 class KiteEKF_Node
 {
 public:
-    KiteEKF_Node(const ros::NodeHandle &_nh, const casadi::Function &Integrator,
-                                             const casadi::Function &Jacobian );
-    virtual ~KiteEKF_Node(){}
+    KiteEKF_Node(const ros::NodeHandle &_nh, const casadi::Function &Transition);
+    virtual ~KiteEKF_Node(){if(pose_spinner) pose_spinner->stop();}
 
     sensor_msgs::MultiDOFJointState kite_state;
     boost::circular_buffer<geometry_msgs::PoseStamped> measurements;
     ros::Time last_measurement_arrived;
+    /** receive time of the last pose measurement, node clock */
+    ros::Time last_measurement_received;
 
     void filterCallback(const geometry_msgs::PoseStamped::ConstPtr &msg);
     void controlCallback(const std_msgs::Int16MultiArray::ConstPtr &msg);
+    void predictCallback(const ros::TimerEvent &event);
+    bool predictService(openkite::predict_state::Request &request, openkite::predict_state::Response &response);
 
-    void estimate(geometry_msgs::PoseStamped _pose);
+    /** start processing pose measurements */
+    void start();
     void estimate();
-    void publish();
+    void publish(const casadi::DM &estimation, const ros::Time &stamp);
+    sensor_msgs::MultiDOFJointState toMessage(const casadi::DM &estimation, const ros::Time &stamp);
 
     void initialize();
     bool initialized(){return m_initialized;}
@@ -45,8 +56,24 @@ private:
     casadi::DM brf_rotation;
 
     ros::Publisher state_pub;
+    ros::Publisher predicted_pub;
+    /** latency tracing : stamps of the last fused mocap sample, published on /kite_state_trace */
+    ros::Publisher trace_pub;
+    openkite::latency_trace trace;
+    ros::ServiceServer predict_srv;
     ros::Subscriber control_sub;
+    ros::CallbackQueue pose_queue;
     ros::Subscriber pose_sub;
+    std::shared_ptr<ros::AsyncSpinner> pose_spinner;
+
+    /** same-host consumers : latest state in shared memory, optional */
+    std::shared_ptr<ShmStateChannel> state_bus;
+
+    ros::Timer predict_timer;
+    /** maximal prediction horizon [s] */
+    double max_prediction;
+    /** predictions are published on /kite_state_predicted, ahead of the current time by lookahead [s] */
+    double prediction_lookahead;
 
     /** handle instance to access node params */
     std::shared_ptr<ros::NodeHandle> nh;
@@ -57,6 +84,8 @@ private:
     casadi::DM convertToDM(const geometry_msgs::PoseStamped &_value);
     casadi::DMVector convertToDM(const sensor_msgs::MultiDOFJointState &_value);
     casadi::DM optitrack2world(const casadi::DM &opt_pose);
+    /** filter time corresponding to a node clock stamp */
+    double predictionTime(const ros::Time &stamp) const;
 };
 
 
@@ -7,120 +7,325 @@ const DM KiteEKF::SIGMA_Q = DM::diag(DMVector{0.01, 0.05, 0.05, 0.05});
 const DM KiteEKF::SIGMA_V = DM::diag(DMVector{0.5, 0.5, 0.5});
 const DM KiteEKF::SIGMA_W = DM::diag(casadi::DMVector{0.5, 0.5, 0.5});
 const DM KiteEKF::SIGMA_R = DM::diag(casadi::DMVector{0.5, 0.1, 0.1});
+const DM KiteEKF::SIGMA_THETA = DM::diag(casadi::DMVector{0.1, 0.1, 0.1});
 
 const DM KiteEKF::DEFAULT_PROCESS_COVARIANCE = pow(DM::diagcat({SIGMA_V, SIGMA_W, SIGMA_R, SIGMA_Q}), 2);
 const DM KiteEKF::DEFAULT_MEASUREMENT_COVARIANCE = pow(DM::diag(DMVector{0.01,0.01,0.01, 0.0001,0.005,0.005,0.005}), 2);
 const DM KiteEKF::DEFAULT_MEASUREMENT_MATRIX = DM::horzcat(DMVector{DM::zeros(7,6), DM::eye(7)});
 
+const DM KiteEKF::DEFAULT_ERROR_PROCESS_COVARIANCE = pow(DM::diagcat({SIGMA_V, SIGMA_W, SIGMA_R, SIGMA_THETA}), 2);
+const DM KiteEKF::DEFAULT_ERROR_MEASUREMENT_COVARIANCE = pow(DM::diag(DMVector{0.01, 0.01, 0.01, 0.01, 0.01, 0.01}), 2);
+
+namespace
+{
+    /** copy a (possibly sparse) DM into a fixed-size Eigen matrix */
+    template<typename Matrix>
+    void dm2eigen(const DM &in, Matrix &out)
+    {
+        DM dense = DM::densify(in);
+        if((dense.size1() != out.rows()) || (dense.size2() != out.cols()))
+        {
+            std::cout << "KiteEKF: expected " << out.rows() << "x" << out.cols() << " matrix, provided "
+                      << dense.size1() << "x" << dense.size2() << "\n";
+            return;
+        }
+        out = Eigen::Map<const Matrix>(dense.nonzeros().data());
+    }
+
+    template<typename Matrix>
+    DM eigen2dm(const Matrix &in)
+    {
+        return DM::reshape(DM(std::vector<double>(in.data(), in.data() + in.size())), in.rows(), in.cols());
+    }
+}
+
 KiteEKF::KiteEKF(const KiteProperties &KiteProps, const AlgorithmProperties &AlgoProps)
 {
     /** instantiate kite object */
     Kite = std::make_shared<KiteDynamics>(KiteProps, AlgoProps);
+    if(AlgoProps.Integrator == IntType::RK4)
+        init(Kite->getNumericTransition());
+    else
+        init(Kite->getNumericIntegrator(), Kite->getNumericJacobian());
+}
 
-    this->m_Integrator = Kite->getNumericIntegrator();
-    this->m_Jacobian = Kite->getNumericJacobian();
+KiteEKF::KiteEKF(std::shared_ptr<KiteDynamics> obj_Kite)
+{
+    Kite = obj_Kite;
+    if(Kite->getNumericIntegrator().name().find("RK4") != std::string::npos)
+        init(Kite->getNumericTransition());
+    else
+        init(Kite->getNumericIntegrator(), Kite->getNumericJacobian());
+}
 
-    this->W = DEFAULT_PROCESS_COVARIANCE;
-    this->V = DEFAULT_MEASUREMENT_COVARIANCE;
-    this->H = DEFAULT_MEASUREMENT_MATRIX;
-    this->Cov_Est = 10 * this->W;
+KiteEKF::KiteEKF(const Function &_Transition)
+{
+    init(_Transition);
+}
 
-    /** initialize time */
-    std::chrono::time_point<std::chrono::system_clock> t_now = kite_utils::get_time();
-    auto duration = t_now.time_since_epoch();
-    auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
-    this->tstamp = static_cast<double>(microsec) * 1e-6;
+KiteEKF::KiteEKF(const Function &_Dynamics, const Function &_Jacobian)
+{
+    /** instantiate model */
+    init(_Dynamics, _Jacobian);
+    std::cout << tstamp << "\n";
 }
 
-KiteEKF::KiteEKF(std::shared_ptr<KiteDynamics> obj_Kite)
+void KiteEKF::init(const Function &_Integrator, const Function &_Jacobian)
 {
-    Kite = obj_Kite;
+    if ((_Integrator.name().find("RK4") == std::string::npos) && (_Integrator.name().find("CVODES") == std::string::npos))
+        std::cout << "WARNING: Unknown intergrator! \n";
 
-    this->m_Integrator = Kite->getNumericIntegrator();
-    this->m_Jacobian = Kite->getNumericJacobian();
+    m_core.setModel(_Integrator, _Jacobian);
+    m_mekf.setModel(_Integrator, _Jacobian);
+    initCovariances();
+}
 
-    this->W = DEFAULT_PROCESS_COVARIANCE;
-    this->V = DEFAULT_MEASUREMENT_COVARIANCE;
-    this->H = DEFAULT_MEASUREMENT_MATRIX;
-    this->Cov_Est = 10 * this->W;
+void KiteEKF::init(const Function &_Transition)
+{
+    if(_Transition.n_out() != 2)
+        std::cout << "WARNING: transition function should return {x_next, Phi} \n";
 
-    /** initialize time */
-    std::chrono::time_point<std::chrono::system_clock> t_now = kite_utils::get_time();
-    auto duration = t_now.time_since_epoch();
-    auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
-    this->tstamp = static_cast<double>(microsec) * 1e-6;
+    m_core.setModel(_Transition);
+    m_mekf.setModel(_Transition);
+    initCovariances();
 }
 
-KiteEKF::KiteEKF(const Function &_Dynamics, const Function &_Jacobian)
+void KiteEKF::initCovariances()
 {
-    /** instantiate model */
-    this->m_Integrator = _Dynamics;
-    this->m_Jacobian = _Jacobian;
+    setHistorySize(50);
+    m_multiplicative = false;
 
-    this->W = DEFAULT_PROCESS_COVARIANCE;
-    this->V = DEFAULT_MEASUREMENT_COVARIANCE;
-    this->H = DEFAULT_MEASUREMENT_MATRIX;
-    this->Cov_Est = 10 * this->W;
+    dm2eigen(DEFAULT_PROCESS_COVARIANCE, m_core.W);
+    dm2eigen(DEFAULT_MEASUREMENT_COVARIANCE, m_core.V);
+    dm2eigen(DEFAULT_MEASUREMENT_MATRIX, m_core.H);
+    m_core.P = 10 * m_core.W;
+
+    dm2eigen(DEFAULT_ERROR_PROCESS_COVARIANCE, m_mekf.W);
+    dm2eigen(DEFAULT_ERROR_MEASUREMENT_COVARIANCE, m_mekf.V);
+    m_mekf.P = 10 * m_mekf.W;
 
     /** initialize time */
     std::chrono::time_point<std::chrono::system_clock> t_now = kite_utils::get_time();
     auto duration = t_now.time_since_epoch();
     auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
     this->tstamp = static_cast<double>(microsec) * 1e-6;
+}
 
-    std::cout << tstamp << "\n";
+void KiteEKF::setMultiplicative(const bool &enable)
+{
+    if(enable == m_multiplicative)
+        return;
+
+    /** carry the estimate over, covariances restart from the defaults of the mode */
+    core_t::state_t x = state();
+    core_t::control_t u = control();
+    m_multiplicative = enable;
+    state() = x;
+    control() = u;
+    if(m_multiplicative)
+    {
+        state().tail<4>().normalize();
+        m_mekf.P = 10 * m_mekf.W;
+    }
+    else
+    {
+        m_core.P = 10 * m_core.W;
+    }
+    clearHistory();
 }
 
+void KiteEKF::setProcessCovariance(const DM &_W)
+{
+    if(m_multiplicative)
+        dm2eigen(_W, m_mekf.W);
+    else
+        dm2eigen(_W, m_core.W);
+}
+
+void KiteEKF::setMeasurementCovariance(const DM &_V)
+{
+    if(m_multiplicative)
+        dm2eigen(_V, m_mekf.V);
+    else
+        dm2eigen(_V, m_core.V);
+}
+
+void KiteEKF::setEstimationCovariance(const DM &_P)
+{
+    if(m_multiplicative)
+        dm2eigen(_P, m_mekf.P);
+    else
+        dm2eigen(_P, m_core.P);
+    clearHistory();
+}
+
+void KiteEKF::setEstimation(const DM &_estimation)
+{
+    dm2eigen(_estimation, state());
+    if(m_multiplicative)
+        state().tail<4>().normalize();
+    clearHistory();
+}
+
+void KiteEKF::setControl(const DM &_control)
+{
+    /** empty control is interpreted as zeros */
+    if(_control.is_empty())
+        control().setZero();
+    else
+        dm2eigen(_control, control());
+}
+
+DM KiteEKF::getEstimation()
+{
+    return eigen2dm(state());
+}
+
+DM KiteEKF::getPrediction(const double &_tstamp)
+{
+    if(m_multiplicative)
+        m_mekf.predict(_tstamp - this->tstamp, m_prediction);
+    else
+        m_core.predict(_tstamp - this->tstamp, m_prediction);
+    return eigen2dm(m_prediction);
+}
+
+DM KiteEKF::getEstimationCovariance()
+{
+    if(m_multiplicative)
+        return eigen2dm(m_mekf.P);
+    return eigen2dm(m_core.P);
+}
 
 void KiteEKF::propagate(const double &_dt)
 {
-    DM new_state;
-    if (m_Integrator.name().find("RK4") != std::string::npos)
+    if(m_multiplicative)
+        m_mekf.propagate(_dt);
+    else
+        m_core.propagate(_dt);
+}
+
+bool KiteEKF::step(const double &_dt, const core_t::measurement_t &y)
+{
+    if(m_multiplicative)
     {
-        DMVector out = m_Integrator(DMVector{State_Est, Control, _dt});
-        new_state = out[0];
+        m_mekf.propagate(_dt);
+        return m_mekf.update(y);
     }
-    else if (m_Integrator.name().find("CVODES") != std::string::npos)
+
+    m_core.propagate(_dt);
+    return m_core.update(y);
+}
+
+void KiteEKF::setHistorySize(const int &size)
+{
+    m_history.resize(std::max(0, size));
+    clearHistory();
+}
+
+bool KiteEKF::estimate(const DM &measurement, const double &_tstamp)
+{
+    if(measurement.nnz() != m_core.H.rows())
     {
-        DMDict args = {{"x0", State_Est}, {"p", Control}};
-        DMDict out = m_Integrator(args);
-        new_state = out["xf"];
+        std::cout << "KiteEKF: measurement should be dense vector of size " << m_core.H.rows() << "\n";
+        return false;
     }
-    else
-        std::cout << "WARNING: Unknown intergrator! \n";
+    Eigen::Map<const core_t::measurement_t> y(measurement.nonzeros().data());
+
+    /** late measurement : without history there is nothing to re-run, a backward propagation would corrupt the estimate */
+    if(_tstamp < this->tstamp)
+        return (m_history_count > 0) ? fuseOutOfSequence(y, _tstamp) : false;
 
-    /** propagate covariance */
-    DM A = m_Jacobian(DMVector{State_Est, Control})[0] * _dt + DM::eye(13);
-    DM P_new = DM::mtimes(DM::mtimes(A, Cov_Est), A.T()) + W;
+    /** prediction and update step : a rejected update leaves the prediction */
+    bool updated = step(_tstamp - this->tstamp, y);
+    this->tstamp = _tstamp;
 
-    State_Est = new_state;
-    Cov_Est = P_new;
+    if(m_history.empty())
+        return updated;
+
+    /** append to history, the oldest entry is overwritten when full */
+    if(m_history_count == m_history.size())
+    {
+        m_history_head = (m_history_head + 1) % m_history.size();
+        --m_history_count;
+    }
+    storeHistory(m_history_count++, _tstamp, y);
+    return updated;
 }
 
-void KiteEKF::estimate(const DM &measurement, const double &_tstamp)
+void KiteEKF::storeHistory(const size_t &k, const double &_tstamp, const core_t::measurement_t &y)
 {
-    /** prediction step */
-    double dt = _tstamp - this->tstamp;
-    std::cout << "Time lapse in Kalman: " << dt << "\n";
-    _estimate(measurement, dt);
+    HistoryEntry &entry = history(k);
+    entry.t = _tstamp;
+    entry.x = state();
+    entry.u = control();
+    entry.y = y;
+    if(m_multiplicative)
+        entry.Pe = m_mekf.P;
+    else
+        entry.P = m_core.P;
 }
 
-void KiteEKF::_estimate(const DM &measurement, const double &_dt)
+bool KiteEKF::fuseOutOfSequence(const core_t::measurement_t &y, const double &_tstamp)
 {
-    this->propagate(_dt);
+    /** measurement predates the retained history */
+    if(_tstamp < history(0).t)
+        return false;
 
-    /** update step */
-    DM y = measurement - DM::mtimes(H, State_Est);
-    /** innovation covariance */
-    DM S = DM::mtimes(DM::mtimes(H, Cov_Est), H.T()) + V;
-    /** Kalman gain */
-    DM K = DM::mtimes(DM::mtimes(Cov_Est, H.T()), DM::solve(S, SX::eye(7)));
+    /** insertion point : first entry newer than the measurement */
+    size_t k = m_history_count;
+    while((k > 0) && (history(k - 1).t > _tstamp))
+        --k;
 
-    /** updated state estimate */
-    DM x_est = State_Est + DM::mtimes(K, y);
-    /** estimate covariance update */
-    DM P_est = DM::mtimes((DM::eye(13) - DM::mtimes(K, H)), Cov_Est);
+    /** make room : drop the oldest entry when full */
+    if(m_history_count == m_history.size())
+    {
+        if(k == 1)
+            return false;
+        m_history_head = (m_history_head + 1) % m_history.size();
+        --m_history_count;
+        --k;
+    }
+    for(size_t j = m_history_count; j > k; --j)
+        history(j) = history(j - 1);
+    ++m_history_count;
+
+    /** the control held after the preceding entry drives the filter up to the new entry, later entries keep their own */
+    core_t::control_t u_current = control();
+    history(k).t = _tstamp;
+    history(k).u = history(k - 1).u;
+    history(k).y = y;
+
+    /** re-run the filter from the entry preceding the insertion point : bounded by the history size */
+    state() = history(k - 1).x;
+    if(m_multiplicative)
+        m_mekf.P = history(k - 1).Pe;
+    else
+        m_core.P = history(k - 1).P;
+    bool updated = true;
+    for(size_t j = k; j < m_history_count; ++j)
+    {
+        HistoryEntry &entry = history(j);
+        control() = entry.u;
+        bool status = step(entry.t - history(j - 1).t, entry.y);
+        if(j == k)
+            updated = status;
+        storeHistory(j, entry.t, entry.y);
+    }
+    control() = u_current;
+    return updated;
+}
+
+void KiteEKF::_estimate(const DM &measurement, const double &_dt)
+{
+    if(measurement.nnz() != m_core.H.rows())
+    {
+        this->propagate(_dt);
+        std::cout << "KiteEKF: measurement should be dense vector of size " << m_core.H.rows() << "\n";
+        return;
+    }
 
-    State_Est = x_est;
-    Cov_Est = P_est;
+    /** measurement is read in place */
+    if(!step(_dt, Eigen::Map<const core_t::measurement_t>(measurement.nonzeros().data())))
+        std::cout << "KiteEKF: innovation covariance is not positive definite, update skipped \n";
 }
@@ -2,6 +2,7 @@
 #define KITEEKF_H
 
 #include "kite.h"
+#include "mekf_core.hpp"
 #include "chrono"
 
 #define DEPRECATED
@@ -12,6 +13,8 @@ public:
     KiteEKF(const KiteProperties &KiteProps, const AlgorithmProperties &AlgoProps); DEPRECATED
     KiteEKF(std::shared_ptr<KiteDynamics> obj_Kite);                                DEPRECATED
     KiteEKF(const casadi::Function &_Dynamics, const casadi::Function &_Jacobian);
+    /** _Transition : Function({x, u, dt}) -> {x_next, Phi}, e.g. KiteDynamics::getNumericTransition() */
+    explicit KiteEKF(const casadi::Function &_Transition);
 
     virtual ~KiteEKF(){}
 
@@ -19,41 +22,88 @@ public:
     static const casadi::DM SIGMA_R;
     static const casadi::DM SIGMA_V;
     static const casadi::DM SIGMA_W;
+    static const casadi::DM SIGMA_THETA;
 
     static const casadi::DM DEFAULT_PROCESS_COVARIANCE;
     static const casadi::DM DEFAULT_MEASUREMENT_COVARIANCE;
     static const casadi::DM DEFAULT_MEASUREMENT_MATRIX;
+    /** error-state covariances : [dv, dw, dr, dtheta] and [dr, dtheta] */
+    static const casadi::DM DEFAULT_ERROR_PROCESS_COVARIANCE;
+    static const casadi::DM DEFAULT_ERROR_MEASUREMENT_COVARIANCE;
 
-    void setProcessCovariance(const casadi::DM &_W){this->W = _W;}
-    void setMeasurementCovariance(const casadi::DM &_V){this->V = _V;}
-    void setEstimationCovariance(const casadi::DM &_P){this->Cov_Est = _P;}
-    void setEstimation(const casadi::DM &_estimation){this->State_Est = _estimation;}
-    void setControl(const casadi::DM &_control){this->Control = _control;}
-    void setTime(const double &_current_time){this->tstamp = _current_time;}
+    /** multiplicative (error-state) mode : 12x12 covariance over a 3-parameter attitude error and
+     *  quaternion reset after each update; covariances are reset to the defaults of the selected mode.
+     *  Process, measurement and estimation covariances are then 12x12, 6x6 and 12x12 */
+    void setMultiplicative(const bool &enable);
+    bool multiplicative(){return m_multiplicative;}
 
-    casadi::DM getEstimation(){return this->State_Est;}
-    casadi::DM getEstimationCovariance(){return this->Cov_Est;}
+    void setProcessCovariance(const casadi::DM &_W);
+    void setMeasurementCovariance(const casadi::DM &_V);
+    void setEstimationCovariance(const casadi::DM &_P);
+    void setEstimation(const casadi::DM &_estimation);
+    void setControl(const casadi::DM &_control);
+    void setTime(const double &_current_time){this->tstamp = _current_time; clearHistory();}
+
+    /** number of processed measurements kept for out-of-sequence fusion (0 disables) */
+    void setHistorySize(const int &size);
+    void clearHistory(){m_history_head = 0; m_history_count = 0;}
+
+    casadi::DM getEstimation();
+    /** state predicted from the current estimate to the time stamp, the filter is not modified */
+    casadi::DM getPrediction(const double &_tstamp);
+    casadi::DM getEstimationCovariance();
     double getTimeStamp(){return this->tstamp;}
 
-    void estimate(const casadi::DM &measurement, const double &_tstamp);
+    /** fuse a time stamped measurement; a measurement older than the latest one is inserted
+     *  into the history and the filter is re-run from that point. Returns false if the
+     *  measurement is older than the history (or late while the history is empty) and has
+     *  been dropped, or if its update was skipped because the innovation covariance is not
+     *  positive definite */
+    bool estimate(const casadi::DM &measurement, const double &_tstamp);
     void _estimate(const casadi::DM &measurement, const double &_dt);
 
     /** @brief Kalman filter equations */
     void propagate(const double & _dt);
 
+    /** 13 states, 3 controls, 7 pose measurements */
+    typedef EKFCore<13, 3, 7> core_t;
+    typedef MEKFCore<13, 3> mekf_core_t;
+
 private:
     std::shared_ptr<KiteDynamics> Kite;
-    casadi::DM State_Est;
-    casadi::DM Cov_Est;
-    casadi::DM Control;
+    /** fixed-size filter : all covariance algebra is done in place */
+    core_t m_core;
+    mekf_core_t m_mekf;
+    bool m_multiplicative;
+    core_t::state_t m_prediction;
+    double tstamp;
 
-    casadi::Function m_Integrator;
-    casadi::Function m_Jacobian;
+    /** HISTORY : ring of processed measurements with posterior estimates, preallocated */
+    struct HistoryEntry
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        double t;
+        core_t::state_t x;
+        core_t::state_cov_t P;
+        mekf_core_t::error_cov_t Pe;
+        core_t::control_t u;
+        core_t::measurement_t y;
+    };
+    std::vector<HistoryEntry, Eigen::aligned_allocator<HistoryEntry>> m_history;
+    size_t m_history_head;
+    size_t m_history_count;
+    HistoryEntry& history(const size_t &k){return m_history[(m_history_head + k) % m_history.size()];}
+    bool fuseOutOfSequence(const core_t::measurement_t &y, const double &_tstamp);
+    void storeHistory(const size_t &k, const double &_tstamp, const core_t::measurement_t &y);
 
-    casadi::DM W;
-    casadi::DM V;
-    casadi::DM H;
-    double tstamp;
+    /** dispatch to the filter of the active mode */
+    bool step(const double &_dt, const core_t::measurement_t &y);
+    core_t::state_t& state(){return m_multiplicative ? m_mekf.x() : m_core.x;}
+    core_t::control_t& control(){return m_multiplicative ? m_mekf.u() : m_core.u;}
+
+    void init(const casadi::Function &_Integrator, const casadi::Function &_Jacobian);
+    void init(const casadi::Function &_Transition);
+    void initCovariances();
 };
 
 
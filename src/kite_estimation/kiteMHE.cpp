@@ -0,0 +1,282 @@
+#include "kiteMHE.h"
+#include "pseudospectral/chebyshev.hpp"
+#include <algorithm>
+
+using namespace casadi;
+
+const DM KiteMHE::DEFAULT_LBX = DM::vertcat({-DM::inf(1), -DM::inf(1), -DM::inf(1), -4 * M_PI, -4 * M_PI, -4 * M_PI,
+                                             -DM::inf(1), -DM::inf(1), -DM::inf(1), -1.05, -1.05, -1.05, -1.05});
+const DM KiteMHE::DEFAULT_UBX = DM::vertcat({DM::inf(1), DM::inf(1), DM::inf(1), 4 * M_PI, 4 * M_PI, 4 * M_PI,
+                                             DM::inf(1), DM::inf(1), DM::inf(1), 1.05, 1.05, 1.05, 1.05});
+
+const DM KiteMHE::DEFAULT_MEASUREMENT_WEIGHTS = DM({1e3, 1e3, 1e3, 1e2, 1e2, 1e2, 1e2});
+const DM KiteMHE::DEFAULT_ARRIVAL_WEIGHTS = DM({1e1, 1e1, 1e1, 1, 1, 1, 1e2, 1e2, 1e2, 1e2, 1e2, 1e2, 1e2});
+
+namespace
+{
+    /** collocated window : dynamic constraints, fitting cost and decision variables */
+    struct MHETranscription
+    {
+        SX G, J, X, U, P;
+    };
+
+    template<int NPAR>
+    MHETranscription transcribe(Function &dynamics, Function &fitting, const SX &data, const double &window)
+    {
+        Chebyshev<SX, KiteMHE::POLY_ORDER, KiteMHE::NUM_SEGMENTS, KiteMHE::NX, KiteMHE::NU, NPAR> spectral;
+        MHETranscription window_nlp;
+        window_nlp.G = spectral.CollocateDynamics(dynamics, 0, window);
+        /** the oldest state is free : drop its collocation equation */
+        window_nlp.G = window_nlp.G(Slice(0, KiteMHE::NUM_SEGMENTS * KiteMHE::POLY_ORDER * KiteMHE::NX));
+        window_nlp.J = spectral.CollocateIdCost(fitting, data, 0, window);
+        window_nlp.X = spectral.VarX();
+        window_nlp.U = spectral.VarU();
+        window_nlp.P = spectral.VarP();
+        return window_nlp;
+    }
+
+    /** linear interpolation clamped to the buffer ends, quaternion at q_idx is normalized */
+    std::vector<double> interpolate(const std::deque<KiteMHE::Sample> &samples, const double &t, const int &q_idx)
+    {
+        auto next = std::lower_bound(samples.begin(), samples.end(), t,
+                                     [](const KiteMHE::Sample &s, const double &value){return s.t < value;});
+        if(next == samples.begin())
+            return next->value;
+        if(next == samples.end())
+            return samples.back().value;
+
+        auto prev = std::prev(next);
+        double alpha = (t - prev->t) / std::max(next->t - prev->t, 1e-9);
+        std::vector<double> a = prev->value;
+        std::vector<double> b = next->value;
+
+        /** shortest path between the two attitudes */
+        double dot = 0;
+        for(int i = q_idx; i < q_idx + 4; ++i)
+            dot += a[i] * b[i];
+        if(dot < 0)
+            for(int i = q_idx; i < q_idx + 4; ++i)
+                b[i] = -b[i];
+
+        std::vector<double> value(a.size());
+        for(size_t i = 0; i < a.size(); ++i)
+            value[i] = (1 - alpha) * a[i] + alpha * b[i];
+
+        double norm = 0;
+        for(int i = q_idx; i < q_idx + 4; ++i)
+            norm += value[i] * value[i];
+        norm = std::sqrt(norm);
+        for(int i = q_idx; i < q_idx + 4; ++i)
+            value[i] /= norm;
+        return value;
+    }
+
+    /** zero-order hold, the first sample is held backwards */
+    std::vector<double> hold(const std::deque<KiteMHE::Sample> &samples, const double &t)
+    {
+        auto next = std::upper_bound(samples.begin(), samples.end(), t,
+                                     [](const double &value, const KiteMHE::Sample &s){return value < s.t;});
+        if(next == samples.begin())
+            return next->value;
+        return std::prev(next)->value;
+    }
+
+    void insert_sorted(std::deque<KiteMHE::Sample> &samples, const KiteMHE::Sample &sample)
+    {
+        auto pos = std::upper_bound(samples.begin(), samples.end(), sample.t,
+                                    [](const double &value, const KiteMHE::Sample &s){return value < s.t;});
+        samples.insert(pos, sample);
+    }
+
+    /** drop samples before t, keeping one for interpolation at t */
+    void trim(std::deque<KiteMHE::Sample> &samples, const double &t)
+    {
+        while((samples.size() > 1) && (samples[1].t <= t))
+            samples.pop_front();
+    }
+}
+
+DM KiteMHE::nominal_parameters(const KiteProperties &props)
+{
+    const PlaneAerodynamics &aero = props.Aerodynamics;
+    return DM({aero.CL0, aero.CLa_total, aero.CD0_total, aero.CYb, aero.Cm0, aero.Cma, aero.Cnb, aero.Clb,
+               aero.CLq, aero.Cmq, aero.CYr, aero.Cnr, aero.Clr, aero.CYp, aero.Clp, aero.Cnp,
+               aero.CLde, aero.CYdr, aero.Cmde, aero.Cndr, aero.Cldr});
+}
+
+KiteMHE::KiteMHE(const Function &_Dynamics, const double &window) : Dynamics(_Dynamics), Window(window)
+{
+    NumParams = (Dynamics.n_in() > 2) ? Dynamics.size1_in(2) : 0;
+    if((NumParams != 0) && (NumParams != NP))
+    {
+        std::cout << "KiteMHE: expected " << NP << " model parameters, provided " << NumParams
+                  << ": parameters will not be estimated \n";
+        NumParams = 0;
+    }
+
+    LBX = DEFAULT_LBX;
+    UBX = DEFAULT_UBX;
+    LBP = -DM::inf(NumParams);
+    UBP = DM::inf(NumParams);
+    Params = DM::zeros(NumParams);
+
+    Wy = DEFAULT_MEASUREMENT_WEIGHTS;
+    Wx = DEFAULT_ARRIVAL_WEIGHTS;
+    Wp = 1e2 * DM::ones(NumParams);
+
+    Estimation = DM::zeros(NX);
+    Estimation(9) = 1.0;
+
+    /** real-time settings : bounded iteration count, the last iterate is used if not converged */
+    NLPConfig.max_iter   = 10;
+    NLPConfig.warm_start = true;
+
+    /** relative node times : nodes are in reversed time order within reversed segments */
+    double h = Window / NUM_SEGMENTS;
+    for(int n = 0; n < NUM_NODES; ++n)
+    {
+        int segment = std::min(n / POLY_ORDER, NUM_SEGMENTS - 1);
+        int local   = n - segment * POLY_ORDER;
+        NodeTimes.push_back(-h * (segment + 0.5 * (1 - std::cos(M_PI * local / POLY_ORDER))));
+    }
+
+    tstamp = 0;
+    _initialized = false;
+}
+
+void KiteMHE::createNLP()
+{
+    /** measurement model : mocap pose */
+    SX x = SX::sym("x", NX);
+    SX y = SX::sym("y", NY);
+    SX residual = x(Slice(6, 13)) - y;
+    SX fitting_cost = SX::sumRows( SX::mtimes(SX::diag(SX(Wy)), pow(residual, 2)) );
+    Function FittingCost = Function("fitting_cost", {x, y}, {fitting_cost});
+
+    SX data = SX::sym("data", NY, NUM_NODES);
+    MHETranscription window_nlp = (NumParams > 0) ? transcribe<NP>(Dynamics, FittingCost, data, Window) :
+                                                    transcribe<0>(Dynamics, FittingCost, data, Window);
+
+    /** arrival cost : prior on the oldest state and on the parameters */
+    SX x_prior = SX::sym("x_prior", NX);
+    SX p_prior = SX::sym("p_prior", NumParams);
+    SX x_arrival = window_nlp.X(Slice((NUM_NODES - 1) * NX, NUM_NODES * NX));
+    SX arrival = SX::sumRows( SX::mtimes(SX::diag(SX(Wx)), pow(x_arrival - x_prior, 2)) );
+    if(NumParams > 0)
+        arrival += SX::sumRows( SX::mtimes(SX::diag(SX(Wp)), pow(window_nlp.P - p_prior, 2)) );
+
+    SXDict NLP;
+    NLP["x"] = SX::vertcat({window_nlp.X, window_nlp.P});
+    NLP["f"] = window_nlp.J + arrival;
+    NLP["g"] = window_nlp.G;
+    NLP["p"] = SX::vertcat({SX::vec(data), window_nlp.U, x_prior, p_prior});
+
+    NLP_Solver = kmath::nlp_solver("mhe_solver", NLP, NLPConfig);
+
+    ARG["lbx"] = DM::vertcat({DM::repmat(LBX, NUM_NODES, 1), LBP});
+    ARG["ubx"] = DM::vertcat({DM::repmat(UBX, NUM_NODES, 1), UBP});
+    ARG["lbg"] = DM::zeros(window_nlp.G.size1());
+    ARG["ubg"] = DM::zeros(window_nlp.G.size1());
+}
+
+void KiteMHE::addMeasurement(const DM &pose, const double &_tstamp)
+{
+    if(pose.nnz() != NY)
+    {
+        std::cout << "KiteMHE: measurement should be dense vector of size " << NY << "\n";
+        return;
+    }
+    insert_sorted(Measurements, Sample{_tstamp, pose.nonzeros()});
+}
+
+void KiteMHE::addControl(const DM &control, const double &_tstamp)
+{
+    if(control.nnz() != NU)
+    {
+        std::cout << "KiteMHE: control should be dense vector of size " << NU << "\n";
+        return;
+    }
+    insert_sorted(Controls, Sample{_tstamp, control.nonzeros()});
+}
+
+bool KiteMHE::estimate(const double &_tstamp)
+{
+    if(NLP_Solver.is_null())
+    {
+        std::cout << "KiteMHE: createNLP() should be called before estimate() \n";
+        return false;
+    }
+    double t_start = _tstamp + NodeTimes.back();
+    if(Measurements.empty() || (Measurements.front().t > t_start))
+        return false;
+
+    /** quaternion sign of the measurements is aligned with the current attitude estimate */
+    std::vector<double> q_ref = _initialized ? std::vector<double>(Estimation.nonzeros().begin() + 9, Estimation.nonzeros().end())
+                                             : std::vector<double>(Measurements.back().value.begin() + 3, Measurements.back().value.end());
+
+    /** resample measurements and controls at the collocation nodes : data in forward time */
+    DM data = DM::zeros(NY, NUM_NODES);
+    DM controls = DM::zeros(NU * NUM_NODES);
+    DM guess = DM::zeros(NX * NUM_NODES);
+    for(int n = 0; n < NUM_NODES; ++n)
+    {
+        double t = _tstamp + NodeTimes[n];
+        std::vector<double> pose = interpolate(Measurements, t, 3);
+        double dot = 0;
+        for(int i = 0; i < 4; ++i)
+            dot += pose[3 + i] * q_ref[i];
+        if(dot < 0)
+            for(int i = 3; i < NY; ++i)
+                pose[i] = -pose[i];
+        data(Slice(), NUM_NODES - 1 - n) = DM(pose);
+
+        if(!Controls.empty())
+            controls(Slice(n * NU, (n + 1) * NU)) = DM(hold(Controls, t));
+
+        /** initial guess : shifted previous solution, measured pose on the first window */
+        if(_initialized)
+            guess(Slice(n * NX, (n + 1) * NX)) = DM(interpolate(Trajectory, t, 9));
+        else
+            guess(Slice(n * NX, (n + 1) * NX)) = DM::vertcat({Estimation(Slice(0, 6)), DM(pose)});
+    }
+
+    /** arrival prior from the previous window */
+    DM x_prior = guess(Slice((NUM_NODES - 1) * NX, NUM_NODES * NX));
+
+    ARG["p"]  = DM::vertcat({DM::vec(data), controls, x_prior, Params});
+    ARG["x0"] = DM::vertcat({guess, Params});
+    if(_initialized && NLPConfig.warm_start)
+    {
+        ARG["lam_x0"] = NLP_LAM_X;
+        ARG["lam_g0"] = NLP_LAM_G;
+    }
+
+    DMDict res = NLP_Solver(ARG);
+    stats = NLP_Solver.stats();
+
+    DM solution = res.at("x");
+    if(!std::isfinite(DM::norm_inf(solution).nonzeros()[0]))
+        return false;
+
+    NLP_X     = solution;
+    NLP_LAM_X = res.at("lam_x");
+    NLP_LAM_G = res.at("lam_g");
+
+    OptimalTrajectory = DM::reshape(NLP_X(Slice(0, NX * NUM_NODES)), NX, NUM_NODES);
+    Estimation = OptimalTrajectory(Slice(), 0);
+    Estimation(Slice(9, 13)) = Estimation(Slice(9, 13)) / DM::norm_2(Estimation(Slice(9, 13)));
+    if(NumParams > 0)
+        Params = NLP_X(Slice(NX * NUM_NODES, NLP_X.size1()));
+
+    Trajectory.clear();
+    for(int n = NUM_NODES - 1; n >= 0; --n)
+        Trajectory.push_back(Sample{_tstamp + NodeTimes[n], OptimalTrajectory(Slice(), n).nonzeros()});
+
+    /** next window starts later : older samples are not needed */
+    trim(Measurements, t_start);
+    trim(Controls, t_start);
+
+    tstamp = _tstamp;
+    _initialized = true;
+    return true;
+}
@@ -0,0 +1,105 @@
+#ifndef KITEMHE_H
+#define KITEMHE_H
+
+#include "kite.h"
+#include "nlp_backend.h"
+#include <deque>
+
+/** Moving horizon estimator on a sliding window of mocap poses.
+ *  The state trajectory over the window is transcribed with the Chebyshev collocation used by
+ *  the controller; measurements, controls and the arrival prior enter the NLP as parameters,
+ *  so the solver is created once and warm started from the shifted previous solution.
+ *  If the dynamics take a parameter vector, the model parameters are estimated as well.
+ */
+class KiteMHE
+{
+public:
+    /** _Dynamics : Function({x, u}) -> xdot or Function({x, u, p}) -> xdot for simultaneous
+     *  parameter estimation, e.g. KiteDynamics(props, algo, true).getNumericDynamics()
+     *  window : horizon length [s] */
+    KiteMHE(const casadi::Function &_Dynamics, const double &window = 0.5);
+    virtual ~KiteMHE(){}
+
+    enum {POLY_ORDER = 4, NUM_SEGMENTS = 2, NUM_NODES = POLY_ORDER * NUM_SEGMENTS + 1,
+          NX = 13, NU = 3, NY = 7, NP = 21};
+
+    static const casadi::DM DEFAULT_LBX;
+    static const casadi::DM DEFAULT_UBX;
+    static const casadi::DM DEFAULT_MEASUREMENT_WEIGHTS;
+    static const casadi::DM DEFAULT_ARRIVAL_WEIGHTS;
+
+    /** aerodynamic coefficients in the parameter order of KiteDynamics(props, algo, true) */
+    static casadi::DM nominal_parameters(const KiteProperties &props);
+
+    /** should be set before createNLP() */
+    void setMeasurementWeights(const casadi::DM &_Wy){Wy = _Wy;}
+    void setArrivalWeights(const casadi::DM &_Wx){Wx = _Wx;}
+    void setParameterWeights(const casadi::DM &_Wp){Wp = _Wp;}
+    void setNLPSettings(const kmath::NLPSettings &settings){NLPConfig = settings;}
+    kmath::NLPSettings getNLPSettings(){return NLPConfig;}
+    void createNLP();
+
+    void setLBX(const casadi::DM &_lbx){LBX = _lbx;}
+    void setUBX(const casadi::DM &_ubx){UBX = _ubx;}
+    /** parameter box, equal bounds keep a parameter fixed */
+    void setParameterBounds(const casadi::DM &_lbp, const casadi::DM &_ubp){LBP = _lbp; UBP = _ubp;}
+    /** nominal parameters : initial guess and prior of the first window */
+    void setParameters(const casadi::DM &_params){Params = _params;}
+    /** initial guess of the velocities for the first window */
+    void setEstimation(const casadi::DM &_estimation){Estimation = _estimation;}
+
+    /** time stamped pose [r, q] and control samples, may arrive out of order */
+    void addMeasurement(const casadi::DM &pose, const double &_tstamp);
+    void addControl(const casadi::DM &control, const double &_tstamp);
+
+    /** solve on the window [tstamp - window, tstamp]; returns false if the measurements
+     *  do not cover the window yet or the solution is not finite */
+    bool estimate(const double &_tstamp);
+
+    casadi::DM getEstimation(){return Estimation;}
+    casadi::DM getParameters(){return Params;}
+    /** [NX x NUM_NODES], first column is the latest state */
+    casadi::DM getOptimalTrajectory(){return OptimalTrajectory;}
+    casadi::Dict getStats(){return stats;}
+    double getTimeStamp(){return tstamp;}
+    double getWindow(){return Window;}
+    bool estimate_parameters(){return NumParams > 0;}
+    bool initialized(){return _initialized;}
+
+    /** time stamped sample, buffers are kept in increasing time order */
+    struct Sample
+    {
+        double t;
+        std::vector<double> value;
+    };
+
+private:
+    casadi::Function Dynamics;
+    double Window;
+    int NumParams;
+
+    casadi::DM LBX, UBX, LBP, UBP;
+    casadi::DM Wy, Wx, Wp;
+
+    casadi::Function NLP_Solver;
+    kmath::NLPSettings NLPConfig;
+    casadi::DMDict ARG;
+    casadi::Dict stats;
+    casadi::DM NLP_X, NLP_LAM_G, NLP_LAM_X;
+
+    casadi::DM Estimation;
+    casadi::DM Params;
+    casadi::DM OptimalTrajectory;
+    double tstamp;
+    bool _initialized;
+
+    /** relative time of the collocation nodes, node 0 is the end of the window */
+    std::vector<double> NodeTimes;
+
+    std::deque<Sample> Measurements;
+    std::deque<Sample> Controls;
+    /** previous solution in increasing time order : warm start and arrival prior */
+    std::deque<Sample> Trajectory;
+};
+
+#endif // KITEMHE_H
@@ -0,0 +1,204 @@
+#include "kiteUKF.h"
+#include "mekf_core.hpp"
+
+using namespace casadi;
+
+const DM KiteUKF::DEFAULT_PROCESS_COVARIANCE = pow(DM::diag(DMVector{0.5, 0.5, 0.5, 0.5, 0.5, 0.5,
+                                                                     0.5, 0.1, 0.1, 0.1, 0.1, 0.1}), 2);
+const DM KiteUKF::DEFAULT_MEASUREMENT_COVARIANCE = pow(DM::diag(DMVector{0.01, 0.01, 0.01, 0.01, 0.01, 0.01}), 2);
+
+using mekf::quaternion_t;
+using mekf::quat_boxplus;
+using mekf::quat_boxminus;
+
+namespace
+{
+    template<typename Matrix>
+    void dm2eigen(const DM &in, Matrix &out)
+    {
+        DM dense = DM::densify(in);
+        if((dense.size1() != out.rows()) || (dense.size2() != out.cols()))
+        {
+            std::cout << "KiteUKF: expected " << out.rows() << "x" << out.cols() << " matrix, provided "
+                      << dense.size1() << "x" << dense.size2() << "\n";
+            return;
+        }
+        out = Eigen::Map<const Matrix>(dense.nonzeros().data());
+    }
+
+    template<typename Matrix>
+    DM eigen2dm(const Matrix &in)
+    {
+        return DM::reshape(DM(std::vector<double>(in.data(), in.data() + in.size())), in.rows(), in.cols());
+    }
+}
+
+KiteUKF::KiteUKF(const Function &_Integrator, const std::string &parallelization)
+{
+    if(_Integrator.n_in() != 3)
+        std::cout << "WARNING: KiteUKF expects an integrator Function({x, u, dt}) \n";
+
+    /** batched propagation of all sigma points */
+    Function sigma_integrator = _Integrator.map(NS, parallelization);
+    m_SigmaIntegrator = kmath::FunctionEvaluator(sigma_integrator);
+    m_SigmaIntegrator.setInput(0, m_sigma.data());
+    m_SigmaIntegrator.setInput(1, m_sigma_u.data());
+    m_SigmaIntegrator.setInput(2, m_sigma_dt.data());
+    m_SigmaIntegrator.setOutput(0, m_sigma_next.data());
+
+    /** weights : alpha = 1, beta = 2, kappa = 0 */
+    const double alpha = 1.0, beta = 2.0, kappa = 0.0;
+    double lambda = alpha * alpha * (NE + kappa) - NE;
+    m_scale = std::sqrt(NE + lambda);
+    m_wm.setConstant(0.5 / (NE + lambda));
+    m_wc = m_wm;
+    m_wm(0) = lambda / (NE + lambda);
+    m_wc(0) = m_wm(0) + (1 - alpha * alpha + beta);
+
+    m_x.setZero();
+    m_x(9) = 1.0;
+    m_u.setZero();
+    dm2eigen(DEFAULT_PROCESS_COVARIANCE, m_W);
+    dm2eigen(DEFAULT_MEASUREMENT_COVARIANCE, m_V);
+    m_P = 10 * m_W;
+
+    /** initialize time */
+    std::chrono::time_point<std::chrono::system_clock> t_now = kite_utils::get_time();
+    auto duration = t_now.time_since_epoch();
+    auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    this->tstamp = static_cast<double>(microsec) * 1e-6;
+}
+
+void KiteUKF::setProcessCovariance(const DM &_W)
+{
+    dm2eigen(_W, m_W);
+}
+
+void KiteUKF::setMeasurementCovariance(const DM &_V)
+{
+    dm2eigen(_V, m_V);
+}
+
+void KiteUKF::setEstimationCovariance(const DM &_P)
+{
+    dm2eigen(_P, m_P);
+}
+
+void KiteUKF::setEstimation(const DM &_estimation)
+{
+    dm2eigen(_estimation, m_x);
+    m_x.tail<4>().normalize();
+}
+
+void KiteUKF::setControl(const DM &_control)
+{
+    if(_control.is_empty())
+        m_u.setZero();
+    else
+        dm2eigen(_control, m_u);
+}
+
+DM KiteUKF::getEstimation()
+{
+    return eigen2dm(m_x);
+}
+
+DM KiteUKF::getEstimationCovariance()
+{
+    return eigen2dm(m_P);
+}
+
+bool KiteUKF::propagate(const double &_dt)
+{
+    /** sigma points in the error space around the current estimate */
+    m_llt.compute(m_P);
+    if(m_llt.info() != Eigen::Success)
+    {
+        std::cout << "KiteUKF: estimation covariance is not positive definite, reset to the process covariance \n";
+        m_P = m_W;
+        return false;
+    }
+    const error_cov_t L = m_llt.matrixL();
+    const quaternion_t q = m_x.tail<4>();
+
+    m_sigma.col(0) = m_x;
+    for(int j = 0; j < NE; ++j)
+    {
+        Eigen::Matrix<double, NE, 1> delta = m_scale * L.col(j);
+        m_sigma.col(1 + j).head<9>()      = m_x.head<9>() + delta.head<9>();
+        m_sigma.col(1 + j).tail<4>()      = quat_boxplus(q, delta.tail<3>());
+        m_sigma.col(1 + NE + j).head<9>() = m_x.head<9>() - delta.head<9>();
+        m_sigma.col(1 + NE + j).tail<4>() = quat_boxplus(q, -delta.tail<3>());
+    }
+    m_sigma_u.colwise() = m_u;
+    m_sigma_dt.setConstant(_dt);
+
+    /** one batched model evaluation */
+    m_SigmaIntegrator.eval();
+
+    /** mean : weighted for the linear part, error-space average around the central point for attitude */
+    const quaternion_t q_ref = m_sigma_next.col(0).tail<4>().normalized();
+    Eigen::Vector3d mean_dtheta = Eigen::Vector3d::Zero();
+    m_x.head<9>().setZero();
+    for(int i = 0; i < NS; ++i)
+    {
+        m_x.head<9>() += m_wm(i) * m_sigma_next.col(i).head<9>();
+        mean_dtheta += m_wm(i) * quat_boxminus(m_sigma_next.col(i).tail<4>().normalized(), q_ref);
+    }
+    m_x.tail<4>() = quat_boxplus(q_ref, mean_dtheta);
+
+    /** covariance from the error-space deviations */
+    const quaternion_t q_mean = m_x.tail<4>();
+    for(int i = 0; i < NS; ++i)
+    {
+        m_deviation.col(i).head<9>() = m_sigma_next.col(i).head<9>() - m_x.head<9>();
+        m_deviation.col(i).tail<3>() = quat_boxminus(m_sigma_next.col(i).tail<4>().normalized(), q_mean);
+    }
+    m_P.noalias() = m_deviation * m_wc.asDiagonal() * m_deviation.transpose();
+    m_P += m_W;
+    m_P = 0.5 * (m_P + m_P.transpose()).eval();
+    return true;
+}
+
+bool KiteUKF::estimate(const DM &measurement, const double &_tstamp)
+{
+    if(measurement.nnz() != NY)
+    {
+        std::cout << "KiteUKF: measurement should be dense vector of size " << NY << "\n";
+        return false;
+    }
+    Eigen::Map<const Eigen::Matrix<double, NY, 1>> y(measurement.nonzeros().data());
+
+    if(!this->propagate(_tstamp - this->tstamp))
+        return false;
+    this->tstamp = _tstamp;
+
+    /** innovation in the error space : [dr, dtheta] */
+    Eigen::Matrix<double, NR, 1> innovation;
+    innovation.head<3>() = y.head<3>() - m_x.segment<3>(6);
+    innovation.tail<3>() = quat_boxminus(y.tail<4>().normalized(), m_x.tail<4>());
+
+    /** pose is linear in the error space : H = [0 I6] */
+    residual_cov_t S = m_P.bottomRightCorner<NR, NR>() + m_V;
+    m_innovation_llt.compute(S);
+    if(m_innovation_llt.info() != Eigen::Success)
+    {
+        std::cout << "KiteUKF: innovation covariance is not positive definite, update skipped \n";
+        return false;
+    }
+    Eigen::Matrix<double, NE, NR> PHt = m_P.rightCols<NR>();
+    Eigen::Matrix<double, NE, NR> K = m_innovation_llt.solve(PHt.transpose()).transpose();
+
+    /** error-state correction and attitude reset */
+    Eigen::Matrix<double, NE, 1> correction = K * innovation;
+    m_x.head<9>() += correction.head<9>();
+    m_x.tail<4>() = quat_boxplus(m_x.tail<4>(), correction.tail<3>());
+
+    /** Joseph form */
+    error_cov_t IKH = error_cov_t::Identity();
+    IKH.rightCols<NR>() -= K;
+    m_P = IKH * m_P * IKH.transpose() + K * m_V * K.transpose();
+    m_P = 0.5 * (m_P + m_P.transpose()).eval();
+
+    return true;
+}
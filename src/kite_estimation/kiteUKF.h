@@ -0,0 +1,78 @@
+#ifndef KITEUKF_H
+#define KITEUKF_H
+
+#include "kite.h"
+#include "function_evaluator.h"
+#include "eigen3/Eigen/Dense"
+
+/** Error-state unscented Kalman filter for the kite / rigid body state [v, w, r, q].
+ *  Sigma points live in the 12-dimensional error space [dv, dw, dr, dtheta] and are mapped
+ *  to the state with q = q_mean * exp(dtheta / 2). All 2n+1 sigma points are propagated by
+ *  a single call to the mapped integrator ("serial", "openmp" or "thread" evaluation).
+ *  Measurements are mocap poses [r, q]; the pose model is linear in the error space
+ *  so the update is done in closed form.
+ */
+class KiteUKF
+{
+public:
+    /** _Integrator : RK4 Function({x, u, dt}) -> x_next (e.g. getNumericIntegrator() or getNumericTransition()) */
+    KiteUKF(const casadi::Function &_Integrator, const std::string &parallelization = "serial");
+    virtual ~KiteUKF(){}
+
+    enum {NX = 13, NU = 3, NE = 12, NY = 7, NR = 6, NS = 2 * NE + 1};
+
+    typedef Eigen::Matrix<double, NX, 1>  state_t;
+    typedef Eigen::Matrix<double, NU, 1>  control_t;
+    typedef Eigen::Matrix<double, NE, NE> error_cov_t;
+    typedef Eigen::Matrix<double, NR, NR> residual_cov_t;
+    typedef Eigen::Matrix<double, NX, NS> sigma_t;
+
+    static const casadi::DM DEFAULT_PROCESS_COVARIANCE;
+    static const casadi::DM DEFAULT_MEASUREMENT_COVARIANCE;
+
+    /** covariances are defined in the error space : process 12x12, measurement 6x6 [dr, dtheta] */
+    void setProcessCovariance(const casadi::DM &_W);
+    void setMeasurementCovariance(const casadi::DM &_V);
+    void setEstimationCovariance(const casadi::DM &_P);
+    void setEstimation(const casadi::DM &_estimation);
+    void setControl(const casadi::DM &_control);
+    void setTime(const double &_current_time){this->tstamp = _current_time;}
+
+    casadi::DM getEstimation();
+    casadi::DM getEstimationCovariance();
+    double getTimeStamp(){return this->tstamp;}
+
+    /** returns false if the update is skipped : estimation or innovation covariance not positive definite */
+    bool estimate(const casadi::DM &measurement, const double &_tstamp);
+    /** returns false and resets the covariance to the process covariance if it is not positive definite,
+     *  the estimate is not propagated */
+    bool propagate(const double &_dt);
+
+private:
+    /** sigma points propagated in one call */
+    kmath::FunctionEvaluator m_SigmaIntegrator;
+
+    state_t m_x;
+    control_t m_u;
+    error_cov_t m_P, m_W;
+    residual_cov_t m_V;
+    double tstamp;
+
+    /** unscented transform weights */
+    double m_scale;
+    Eigen::Matrix<double, NS, 1> m_wm, m_wc;
+
+    /** workspace : the evaluator reads and writes these buffers in place */
+    sigma_t m_sigma, m_sigma_next;
+    Eigen::Matrix<double, NU, NS> m_sigma_u;
+    Eigen::Matrix<double, 1, NS> m_sigma_dt;
+    Eigen::Matrix<double, NE, NS> m_deviation;
+    Eigen::LLT<error_cov_t> m_llt;
+    Eigen::LLT<residual_cov_t> m_innovation_llt;
+
+    /** buffers are bound by address : no copies */
+    KiteUKF(const KiteUKF&) = delete;
+    KiteUKF& operator=(const KiteUKF&) = delete;
+};
+
+#endif // KITEUKF_H
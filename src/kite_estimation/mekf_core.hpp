@@ -0,0 +1,195 @@
+#ifndef MEKF_CORE_HPP
+#define MEKF_CORE_HPP
+
+#include "ekf_core.hpp"
+#include "quaternion.hpp"
+
+/** unit quaternion helpers, scalar first, Hamilton product */
+namespace mekf
+{
+    typedef Eigen::Vector4d quaternion_t;
+
+    using kmath::quat_multiply;
+
+    inline quaternion_t quat_conjugate(const quaternion_t &q)
+    {
+        return kmath::quat_inverse(q);
+    }
+
+    /** q * exp(dtheta / 2) : body frame attitude error */
+    inline quaternion_t quat_boxplus(const quaternion_t &q, const Eigen::Vector3d &dtheta)
+    {
+        double angle = dtheta.norm();
+        quaternion_t dq(1, 0, 0, 0);
+        if(angle > 1e-12)
+        {
+            dq(0) = std::cos(0.5 * angle);
+            dq.tail<3>() = std::sin(0.5 * angle) * dtheta / angle;
+        }
+        quaternion_t result = quat_multiply(q, dq);
+        return result / result.norm();
+    }
+
+    /** rotation vector of q_ref^-1 * q, shortest path */
+    inline Eigen::Vector3d quat_boxminus(const quaternion_t &q, const quaternion_t &q_ref)
+    {
+        quaternion_t dq = quat_multiply(quat_conjugate(q_ref), q);
+        if(dq(0) < 0)
+            dq = -dq;
+        double sin_half = dq.tail<3>().norm();
+        if(sin_half < 1e-12)
+            return 2.0 * dq.tail<3>();
+        return 2.0 * std::atan2(sin_half, dq(0)) * dq.tail<3>() / sin_half;
+    }
+
+    /** Xi(q) : d(q * [1, v]) / dv, the columns span the tangent space at q and Xi' * Xi = I */
+    inline Eigen::Matrix<double, 4, 3> quat_xi(const quaternion_t &q)
+    {
+        Eigen::Matrix<double, 4, 3> xi;
+        xi.row(0) = -q.tail<3>().transpose();
+        xi.bottomRows<3>() << q(0), -q(3),  q(2),
+                              q(3),  q(0), -q(1),
+                             -q(2),  q(1),  q(0);
+        return xi;
+    }
+}
+
+/** Multiplicative (error-state) EKF for a state [x_lin, r, q] ending with a position and a unit quaternion.
+ *  The covariance is kept over the error [dx_lin, dr, dtheta] of dimension NX - 1; the attitude is
+ *  corrected by q * exp(dtheta / 2) and the error is reset after every update, so the quaternion
+ *  norm does not rely on the dynamics. The model is evaluated by an EKFCore on the full state,
+ *  its transition matrix is projected on the error space. Measurements are poses [r, q].
+ */
+template<int NX, int NU>
+class MEKFCore
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    enum {NE = NX - 1, NL = NX - 4, NY = 7, NR = 6};
+
+    typedef EKFCore<NX, NU, NY> model_t;
+    typedef typename model_t::state_t       state_t;
+    typedef typename model_t::control_t     control_t;
+    typedef typename model_t::measurement_t measurement_t;
+    typedef Eigen::Matrix<double, NE, NE>   error_cov_t;
+    typedef Eigen::Matrix<double, NR, NR>   residual_cov_t;
+
+    MEKFCore();
+    virtual ~MEKFCore(){}
+
+    void setModel(const casadi::Function &integrator, const casadi::Function &jacobian){m_model.setModel(integrator, jacobian);}
+    void setModel(const casadi::Function &transition){m_model.setModel(transition);}
+
+    void propagate(const double &dt);
+    /** returns false and leaves the estimate untouched if the innovation covariance is not positive definite */
+    bool update(const measurement_t &measurement);
+    void predict(const double &dt, state_t &prediction){m_model.predict(dt, prediction);}
+
+    state_t& x(){return m_model.x;}
+    control_t& u(){return m_model.u;}
+
+    error_cov_t P;
+    error_cov_t W;
+    residual_cov_t V;
+
+private:
+    model_t m_model;
+
+    /** workspace */
+    mekf::quaternion_t m_q;
+    Eigen::Matrix<double, NX, NE> m_G, m_AG;
+    Eigen::Matrix<double, NE, NX> m_Ginv;
+    error_cov_t m_Phi, m_PhiP, m_IKH;
+    Eigen::Matrix<double, NE, NR> m_PHt, m_K;
+    Eigen::Matrix<double, NE, 1>  m_dx;
+    Eigen::Matrix<double, NR, 1>  m_innovation;
+    residual_cov_t m_S;
+    Eigen::LLT<residual_cov_t> m_llt;
+
+    void symmetrize();
+};
+
+template<int NX, int NU>
+MEKFCore<NX, NU>::MEKFCore()
+{
+    P.setIdentity();
+    W.setIdentity();
+    V.setIdentity();
+    m_model.x(NL) = 1.0;
+
+    m_G.setZero();
+    m_G.template topLeftCorner<NL, NL>().setIdentity();
+    m_Ginv.setZero();
+    m_Ginv.template topLeftCorner<NL, NL>().setIdentity();
+}
+
+template<int NX, int NU>
+void MEKFCore<NX, NU>::symmetrize()
+{
+    for(int i = 0; i < NE; ++i)
+        for(int j = i + 1; j < NE; ++j)
+            P(i, j) = P(j, i) = 0.5 * (P(i, j) + P(j, i));
+}
+
+template<int NX, int NU>
+void MEKFCore<NX, NU>::propagate(const double &dt)
+{
+    m_q = m_model.x.template tail<4>();
+    m_model.propagateState(dt);
+    m_model.x.template tail<4>().normalize();
+
+    /** error transition : Phi_e = G(q_next)^+ * A * G(q), G = blkdiag(I, Xi(q) / 2) */
+    m_G.template bottomRightCorner<4, 3>() = 0.5 * mekf::quat_xi(m_q);
+    m_Ginv.template bottomRightCorner<3, 4>() = 2.0 * mekf::quat_xi(m_model.x.template tail<4>()).transpose();
+    m_AG.noalias() = m_model.transitionMatrix() * m_G;
+    m_Phi.noalias() = m_Ginv * m_AG;
+
+    /** P = Phi * P * Phi' + W */
+    m_PhiP.noalias() = m_Phi * P;
+    P.noalias() = m_PhiP * m_Phi.transpose();
+    P += W;
+    symmetrize();
+}
+
+template<int NX, int NU>
+bool MEKFCore<NX, NU>::update(const measurement_t &measurement)
+{
+    /** innovation in the error space : the pose is linear in [dr, dtheta], H = [0 I] */
+    m_q = m_model.x.template tail<4>();
+    m_innovation.template head<3>() = measurement.template head<3>() - m_model.x.template segment<3>(NL - 3);
+    m_innovation.template tail<3>() = mekf::quat_boxminus(measurement.template tail<4>().normalized(), m_q);
+
+    m_S = P.template bottomRightCorner<NR, NR>() + V;
+    m_PHt = P.template rightCols<NR>();
+    m_llt.compute(m_S);
+    if(m_llt.info() != Eigen::Success)
+        return false;
+    m_K.transpose() = m_llt.solve(m_PHt.transpose());
+
+    /** correction */
+    m_dx.noalias() = m_K * m_innovation;
+    m_model.x.template head<NL>() += m_dx.template head<NL>();
+    m_model.x.template tail<4>() = mekf::quat_boxplus(m_q, m_dx.template tail<3>());
+
+    /** Joseph form : P = (I - K * H) * P * (I - K * H)' + K * V * K' */
+    m_IKH.setIdentity();
+    m_IKH.template rightCols<NR>() -= m_K;
+    m_PhiP.noalias() = m_IKH * P;
+    P.noalias() = m_PhiP * m_IKH.transpose();
+    m_PHt.noalias() = m_K * V;
+    P.noalias() += m_PHt * m_K.transpose();
+
+    /** reset : the error is now expressed around the corrected attitude, G = blkdiag(I, I - [dtheta / 2]x) */
+    Eigen::Vector3d half = 0.5 * m_dx.template tail<3>();
+    m_IKH.setIdentity();
+    m_IKH.template bottomRightCorner<3, 3>() << 1,        half(2), -half(1),
+                                               -half(2), 1,        half(0),
+                                                half(1), -half(0), 1;
+    m_PhiP.noalias() = m_IKH * P;
+    P.noalias() = m_PhiP * m_IKH.transpose();
+    symmetrize();
+    return true;
+}
+
+#endif // MEKF_CORE_HPP
@@ -0,0 +1,155 @@
+#include "mhe_node.h"
+
+using namespace casadi;
+
+void KiteMHE_Node::poseCallback(const geometry_msgs::PoseStamped::ConstPtr &msg)
+{
+    mocap::Pose opt_pose;
+    opt_pose << msg->pose.position.x, msg->pose.position.y, msg->pose.position.z,
+                msg->pose.orientation.w, msg->pose.orientation.x, msg->pose.orientation.y, msg->pose.orientation.z;
+    mocap::Pose pose = mocap::optitrack2world(opt_pose, frame);
+    double tstamp = msg->header.stamp.toSec();
+
+    DM measurement = DM::zeros(KiteMHE::NY);
+    mocap::Pose::Map(measurement.ptr()) = pose;
+    estimator->addMeasurement(measurement, tstamp);
+    last_stamp = std::max(last_stamp, tstamp);
+
+    /** initial velocities from 2 pose measurements at least 10 ms apart */
+    if(!m_initialized)
+    {
+        if(first_stamp < 0)
+        {
+            first_pose = pose;
+            first_stamp = tstamp;
+        }
+        else if(tstamp - first_stamp >= 0.01)
+        {
+            DM init = DM::zeros(KiteMHE::NX);
+            mocap::State::Map(init.ptr()) = mocap::initial_state(first_pose, pose, tstamp - first_stamp);
+            estimator->setEstimation(init);
+            m_initialized = true;
+        }
+    }
+}
+
+void KiteMHE_Node::controlCallback(const openkite::aircraft_controls::ConstPtr &msg)
+{
+    double tstamp = msg->header.stamp.isZero() ? ros::Time::now().toSec() : msg->header.stamp.toSec();
+    estimator->addControl(DM::vertcat({msg->thrust, msg->elevator, msg->rudder}), tstamp);
+}
+
+void KiteMHE_Node::estimateCallback(const ros::TimerEvent &event)
+{
+    /** one window per new pose at most */
+    if(!m_initialized || (last_stamp <= last_solved))
+        return;
+
+    /** false until the poses cover the window */
+    if(!estimator->estimate(last_stamp))
+        return;
+    last_solved = last_stamp;
+
+    if(!kmath::nlp_converged(estimator->getStats()))
+        ROS_WARN_THROTTLE(1.0, "mhe_node: iteration limit reached, publishing the last iterate");
+    publish();
+}
+
+KiteMHE_Node::KiteMHE_Node(const ros::NodeHandle &_nh, const KiteProperties &kite_props, const AlgorithmProperties &algo_props)
+{
+    nh = std::make_shared<ros::NodeHandle>(_nh);
+
+    /** simultaneous estimation of the aerodynamic coefficients, within a box relative to the nominal values */
+    bool estimate_parameters;
+    double window, parameter_box;
+    nh->param<bool>("estimate_parameters", estimate_parameters, false);
+    nh->param<double>("window", window, 0.5);
+    nh->param<double>("parameter_box", parameter_box, 0.2);
+
+    /** the identification model takes the coefficients as a parameter vector */
+    std::shared_ptr<KiteDynamics> kite = estimate_parameters ? std::make_shared<KiteDynamics>(kite_props, algo_props, true)
+                                                             : std::make_shared<KiteDynamics>(kite_props, algo_props);
+    estimator = std::make_shared<KiteMHE>(kite->getNumericDynamics(), window);
+    if(estimator->estimate_parameters())
+    {
+        DM params = KiteMHE::nominal_parameters(kite_props);
+        estimator->setParameters(params);
+        estimator->setParameterBounds(params - parameter_box * DM::fabs(params), params + parameter_box * DM::fabs(params));
+    }
+
+    /** real-time iteration budget, warm start from the shifted window */
+    std::string nlp_backend;
+    int max_iter;
+    nh->param<std::string>("nlp_backend", nlp_backend, "ipopt:ma97");
+    nh->param<int>("max_iter", max_iter, estimator->getNLPSettings().max_iter);
+    kmath::NLPSettings settings = kmath::nlp_settings_from_string(nlp_backend, estimator->getNLPSettings());
+    settings.max_iter = max_iter;
+    estimator->setNLPSettings(settings);
+    estimator->createNLP();
+
+    /** initialize subscribers and publishers */
+    state_pub  = nh->advertise<sensor_msgs::MultiDOFJointState>("/kite_state_mhe", 100);
+    params_pub = nh->advertise<std_msgs::Float64MultiArray>("/kite_params_mhe", 100);
+
+    /** @todo : parametrize topics */
+    pose_sub = nh->subscribe("/optitrack_client/Kite/pose", 1000, &KiteMHE_Node::poseCallback, this,
+                             ros::TransportHints().tcpNoDelay());
+    control_sub = nh->subscribe("/kite_controls", 1000, &KiteMHE_Node::controlCallback, this);
+
+    double mhe_rate;
+    nh->param<double>("mhe_rate", mhe_rate, 20.0);
+    estimate_timer = nh->createTimer(ros::Duration(1.0 / std::max(mhe_rate, 1.0)), &KiteMHE_Node::estimateCallback, this);
+
+    first_stamp = -1;
+    last_stamp  = -1;
+    last_solved = -1;
+    m_initialized = false;
+}
+
+void KiteMHE_Node::publish()
+{
+    ros::Time stamp(estimator->getTimeStamp());
+    state_pub.publish(toMessage(estimator->getEstimation(), stamp));
+
+    if(estimator->estimate_parameters())
+    {
+        std_msgs::Float64MultiArray params_msg;
+        params_msg.data = estimator->getParameters().nonzeros();
+        params_pub.publish(params_msg);
+    }
+}
+
+sensor_msgs::MultiDOFJointState KiteMHE_Node::toMessage(const DM &estimation, const ros::Time &stamp)
+{
+    /** same packing as ekf_node : consumers of /kite_state can take this estimate */
+    mocap::State corrected_estim = mocap::State::Map(estimation.ptr()) - mocap::state_correction();
+
+    sensor_msgs::MultiDOFJointState state_msg;
+    state_msg.joint_names.resize(1);
+    state_msg.header.frame_id = "kite";
+    state_msg.joint_names[0] = "lox";
+    state_msg.header.stamp = stamp;
+    mocap::state_to_message(corrected_estim, state_msg);
+
+    return state_msg;
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "mhe_node");
+    ros::NodeHandle n("~");
+
+    std::string kite_params_file;
+    n.param<std::string>("kite_params", kite_params_file, "./umx_radian.yaml");
+    KiteProperties kite_props = kite_utils::LoadProperties(kite_params_file);
+    AlgorithmProperties algo_props;
+    algo_props.Integrator = RK4;
+    algo_props.sampling_time = 0.02;
+
+    KiteMHE_Node estimator(n, kite_props, algo_props);
+
+    /** callbacks and window solves share the spinner thread */
+    ros::spin();
+
+    return 0;
+}
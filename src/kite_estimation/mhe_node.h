@@ -0,0 +1,55 @@
+#ifndef MHE_NODE_H
+#define MHE_NODE_H
+
+#include "ros/ros.h"
+#include "geometry_msgs/PoseStamped.h"
+#include "sensor_msgs/MultiDOFJointState.h"
+#include "std_msgs/Float64MultiArray.h"
+#include "openkite/aircraft_controls.h"
+
+#include "kiteMHE.h"
+#include "mocap_frame.hpp"
+
+/** Moving horizon estimation next to ekf_node : same pose input, the commanded controls of nmpf_node.
+ *  The window is solved at "mhe_rate" with the bounded iteration count of KiteMHE, warm started from the
+ *  shifted previous solution. The state estimate is published on /kite_state_mhe, the model parameters
+ *  ("estimate_parameters") on /kite_params_mhe.
+ */
+class KiteMHE_Node
+{
+public:
+    KiteMHE_Node(const ros::NodeHandle &_nh, const KiteProperties &kite_props, const AlgorithmProperties &algo_props);
+    virtual ~KiteMHE_Node(){}
+
+    void poseCallback(const geometry_msgs::PoseStamped::ConstPtr &msg);
+    void controlCallback(const openkite::aircraft_controls::ConstPtr &msg);
+    void estimateCallback(const ros::TimerEvent &event);
+
+    void publish();
+    sensor_msgs::MultiDOFJointState toMessage(const casadi::DM &estimation, const ros::Time &stamp);
+
+    bool initialized(){return m_initialized;}
+
+private:
+    ros::Publisher state_pub;
+    ros::Publisher params_pub;
+    ros::Subscriber pose_sub;
+    ros::Subscriber control_sub;
+    ros::Timer estimate_timer;
+
+    /** handle instance to access node params */
+    std::shared_ptr<ros::NodeHandle> nh;
+    /** MHE instance */
+    std::shared_ptr<KiteMHE> estimator;
+    mocap::MocapFrame frame;
+
+    /** first pose : initial velocities from two poses as in ekf_node */
+    mocap::Pose first_pose;
+    double first_stamp;
+    /** stamp of the latest pose, the window ends there */
+    double last_stamp;
+    double last_solved;
+    bool m_initialized;
+};
+
+#endif // MHE_NODE_H
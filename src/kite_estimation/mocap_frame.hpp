@@ -0,0 +1,108 @@
+#ifndef MOCAP_FRAME_HPP
+#define MOCAP_FRAME_HPP
+
+#include "quaternion.hpp"
+
+/** Motion capture to estimator frame conversions shared by ekf_node and the offline tools (kite_replay),
+ *  plain double arithmetic on Eigen types : evaluated for every mocap sample
+ */
+namespace mocap
+{
+    typedef Eigen::Matrix<double, 7, 1>  Pose;   /** [x, y, z, qw, qx, qy, qz] */
+    typedef Eigen::Matrix<double, 13, 1> State;  /** [v, w, r, q] */
+
+    struct MocapFrame
+    {
+        /** marker body frame offset and rotation with respect to the kite body frame */
+        Eigen::Vector3d brf_offset;
+        Eigen::Vector4d brf_rotation;
+        /** @todo : remove this hack */
+        double height;
+
+        MocapFrame() : brf_offset(-0.09, 0, -0.02), brf_rotation(0.0, -1.0, 0.0, 0.0), height(2.77) {}
+    };
+
+    /** transform an optitrack pose to world ref frame */
+    inline Pose optitrack2world(const Pose &opt_pose, const MocapFrame &frame = MocapFrame())
+    {
+        const Eigen::Vector3d position = opt_pose.head<3>();
+        const Eigen::Vector4d attitude = opt_pose.tail<4>();
+
+        Pose world_pose;
+        world_pose.head<3>() = kmath::quat_transform(frame.brf_rotation, position + kmath::quat_transform(attitude, frame.brf_offset));
+        world_pose.tail<4>() = kmath::quat_multiply(kmath::quat_multiply(frame.brf_rotation, attitude),
+                                                    kmath::quat_inverse(frame.brf_rotation));
+        world_pose(2) += frame.height;
+        return world_pose;
+    }
+
+    /** initial kite state from two world poses dt seconds apart : finite difference velocities in body frame */
+    inline State initial_state(const Pose &prev, const Pose &next, const double &dt)
+    {
+        const Eigen::Vector4d att_inv = kmath::quat_inverse(Eigen::Vector4d(prev.tail<4>()));
+        const Eigen::Vector3d rdot = (next.head<3>() - prev.head<3>()) / dt;
+        const Eigen::Vector4d dq = kmath::quat_multiply(att_inv, Eigen::Vector4d(next.tail<4>()));
+
+        State state;
+        state.segment<3>(0) = kmath::quat_transform(att_inv, rdot);
+        state.segment<3>(3) = (2.0 / dt) * dq.tail<3>();
+        state.tail<7>() = next;
+        return state;
+    }
+
+    /** constant offset removed from the estimation before it is published as /kite_state */
+    inline State state_correction()
+    {
+        State correction = State::Zero();
+        correction.segment<3>(6) << -0.09 - 0.02, -0.1247 + 0.01, -0.0418 - 0.0418;
+        return correction;
+    }
+
+    /** kite state to a sensor_msgs::MultiDOFJointState (single joint); templated on the message type so that
+     *  the packing is shared by the nodes and tested without ROS */
+    template<typename Message>
+    void state_to_message(const State &state, Message &msg)
+    {
+        msg.twist.resize(1);
+        msg.transforms.resize(1);
+
+        msg.twist[0].linear.x  = state(0);
+        msg.twist[0].linear.y  = state(1);
+        msg.twist[0].linear.z  = state(2);
+        msg.twist[0].angular.x = state(3);
+        msg.twist[0].angular.y = state(4);
+        msg.twist[0].angular.z = state(5);
+
+        msg.transforms[0].translation.x = state(6);
+        msg.transforms[0].translation.y = state(7);
+        msg.transforms[0].translation.z = state(8);
+        msg.transforms[0].rotation.w    = state(9);
+        msg.transforms[0].rotation.x    = state(10);
+        msg.transforms[0].rotation.y    = state(11);
+        msg.transforms[0].rotation.z    = state(12);
+    }
+
+    /** kite state from the last joint of a sensor_msgs::MultiDOFJointState */
+    template<typename Message>
+    State message_to_state(const Message &msg)
+    {
+        State state;
+        state(0)  = msg.twist.back().linear.x;
+        state(1)  = msg.twist.back().linear.y;
+        state(2)  = msg.twist.back().linear.z;
+        state(3)  = msg.twist.back().angular.x;
+        state(4)  = msg.twist.back().angular.y;
+        state(5)  = msg.twist.back().angular.z;
+
+        state(6)  = msg.transforms.back().translation.x;
+        state(7)  = msg.transforms.back().translation.y;
+        state(8)  = msg.transforms.back().translation.z;
+        state(9)  = msg.transforms.back().rotation.w;
+        state(10) = msg.transforms.back().rotation.x;
+        state(11) = msg.transforms.back().rotation.y;
+        state(12) = msg.transforms.back().rotation.z;
+        return state;
+    }
+}
+
+#endif // MOCAP_FRAME_HPP
@@ -0,0 +1,94 @@
+#include "function_evaluator.h"
+#include <algorithm>
+
+using namespace casadi;
+
+namespace kmath
+{
+    FunctionEvaluator::FunctionEvaluator(const Function &func) : m_mem(-1)
+    {
+        init(func);
+    }
+
+    FunctionEvaluator::FunctionEvaluator(const FunctionEvaluator &other) : m_mem(-1)
+    {
+        if(other.initialized())
+            init(other.m_func);
+    }
+
+    FunctionEvaluator& FunctionEvaluator::operator=(const FunctionEvaluator &other)
+    {
+        if(this != &other)
+        {
+            release();
+            if(other.initialized())
+                init(other.m_func);
+        }
+        return *this;
+    }
+
+    FunctionEvaluator::~FunctionEvaluator()
+    {
+        release();
+    }
+
+    void FunctionEvaluator::init(const Function &func)
+    {
+        m_func = func;
+        m_mem  = m_func.checkout();
+
+        m_arg.assign(m_func.sz_arg(), nullptr);
+        m_res.assign(m_func.sz_res(), nullptr);
+        m_iw.resize(m_func.sz_iw());
+        m_w.resize(m_func.sz_w());
+
+        m_dense.assign(m_func.n_out(), nullptr);
+        m_nonzeros.resize(m_func.n_out());
+        for(int i = 0; i < m_func.n_out(); ++i)
+        {
+            if(!m_func.sparsity_out(i).is_dense())
+                m_nonzeros[i].resize(m_func.nnz_out(i));
+        }
+    }
+
+    void FunctionEvaluator::release()
+    {
+        if(m_mem >= 0)
+            m_func.release(m_mem);
+        m_mem = -1;
+    }
+
+    void FunctionEvaluator::setOutput(const int &idx, double *data)
+    {
+        if(m_nonzeros[idx].empty())
+        {
+            m_res[idx] = data;
+        }
+        else
+        {
+            m_dense[idx] = data;
+            m_res[idx] = m_nonzeros[idx].data();
+        }
+    }
+
+    void FunctionEvaluator::eval()
+    {
+        m_func(m_arg.data(), m_res.data(), m_iw.data(), m_w.data(), m_mem);
+
+        /** scatter sparse outputs */
+        for(size_t i = 0; i < m_dense.size(); ++i)
+        {
+            if(m_dense[i] == nullptr)
+                continue;
+
+            const Sparsity &sp = m_func.sparsity_out(i);
+            const int *colind = sp.colind();
+            const int *row    = sp.row();
+            const int nrow    = sp.size1();
+            std::fill(m_dense[i], m_dense[i] + sp.numel(), 0.0);
+            for(int c = 0; c < sp.size2(); ++c)
+                for(int k = colind[c]; k < colind[c + 1]; ++k)
+                    m_dense[i][c * nrow + row[k]] = m_nonzeros[i][k];
+        }
+    }
+}
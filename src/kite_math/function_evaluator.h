@@ -0,0 +1,47 @@
+#ifndef FUNCTION_EVALUATOR_H
+#define FUNCTION_EVALUATOR_H
+
+#include "casadi/casadi.hpp"
+
+namespace kmath
+{
+    /** Allocation-free numerical evaluation of a casadi::Function through the raw buffer interface.
+     *  Work vectors are allocated once; inputs are read in place, outputs are written as dense
+     *  column-major matrices (sparse outputs are scattered). Inputs are assumed to be dense. */
+    class FunctionEvaluator
+    {
+    public:
+        FunctionEvaluator() : m_mem(-1) {}
+        explicit FunctionEvaluator(const casadi::Function &func);
+        FunctionEvaluator(const FunctionEvaluator &other);
+        FunctionEvaluator& operator=(const FunctionEvaluator &other);
+        virtual ~FunctionEvaluator();
+
+        /** nullptr input is interpreted as zeros */
+        void setInput(const int &idx, const double *data){m_arg[idx] = data;}
+        void setOutput(const int &idx, double *data);
+
+        void eval();
+
+        const casadi::Function& function() const {return m_func;}
+        bool initialized() const {return m_mem >= 0;}
+
+    private:
+        casadi::Function m_func;
+        int m_mem;
+
+        std::vector<const double*> m_arg;
+        std::vector<double*> m_res;
+        std::vector<int> m_iw;
+        std::vector<double> m_w;
+
+        /** nonzero buffers for the sparse outputs */
+        std::vector<double*> m_dense;
+        std::vector<std::vector<double>> m_nonzeros;
+
+        void init(const casadi::Function &func);
+        void release();
+    };
+}
+
+#endif // FUNCTION_EVALUATOR_H
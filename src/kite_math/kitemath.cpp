@@ -62,6 +62,19 @@ namespace kmath
         return x + (h/6) * (k1 + 2*k2 + 2*k3 + k4);
     }
 
+    Function rk4_transition(Function &dynamics, const std::string &name)
+    {
+        SX x  = SX::sym("x", dynamics.size1_in(0));
+        SX u  = SX::sym("u", dynamics.size1_in(1));
+        SX dt = SX::sym("dt");
+
+        SX x_next = rk4_symbolic(x, u, dynamics, dt);
+        /** propagate unit seeds through the step in forward mode */
+        SX Phi = SX::jtimes(x_next, x, SX::eye(x.size1()));
+
+        return Function(name, {x, u, dt}, {x_next, Phi});
+    }
+
     void cheb(DM &CollocPoints, DM &DiffMatrix, const unsigned &N,
               const std::pair<double, double> interval = std::make_pair(0,1))
     {
@@ -7,6 +7,7 @@
 #include "eigen3/unsupported/Eigen/Polynomials"
 #include "eigen3/unsupported/Eigen/MatrixFunctions"
 #include <type_traits>
+#include "quaternion.hpp"
 
 /** Windows hack (MSVC) */
 #ifndef M_PI
@@ -36,6 +37,12 @@ namespace kmath
                             casadi::Function &func,
                             const casadi::SX &h);
 
+    /** @brief: RK4 step with exact discrete transition matrix (forward sensitivities through the step)
+     * dynamics: Function({x, u}) -> dx/dt
+     * returns: Function({x, u, dt}) -> {x_next, Phi = d(x_next)/dx}
+     * */
+    casadi::Function rk4_transition(casadi::Function &dynamics, const std::string &name = "RK4_TRANSITION");
+
     /** @brief: compute Chebyshev collocation points for a given interval */
     void cheb(casadi::DM &CollocPoints, casadi::DM &DiffMatrix,
               const unsigned &N, const std::pair<double, double> interval);
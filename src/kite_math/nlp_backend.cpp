@@ -0,0 +1,187 @@
+#include "nlp_backend.h"
+#include <algorithm>
+#include <limits>
+
+using namespace casadi;
+
+namespace kmath
+{
+    NLPSettings nlp_settings_from_string(const std::string &spec, const NLPSettings &defaults)
+    {
+        NLPSettings settings = defaults;
+        size_t pos = spec.find(':');
+        settings.solver = spec.substr(0, pos);
+        if(pos != std::string::npos)
+        {
+            std::string sub_solver = spec.substr(pos + 1);
+            if(settings.solver == "ipopt")
+                settings.linear_solver = sub_solver;
+            else
+                settings.qp_solver = sub_solver;
+        }
+        return settings;
+    }
+
+    std::string nlp_settings_to_string(const NLPSettings &settings)
+    {
+        if(settings.solver == "ipopt")
+            return settings.solver + ":" + settings.linear_solver;
+        if(settings.solver == "sqpmethod")
+            return settings.solver + ":" + settings.qp_solver;
+        return settings.solver;
+    }
+
+    Dict nlp_solver_options(const NLPSettings &settings)
+    {
+        if(!has_nlpsol(settings.solver))
+            throw std::runtime_error("nlp_solver: NLP plugin is not available: " + settings.solver);
+
+        Dict opts;
+        if(settings.solver == "ipopt")
+        {
+            opts["ipopt.linear_solver"]         = settings.linear_solver;
+            opts["ipopt.print_level"]           = settings.print_level;
+            opts["ipopt.tol"]                   = settings.tol;
+            opts["ipopt.acceptable_tol"]        = settings.tol;
+            opts["ipopt.max_iter"]              = settings.max_iter;
+            opts["ipopt.warm_start_init_point"] = settings.warm_start ? "yes" : "no";
+            if(settings.limited_memory)
+                opts["ipopt.hessian_approximation"] = "limited-memory";
+            if(settings.print_level == 0)
+                opts["print_time"] = false;
+        }
+        else if(settings.solver == "sqpmethod")
+        {
+            if(!has_conic(settings.qp_solver))
+                throw std::runtime_error("nlp_solver: QP plugin is not available: " + settings.qp_solver);
+
+            opts["qpsol"]    = settings.qp_solver;
+            opts["max_iter"] = settings.max_iter;
+            opts["tol_pr"]   = settings.tol;
+            opts["tol_du"]   = settings.tol;
+            if(settings.limited_memory)
+                opts["hessian_approximation"] = "limited-memory";
+
+            Dict qp_opts;
+            qp_opts["error_on_fail"] = false;
+            if(settings.qp_solver == "qpoases")
+            {
+                qp_opts["printLevel"] = "none";
+                qp_opts["sparse"]     = true;
+            }
+            else if(settings.qp_solver == "osqp")
+            {
+                qp_opts["warm_start_primal"] = settings.warm_start;
+                qp_opts["osqp"] = Dict{{"verbose", settings.print_level > 0}};
+            }
+            opts["qpsol_options"] = qp_opts;
+
+            if(settings.print_level == 0)
+            {
+                opts["print_header"]    = false;
+                opts["print_iteration"] = false;
+                opts["print_time"]      = false;
+            }
+        }
+
+        for(const auto &option : settings.options)
+            opts[option.first] = option.second;
+
+        return opts;
+    }
+
+    Function nlp_solver(const std::string &name, const SXDict &nlp, const NLPSettings &settings)
+    {
+        return nlpsol(name, settings.solver, nlp, nlp_solver_options(settings));
+    }
+
+    Function nlp_solver(const std::string &name, const MXDict &nlp, const NLPSettings &settings)
+    {
+        return nlpsol(name, settings.solver, nlp, nlp_solver_options(settings));
+    }
+
+    bool nlp_thread_safe(const NLPSettings &settings)
+    {
+        return !((settings.solver == "ipopt") && (settings.linear_solver == "mumps"));
+    }
+
+    bool nlp_converged(const Dict &stats)
+    {
+        auto success = stats.find("success");
+        if(success != stats.end())
+            return success->second.as_bool();
+
+        auto status = stats.find("return_status");
+        if(status == stats.end())
+            return false;
+
+        std::string return_status = status->second.as_string();
+        return (return_status == "Solve_Succeeded") || (return_status == "Solved_To_Acceptable_Level");
+    }
+
+    namespace
+    {
+        /** first of the candidate keys present in stats, seconds converted to milliseconds */
+        double stat_time(const Dict &stats, const std::vector<std::string> &keys)
+        {
+            for(const std::string &key : keys)
+            {
+                auto entry = stats.find(key);
+                if(entry == stats.end())
+                    continue;
+                if(entry->second.is_double())
+                    return 1000 * entry->second.as_double();
+                if(entry->second.is_int())
+                    return 1000 * entry->second.as_int();
+            }
+            return -1;
+        }
+    }
+
+    NLPTelemetry nlp_telemetry(const Dict &stats)
+    {
+        NLPTelemetry telemetry;
+        telemetry.success = nlp_converged(stats);
+
+        auto status = stats.find("return_status");
+        if(status != stats.end())
+            telemetry.return_status = status->second.as_string();
+        auto iter = stats.find("iter_count");
+        if((iter != stats.end()) && iter->second.is_int())
+            telemetry.iter_count = iter->second.as_int();
+
+        /** CasADi >= 3.3 : t_wall_nlp_*, 3.1 - 3.2 : t_wall_eval_*, 3.0 : t_eval_* */
+        telemetry.t_eval_f      = stat_time(stats, {"t_wall_nlp_f", "t_wall_eval_f", "t_eval_f"});
+        telemetry.t_eval_grad_f = stat_time(stats, {"t_wall_nlp_grad_f", "t_wall_eval_grad_f", "t_eval_grad_f"});
+        telemetry.t_eval_g      = stat_time(stats, {"t_wall_nlp_g", "t_wall_eval_g", "t_eval_g"});
+        telemetry.t_eval_jac_g  = stat_time(stats, {"t_wall_nlp_jac_g", "t_wall_eval_jac_g", "t_eval_jac_g"});
+        telemetry.t_eval_hess   = stat_time(stats, {"t_wall_nlp_hess_l", "t_wall_eval_h", "t_eval_h"});
+        telemetry.t_total       = stat_time(stats, {"t_wall_total", "t_wall_solver", "t_wall_mainloop", "t_mainloop"});
+
+        if(telemetry.t_total >= 0)
+        {
+            double t_eval = 0;
+            for(const double &t : {telemetry.t_eval_f, telemetry.t_eval_grad_f, telemetry.t_eval_g,
+                                   telemetry.t_eval_jac_g, telemetry.t_eval_hess})
+                t_eval += std::max(0.0, t);
+            telemetry.t_solver_overhead = std::max(0.0, telemetry.t_total - t_eval);
+        }
+        return telemetry;
+    }
+
+    double constraint_violation(const DM &g, const DM &lbg, const DM &ubg)
+    {
+        std::vector<double> value = g.nonzeros();
+        std::vector<double> lower = lbg.nonzeros();
+        std::vector<double> upper = ubg.nonzeros();
+        /** scalar bounds apply to all constraints */
+        double violation = 0;
+        for(size_t i = 0; i < value.size(); ++i)
+        {
+            double lo = lower.empty() ? -std::numeric_limits<double>::infinity() : lower[std::min(i, lower.size() - 1)];
+            double hi = upper.empty() ?  std::numeric_limits<double>::infinity() : upper[std::min(i, upper.size() - 1)];
+            violation = std::max(violation, std::max(lo - value[i], value[i] - hi));
+        }
+        return violation;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef NLP_BACKEND_H
+#define NLP_BACKEND_H
+
+#include "casadi/casadi.hpp"
+
+namespace kmath
+{
+    /** solver-independent NLP settings; translated to the plugin specific options by nlp_solver() */
+    struct NLPSettings
+    {
+        /** nlpsol plugin : "ipopt", "sqpmethod", or any other plugin compiled into CasADi */
+        std::string solver        = "ipopt";
+        /** IPOPT linear solver : "mumps", "ma27", "ma57", "ma97" */
+        std::string linear_solver = "ma97";
+        /** sqpmethod QP solver : "qpoases", "osqp" */
+        std::string qp_solver     = "qpoases";
+
+        double tol          = 1e-4;
+        int    max_iter     = 40;
+        int    print_level  = 0;
+        bool   warm_start   = true;
+        bool   limited_memory = false;
+
+        /** plugin specific options, applied last and override the translated ones */
+        casadi::Dict options;
+    };
+
+    /** parse "solver[:sub_solver]", e.g. "ipopt:mumps", "sqpmethod:osqp", "blocksqp" */
+    NLPSettings nlp_settings_from_string(const std::string &spec, const NLPSettings &defaults = NLPSettings());
+    std::string nlp_settings_to_string(const NLPSettings &settings);
+
+    /** plugin options translated from the settings, throws if the plugin is not available */
+    casadi::Dict nlp_solver_options(const NLPSettings &settings);
+
+    /** create an NLP solver for the selected backend, throws if the plugin is not available */
+    casadi::Function nlp_solver(const std::string &name, const casadi::SXDict &nlp, const NLPSettings &settings);
+    /** MX graphs, e.g. with mapped Functions */
+    casadi::Function nlp_solver(const std::string &name, const casadi::MXDict &nlp, const NLPSettings &settings);
+
+    /** solver instances of these settings may run concurrently : not with IPOPT and sequential MUMPS,
+     *  which keeps process-global state */
+    bool nlp_thread_safe(const NLPSettings &settings);
+
+    /** backend independent convergence check of solver stats */
+    bool nlp_converged(const casadi::Dict &stats);
+
+    /** per-solve solver telemetry, times in milliseconds, negative if not reported by the plugin */
+    struct NLPTelemetry
+    {
+        int iter_count = -1;
+        std::string return_status;
+        bool success = false;
+        double objective = 0;
+        double constraint_violation = 0;
+
+        double t_eval_f      = -1;
+        double t_eval_grad_f = -1;
+        double t_eval_g      = -1;
+        double t_eval_jac_g  = -1;
+        double t_eval_hess   = -1;
+        /** solver time less the function evaluations : linear solver, line search and the other solver internals,
+         *  not a linear solver timing */
+        double t_solver_overhead = -1;
+        double t_total = -1;
+    };
+
+    /** timings and counters from solver stats, tolerant to the key names of different CasADi versions */
+    NLPTelemetry nlp_telemetry(const casadi::Dict &stats);
+    /** largest violation of lbg <= g <= ubg */
+    double constraint_violation(const casadi::DM &g, const casadi::DM &lbg, const casadi::DM &ubg);
+}
+
+#endif // NLP_BACKEND_H
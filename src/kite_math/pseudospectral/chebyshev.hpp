@@ -28,7 +28,10 @@ public:
     BaseClass CollocateDynamics(casadi::Function &dynamics, const double &t0, const double &tf);
     BaseClass CollocateCost(casadi::Function &MayerTerm, casadi::Function &LagrangeTerm,
                             const double &t0, const double &tf);
+    /** data : [ND x (NumSegments * PolyOrder + 1)] samples in forward time, IdCost(x, y) : y is one data column */
     BaseClass CollocateIdCost(casadi::Function &IdCost, casadi::DM data, const double &t0, const double &tf);
+    /** symbolic data, e.g. measurements passed as NLP parameters */
+    BaseClass CollocateIdCost(casadi::Function &IdCost, const BaseClass &data, const double &t0, const double &tf);
 
     typedef std::function<BaseClass(BaseClass, BaseClass, BaseClass)> functor;
     /** right hand side function of the ODE */
@@ -343,17 +346,31 @@ BaseClass Chebyshev<BaseClass, PolyOrder, NumSegments, NX, NU, NP>::CollocateIdC
                                                                                     casadi::DM data,
                                                                                     const double &t0, const double &tf)
 {
-    if ( (data.size1() != NX) || (data.size2() != (NumSegments * PolyOrder + 1)) )
+    return CollocateIdCost(IdCost, BaseClass(data), t0, tf);
+}
+
+template<class BaseClass,
+         int PolyOrder,
+         int NumSegments,
+         int NX,
+         int NU,
+         int NP>
+BaseClass Chebyshev<BaseClass, PolyOrder, NumSegments, NX, NU, NP>::CollocateIdCost(casadi::Function &IdCost,
+                                                                                    const BaseClass &data,
+                                                                                    const double &t0, const double &tf)
+{
+    if (data.size2() != (NumSegments * PolyOrder + 1))
     {
         std::cout << "CollocateIdCost: Inconsistent data size! \n";
-        return casadi::SX({0});
+        return BaseClass({0});
     }
 
     /** collocate Integral cost */
     BaseClass IntCost = {0};
-    casadi::SXVector value;
-    casadi::DM _data = casadi::DM::vec(data);
-    int size_x = _X.size1();
+    std::vector<BaseClass> value;
+    BaseClass _data = BaseClass::vec(data);
+    int ND = data.size1();
+    int size_data = _data.size1();
 
     if(!IdCost.is_null())
     {
@@ -365,8 +382,9 @@ BaseClass Chebyshev<BaseClass, PolyOrder, NumSegments, NX, NU, NP>::CollocateIdC
             int m = 0;
             for (int i = k * NX * PolyOrder; i <= (k + 1) * NX * PolyOrder; i += NX)
             {
-                int idx = size_x - i;
-                value = IdCost(casadi::SXVector{_X(casadi::Slice(i, i + NX)), _data(casadi::Slice(idx, idx - NX)) });
+                /** collocation points are in reversed time order : node n <-> data column (N - 1 - n) */
+                int idx = size_data - ND * (i / NX + 1);
+                value = IdCost(std::vector<BaseClass>{_X(casadi::Slice(i, i + NX)), _data(casadi::Slice(idx, idx + ND))});
 
                 local_int += _QuadWeights[m] * value[0];
                 ++m;
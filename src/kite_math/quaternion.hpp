@@ -0,0 +1,167 @@
+#ifndef QUATERNION_HPP
+#define QUATERNION_HPP
+
+#include "casadi/casadi.hpp"
+#include "eigen3/Eigen/Dense"
+#include <type_traits>
+
+/** Quaternion arithmetic for symbolic and numeric types : scalar first, Hamilton product.
+ *  casadi::SX is served by the functions declared in kitemath.h, DM and MX by the templates below.
+ *  Eigen vectors and raw arrays of float / double are evaluated inline without temporaries;
+ *  the batched versions take poses row-wise ([N x 4] quaternions, [N x 3] vectors) so every
+ *  component is a contiguous column and the arithmetic vectorizes over the poses.
+ */
+namespace kmath
+{
+    template<typename T>
+    struct is_casadi_matrix : std::false_type {};
+    template<>
+    struct is_casadi_matrix<casadi::DM> : std::true_type {};
+    template<>
+    struct is_casadi_matrix<casadi::MX> : std::true_type {};
+
+    /** casadi DM and MX */
+    template<typename T>
+    typename std::enable_if<is_casadi_matrix<T>::value, T>::type quat_multiply(const T &q1, const T &q2)
+    {
+        T s1 = q1(0);
+        T v1 = q1(casadi::Slice(1,4), 0);
+        T s2 = q2(0);
+        T v2 = q2(casadi::Slice(1,4), 0);
+
+        T s = (s1 * s2) - T::dot(v1, v2);
+        T v = T::cross(v1, v2) + (s1 * v2) + (s2 * v1);
+        return T::vertcat({s, v});
+    }
+
+    template<typename T>
+    typename std::enable_if<is_casadi_matrix<T>::value, T>::type quat_inverse(const T &q)
+    {
+        return T::vertcat({q(0), -q(1), -q(2), -q(3)});
+    }
+
+    template<typename T>
+    typename std::enable_if<is_casadi_matrix<T>::value, T>::type quat_transform(const T &q_ba, const T &a_vect)
+    {
+        T tmp = quat_multiply(q_ba, quat_multiply(T::vertcat({0, a_vect}), quat_inverse(q_ba)));
+        return tmp(casadi::Slice(1,4), 0);
+    }
+
+    /** raw arrays : out may not alias the inputs */
+    template<typename Scalar>
+    inline typename std::enable_if<std::is_floating_point<Scalar>::value>::type
+    quat_multiply(const Scalar *q1, const Scalar *q2, Scalar *out)
+    {
+        out[0] = q1[0] * q2[0] - q1[1] * q2[1] - q1[2] * q2[2] - q1[3] * q2[3];
+        out[1] = q1[0] * q2[1] + q1[1] * q2[0] + q1[2] * q2[3] - q1[3] * q2[2];
+        out[2] = q1[0] * q2[2] - q1[1] * q2[3] + q1[2] * q2[0] + q1[3] * q2[1];
+        out[3] = q1[0] * q2[3] + q1[1] * q2[2] - q1[2] * q2[1] + q1[3] * q2[0];
+    }
+
+    template<typename Scalar>
+    inline typename std::enable_if<std::is_floating_point<Scalar>::value>::type
+    quat_inverse(const Scalar *q, Scalar *out)
+    {
+        out[0] = q[0];
+        out[1] = -q[1];
+        out[2] = -q[2];
+        out[3] = -q[3];
+    }
+
+    /** v_b = q_ba * v_a * q_ba^-1 for a unit quaternion : v + 2s (u x v) + 2u x (u x v) */
+    template<typename Scalar>
+    inline typename std::enable_if<std::is_floating_point<Scalar>::value>::type
+    quat_transform(const Scalar *q_ba, const Scalar *a_vect, Scalar *out)
+    {
+        const Scalar *u = q_ba + 1;
+        Scalar t[3] = {2 * (u[1] * a_vect[2] - u[2] * a_vect[1]),
+                       2 * (u[2] * a_vect[0] - u[0] * a_vect[2]),
+                       2 * (u[0] * a_vect[1] - u[1] * a_vect[0])};
+        out[0] = a_vect[0] + q_ba[0] * t[0] + (u[1] * t[2] - u[2] * t[1]);
+        out[1] = a_vect[1] + q_ba[0] * t[1] + (u[2] * t[0] - u[0] * t[2]);
+        out[2] = a_vect[2] + q_ba[0] * t[2] + (u[0] * t[1] - u[1] * t[0]);
+    }
+
+    /** Eigen vectors */
+    template<typename D1, typename D2>
+    inline Eigen::Matrix<typename D1::Scalar, 4, 1> quat_multiply(const Eigen::MatrixBase<D1> &q1, const Eigen::MatrixBase<D2> &q2)
+    {
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D1, 4);
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D2, 4);
+        Eigen::Matrix<typename D1::Scalar, 4, 1> q;
+        q(0) = q1(0) * q2(0) - q1.template tail<3>().dot(q2.template tail<3>());
+        q.template tail<3>() = q1.template tail<3>().cross(q2.template tail<3>()) + q1(0) * q2.template tail<3>() +
+                               q2(0) * q1.template tail<3>();
+        return q;
+    }
+
+    template<typename D>
+    inline Eigen::Matrix<typename D::Scalar, 4, 1> quat_inverse(const Eigen::MatrixBase<D> &q)
+    {
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D, 4);
+        return Eigen::Matrix<typename D::Scalar, 4, 1>(q(0), -q(1), -q(2), -q(3));
+    }
+
+    template<typename D1, typename D2>
+    inline Eigen::Matrix<typename D1::Scalar, 3, 1> quat_transform(const Eigen::MatrixBase<D1> &q_ba, const Eigen::MatrixBase<D2> &a_vect)
+    {
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D1, 4);
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D2, 3);
+        Eigen::Matrix<typename D1::Scalar, 3, 1> t = 2 * q_ba.template tail<3>().cross(a_vect);
+        return a_vect + q_ba(0) * t + q_ba.template tail<3>().cross(t);
+    }
+
+    /** rotation matrix of a unit quaternion : R * v == quat_transform(q, v) */
+    template<typename D>
+    inline Eigen::Matrix<typename D::Scalar, 3, 3> quat_rotation_matrix(const Eigen::MatrixBase<D> &q)
+    {
+        EIGEN_STATIC_ASSERT_VECTOR_SPECIFIC_SIZE(D, 4);
+        typedef typename D::Scalar Scalar;
+        const Scalar w = q(0), x = q(1), y = q(2), z = q(3);
+        Eigen::Matrix<Scalar, 3, 3> R;
+        R << 1 - 2 * (y * y + z * z), 2 * (x * y - w * z),     2 * (x * z + w * y),
+             2 * (x * y + w * z),     1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+             2 * (x * z - w * y),     2 * (y * z + w * x),     1 - 2 * (x * x + y * y);
+        return R;
+    }
+
+    /** batched : row i of out = Q1.row(i) * Q2.row(i), Q2 may have a single row which is then applied to all */
+    template<typename D1, typename D2, typename D3>
+    void quat_multiply_batch(const Eigen::MatrixBase<D1> &Q1, const Eigen::MatrixBase<D2> &Q2, const Eigen::MatrixBase<D3> &_out)
+    {
+        Eigen::MatrixBase<D3> &out = const_cast<Eigen::MatrixBase<D3>&>(_out);
+        eigen_assert((Q1.cols() == 4) && (Q2.cols() == 4) && (out.cols() == 4));
+        eigen_assert((Q2.rows() == Q1.rows()) || (Q2.rows() == 1));
+        out.derived().resize(Q1.rows(), 4);
+
+        if(Q2.rows() == 1)
+        {
+            const typename D2::Scalar w = Q2(0, 0), x = Q2(0, 1), y = Q2(0, 2), z = Q2(0, 3);
+            out.col(0).array() = Q1.col(0).array() * w - Q1.col(1).array() * x - Q1.col(2).array() * y - Q1.col(3).array() * z;
+            out.col(1).array() = Q1.col(0).array() * x + Q1.col(1).array() * w + Q1.col(2).array() * z - Q1.col(3).array() * y;
+            out.col(2).array() = Q1.col(0).array() * y - Q1.col(1).array() * z + Q1.col(2).array() * w + Q1.col(3).array() * x;
+            out.col(3).array() = Q1.col(0).array() * z + Q1.col(1).array() * y - Q1.col(2).array() * x + Q1.col(3).array() * w;
+            return;
+        }
+
+        out.col(0).array() = Q1.col(0).array() * Q2.col(0).array() - Q1.col(1).array() * Q2.col(1).array()
+                           - Q1.col(2).array() * Q2.col(2).array() - Q1.col(3).array() * Q2.col(3).array();
+        out.col(1).array() = Q1.col(0).array() * Q2.col(1).array() + Q1.col(1).array() * Q2.col(0).array()
+                           + Q1.col(2).array() * Q2.col(3).array() - Q1.col(3).array() * Q2.col(2).array();
+        out.col(2).array() = Q1.col(0).array() * Q2.col(2).array() - Q1.col(1).array() * Q2.col(3).array()
+                           + Q1.col(2).array() * Q2.col(0).array() + Q1.col(3).array() * Q2.col(1).array();
+        out.col(3).array() = Q1.col(0).array() * Q2.col(3).array() + Q1.col(1).array() * Q2.col(2).array()
+                           - Q1.col(2).array() * Q2.col(1).array() + Q1.col(3).array() * Q2.col(0).array();
+    }
+
+    /** batched : rows of V [N x 3] rotated by a single unit quaternion */
+    template<typename D1, typename D2, typename D3>
+    void quat_transform_batch(const Eigen::MatrixBase<D1> &q_ba, const Eigen::MatrixBase<D2> &V, const Eigen::MatrixBase<D3> &_out)
+    {
+        Eigen::MatrixBase<D3> &out = const_cast<Eigen::MatrixBase<D3>&>(_out);
+        eigen_assert(V.cols() == 3);
+        out.derived().noalias() = V * quat_rotation_matrix(q_ba).transpose();
+    }
+}
+
+#endif // QUATERNION_HPP
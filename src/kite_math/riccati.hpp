@@ -0,0 +1,383 @@
+#ifndef RICCATI_HPP
+#define RICCATI_HPP
+
+#include "eigen3/Eigen/Dense"
+#include "eigen3/Eigen/Eigenvalues"
+#include <limits>
+#include <cmath>
+
+namespace kmath
+{
+namespace oc
+{
+
+/** Riccati solver for repeated LQR gain computation on slowly varying linearizations.
+ *  Dimensions are fixed at compile time and the workspace is kept in the object : a solve does not allocate.
+ *  J = INT { x'Qx + 2x'Mu + u'Ru }dt (continuous) or SUM { ... } (discrete), u = -Kx
+ *  care : Newton-Kleinman iteration, dare : Newton-Hewer iteration. Both are warm started from the previous
+ *  gain when it still stabilizes the new system, otherwise restarted from a Bass stabilizing gain (care) or
+ *  solved by the structure-preserving doubling algorithm (dare).
+ */
+template<int NX, int NU>
+class RiccatiSolver
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double, NX, NX> MatrixX;
+    typedef Eigen::Matrix<double, NX, NU> MatrixB;
+    typedef Eigen::Matrix<double, NU, NU> MatrixU;
+    typedef Eigen::Matrix<double, NU, NX> MatrixK;
+
+    RiccatiSolver();
+    RiccatiSolver(const MatrixX &Q, const MatrixU &R, const MatrixB &M = MatrixB::Zero());
+    virtual ~RiccatiSolver(){}
+
+    void setWeights(const MatrixX &Q, const MatrixU &R, const MatrixB &M = MatrixB::Zero());
+    void setTolerance(const double &tolerance){m_tolerance = tolerance;}
+    void setMaxIterations(const int &max_iter){m_max_iter = max_iter;}
+    /** drop the warm start */
+    void reset(){m_warm = NONE;}
+
+    /** A'X + XA - (XB + M) R^-1 (B'X + M') + Q = 0, K = R^-1 (B'X + M') */
+    bool care(const MatrixX &A, const MatrixB &B);
+    /** X = A'XA - (A'XB + M) (R + B'XB)^-1 (B'XA + M') + Q, K = (R + B'XB)^-1 (B'XA + M') */
+    bool dare(const MatrixX &A, const MatrixB &B);
+
+    const MatrixX& solution() const {return m_X;}
+    const MatrixK& gain() const {return m_K;}
+    int iterations() const {return m_iterations;}
+    /** Frobenius norm of the Riccati residual at the solution */
+    double residual() const {return m_residual;}
+    bool warm_started() const {return m_warm_started;}
+
+    /** AX + XA' = Q, returns false if A is not Hurwitz (the solution is then not the controllability gramian) */
+    bool lyapunov(const MatrixX &A, const MatrixX &Q, MatrixX &X);
+    /** X = A'XA + Q, returns false if A is not Schur stable */
+    bool stein(const MatrixX &A, const MatrixX &Q, MatrixX &X);
+
+private:
+    enum Mode {NONE, CONTINUOUS, DISCRETE};
+
+    /** weights, cross term removed : A_ = A - B R^-1 M', Q_ = Q - M R^-1 M' */
+    MatrixX m_Q;
+    MatrixU m_R, m_Rinv;
+    MatrixK m_RinvMt;
+
+    double m_tolerance;
+    int m_max_iter;
+    Mode m_warm;
+    bool m_warm_started;
+    int m_iterations;
+    double m_residual;
+
+    /** solution */
+    MatrixX m_X;
+    MatrixK m_K;
+
+    /** workspace */
+    MatrixX m_A, m_Ac, m_W, m_T, m_Q1, m_Y;
+    MatrixX m_Ak, m_Gk, m_Hk, m_A1, m_G1;
+    MatrixK m_Kt, m_Kn;
+    Eigen::Matrix<double, NX, 1> m_rhs1, m_rhs2;
+    Eigen::Matrix<double, 2 * NX, 1> m_rhs;
+    Eigen::Matrix<double, 2 * NX, 2 * NX> m_M2;
+    Eigen::RealSchur<MatrixX> m_schur;
+    Eigen::PartialPivLU<MatrixX> m_lu;
+    Eigen::PartialPivLU<Eigen::Matrix<double, 2 * NX, 2 * NX>> m_lu2;
+    Eigen::LDLT<MatrixU> m_ldlt;
+
+    bool newton_care(const MatrixB &B);
+    bool newton_dare(const MatrixB &B);
+    bool bass(const MatrixB &B);
+    bool doubling(const MatrixB &B);
+    bool finish(const Mode &mode, const bool &converged);
+};
+
+
+template<int NX, int NU>
+RiccatiSolver<NX, NU>::RiccatiSolver() : m_tolerance(1e-10), m_max_iter(30), m_warm(NONE), m_warm_started(false),
+    m_iterations(0), m_residual(std::numeric_limits<double>::infinity()), m_schur(NX), m_lu(NX), m_lu2(2 * NX), m_ldlt(NU)
+{
+    setWeights(MatrixX::Identity(), MatrixU::Identity());
+    m_X.setZero();
+    m_K.setZero();
+}
+
+template<int NX, int NU>
+RiccatiSolver<NX, NU>::RiccatiSolver(const MatrixX &Q, const MatrixU &R, const MatrixB &M) : RiccatiSolver()
+{
+    setWeights(Q, R, M);
+}
+
+template<int NX, int NU>
+void RiccatiSolver<NX, NU>::setWeights(const MatrixX &Q, const MatrixU &R, const MatrixB &M)
+{
+    m_R = R;
+    m_ldlt.compute(R);
+    m_Rinv = m_ldlt.solve(MatrixU::Identity());
+    m_RinvMt.noalias() = m_Rinv * M.transpose();
+    m_Q = Q;
+    m_Q.noalias() -= M * m_RinvMt;
+    m_warm = NONE;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::lyapunov(const MatrixX &A, const MatrixX &Q, MatrixX &X)
+{
+    /** Bartels-Stewart : T Y + Y T' = U'QU, A = U T U', T quasi-triangular */
+    m_schur.compute(A);
+    const MatrixX &T = m_schur.matrixT();
+    const MatrixX &U = m_schur.matrixU();
+    m_Q1.noalias() = U.transpose() * Q;
+    m_W.noalias() = m_Q1 * U;
+
+    bool stable = true;
+    int i = NX - 1;
+    while(i >= 0)
+    {
+        /** columns right of the current block are known */
+        if((i > 0) && (T(i, i - 1) != 0))
+        {
+            /** complex pair : two coupled columns */
+            m_rhs1 = m_W.col(i - 1);
+            m_rhs2 = m_W.col(i);
+            for(int j = i + 1; j < NX; ++j)
+            {
+                m_rhs1 -= T(i - 1, j) * m_Y.col(j);
+                m_rhs2 -= T(i, j) * m_Y.col(j);
+            }
+            m_M2.setZero();
+            m_M2.template topLeftCorner<NX, NX>() = T;
+            m_M2.template bottomRightCorner<NX, NX>() = T;
+            m_M2.template topLeftCorner<NX, NX>().diagonal().array() += T(i - 1, i - 1);
+            m_M2.template bottomRightCorner<NX, NX>().diagonal().array() += T(i, i);
+            m_M2.template topRightCorner<NX, NX>().diagonal().setConstant(T(i - 1, i));
+            m_M2.template bottomLeftCorner<NX, NX>().diagonal().setConstant(T(i, i - 1));
+            m_rhs << m_rhs1, m_rhs2;
+            m_lu2.compute(m_M2);
+            m_rhs = m_lu2.solve(m_rhs);
+            m_Y.col(i - 1) = m_rhs.template head<NX>();
+            m_Y.col(i) = m_rhs.template tail<NX>();
+
+            stable = stable && (T(i - 1, i - 1) + T(i, i) < 0);
+            i -= 2;
+        }
+        else
+        {
+            m_rhs1 = m_W.col(i);
+            for(int j = i + 1; j < NX; ++j)
+                m_rhs1 -= T(i, j) * m_Y.col(j);
+            m_T = T;
+            m_T.diagonal().array() += T(i, i);
+            m_lu.compute(m_T);
+            m_Y.col(i) = m_lu.solve(m_rhs1);
+
+            stable = stable && (T(i, i) < 0);
+            i -= 1;
+        }
+    }
+
+    m_W.noalias() = U * m_Y;
+    X.noalias() = m_W * U.transpose();
+    return stable && X.allFinite();
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::stein(const MatrixX &A, const MatrixX &Q, MatrixX &X)
+{
+    /** squared Smith iteration : X = SUM (A')^k Q A^k, doubling the number of terms per step */
+    X = Q;
+    m_Ak = A;
+    for(int k = 0; k < 64; ++k)
+    {
+        m_W.noalias() = m_Ak.transpose() * X;
+        m_Y.noalias() = m_W * m_Ak;
+        X += m_Y;
+        m_W.noalias() = m_Ak * m_Ak;
+        m_Ak = m_W;
+
+        if(!X.allFinite() || (m_Ak.norm() > 1e12))
+            return false;
+        if(m_Y.norm() <= std::numeric_limits<double>::epsilon() * X.norm())
+            return true;
+    }
+    return false;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::bass(const MatrixB &B)
+{
+    /** (A + bI) Z + Z (A + bI)' = 2 B R^-1 B', b > max(-Re(eig(A))) : A - B R^-1 B' Z^-1 is stable */
+    m_schur.compute(m_A, false);
+    const MatrixX &T = m_schur.matrixT();
+    double b = 0;
+    for(int i = 0; i < NX; ++i)
+    {
+        /** complex pair : 2x2 block, the real part is the mean of its diagonal */
+        if((i + 1 < NX) && (T(i + 1, i) != 0))
+        {
+            b = std::fmax(b, -0.5 * (T(i, i) + T(i + 1, i + 1)));
+            ++i;
+        }
+        else
+            b = std::fmax(b, -T(i, i));
+    }
+    b += 0.5;
+
+    m_Ac = m_A;
+    m_Ac.diagonal().array() += b;
+    m_G1.noalias() = B * m_Rinv * B.transpose();
+    m_G1 *= 2;
+    if(!lyapunov(-m_Ac, -m_G1, m_Gk))
+        return false;
+
+    m_lu.compute(m_Gk);
+    m_Kt.noalias() = m_Rinv * (m_lu.solve(B)).transpose();
+    return m_Kt.allFinite();
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::newton_care(const MatrixB &B)
+{
+    bool converged = false;
+    for(m_iterations = 0; (m_iterations < m_max_iter) && !converged; ++m_iterations)
+    {
+        /** (A - BK)'X + X(A - BK) = -(Q + K'RK) */
+        m_Ac = m_A;
+        m_Ac.noalias() -= B * m_Kt;
+        m_W = m_Q;
+        m_W.noalias() += m_Kt.transpose() * m_R * m_Kt;
+        if(!lyapunov(m_Ac.transpose(), -m_W, m_X))
+            return false;
+
+        m_Kn.noalias() = m_Rinv * B.transpose() * m_X;
+        const double step = (m_Kn - m_Kt).norm();
+        m_Kt = m_Kn;
+        converged = (step <= m_tolerance * (1 + m_Kt.norm()));
+    }
+
+    /** residual of the cross term free equation */
+    m_W.noalias() = m_A.transpose() * m_X;
+    m_Y = m_W + m_W.transpose() + m_Q;
+    m_Y.noalias() -= m_X * B * m_Kt;
+    m_residual = m_Y.norm();
+    return converged;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::doubling(const MatrixB &B)
+{
+    /** structure-preserving doubling : H_k -> X, no stabilizing initial gain needed */
+    m_Ak = m_A;
+    m_Gk.noalias() = B * m_Rinv * B.transpose();
+    m_Hk = m_Q;
+    bool converged = false;
+    for(m_iterations = 0; (m_iterations < m_max_iter) && !converged; ++m_iterations)
+    {
+        m_T = MatrixX::Identity();
+        m_T.noalias() += m_Gk * m_Hk;
+        m_lu.compute(m_T);
+        m_A1 = m_lu.solve(m_Ak);
+        m_G1 = m_lu.solve(m_Gk);
+
+        m_W.noalias() = m_Ak.transpose() * m_Hk;
+        m_X = m_Hk;
+        m_X.noalias() += m_W * m_A1;
+        m_W.noalias() = m_Ak * m_G1;
+        m_Gk.noalias() += m_W * m_Ak.transpose();
+        m_W.noalias() = m_Ak * m_A1;
+        m_Ak = m_W;
+
+        const double step = (m_X - m_Hk).norm();
+        m_Hk = m_X;
+        if(!m_X.allFinite())
+            return false;
+        converged = (step <= m_tolerance * (1 + m_X.norm()));
+    }
+
+    m_ldlt.compute(m_R + B.transpose() * m_X * B);
+    m_Kt = m_ldlt.solve(B.transpose() * m_X * m_A);
+    return converged;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::newton_dare(const MatrixB &B)
+{
+    bool converged = false;
+    for(m_iterations = 0; (m_iterations < m_max_iter) && !converged; ++m_iterations)
+    {
+        /** X = (A - BK)'X(A - BK) + Q + K'RK */
+        m_Ac = m_A;
+        m_Ac.noalias() -= B * m_Kt;
+        m_W = m_Q;
+        m_W.noalias() += m_Kt.transpose() * m_R * m_Kt;
+        if(!stein(m_Ac, m_W, m_X))
+            return false;
+
+        m_ldlt.compute(m_R + B.transpose() * m_X * B);
+        m_Kn = m_ldlt.solve(B.transpose() * m_X * m_A);
+        const double step = (m_Kn - m_Kt).norm();
+        m_Kt = m_Kn;
+        converged = (step <= m_tolerance * (1 + m_Kt.norm()));
+    }
+    return converged;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::finish(const Mode &mode, const bool &converged)
+{
+    m_K = m_Kt + m_RinvMt;
+    m_warm = converged ? mode : NONE;
+    return converged;
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::care(const MatrixX &A, const MatrixB &B)
+{
+    m_A = A;
+    m_A.noalias() -= B * m_RinvMt;
+
+    m_warm_started = (m_warm == CONTINUOUS);
+    if(m_warm_started)
+    {
+        m_Kt = m_K - m_RinvMt;
+        if(newton_care(B))
+            return finish(CONTINUOUS, true);
+        m_warm_started = false;
+    }
+
+    bool converged = bass(B) && newton_care(B);
+    return finish(CONTINUOUS, converged);
+}
+
+template<int NX, int NU>
+bool RiccatiSolver<NX, NU>::dare(const MatrixX &A, const MatrixB &B)
+{
+    m_A = A;
+    m_A.noalias() -= B * m_RinvMt;
+
+    m_warm_started = (m_warm == DISCRETE);
+    bool converged = false;
+    if(m_warm_started)
+    {
+        m_Kt = m_K - m_RinvMt;
+        converged = newton_dare(B);
+        m_warm_started = converged;
+    }
+    if(!converged)
+        converged = doubling(B);
+
+    /** residual of the cross term free equation */
+    m_W.noalias() = m_A.transpose() * m_X;
+    m_Y.noalias() = m_W * m_A;
+    m_Y += m_Q - m_X;
+    m_Y.noalias() -= m_W * B * m_Kt;
+    m_residual = m_Y.norm();
+    return finish(DISCRETE, converged && m_X.allFinite());
+}
+
+}
+}
+
+#endif // RICCATI_HPP
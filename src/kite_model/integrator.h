@@ -3,6 +3,7 @@
 
 #include "casadi/casadi.hpp"
 #include "kitemath.h"
+#include "nlp_backend.h"
 #include "eigen3/Eigen/Dense"
 #include "pseudospectral/chebyshev.hpp"
 
@@ -59,11 +60,23 @@ private:
     bool             cvodes_initialized;
 };
 
+/** default NLP settings of the pseudospectral solver : accurate offline solve */
+inline kmath::NLPSettings psode_nlp_settings()
+{
+    kmath::NLPSettings settings;
+    settings.print_level    = 5;
+    settings.max_iter       = 3000;
+    settings.warm_start     = false;
+    settings.limited_memory = true;
+    return settings;
+}
+
 /** Pseudospectral solver */
 template<int PolyOrder, int NumSegments, int NX, int NU>
 class PSODESolver{
 public:
-    PSODESolver(casadi::Function ODE, const float &dt, const casadi::DMDict &props);
+    PSODESolver(casadi::Function ODE, const float &dt, const casadi::DMDict &props,
+                const kmath::NLPSettings &nlp_settings = psode_nlp_settings());
     virtual ~PSODESolver(){}
     casadi::DM solve(const casadi::DM &X0, const casadi::DM &U, const bool full = false);
     casadi::DMDict solve_trajectory(const casadi::DM &X0, const casadi::DM &U, const bool full = false);
@@ -76,7 +89,6 @@ private:
     casadi::SX G;
     casadi::SX opt_var;
     casadi::SXDict   NLP;
-    casadi::Dict     OPTS;
     casadi::DMDict   ARG;
     casadi::Function NLP_Solver;
 
@@ -84,7 +96,8 @@ private:
 };
 
 template<int PolyOrder, int NumSegments, int NX, int NU>
-PSODESolver<PolyOrder, NumSegments, NX, NU>::PSODESolver(casadi::Function ODE, const float &dt, const casadi::DMDict &props)
+PSODESolver<PolyOrder, NumSegments, NX, NU>::PSODESolver(casadi::Function ODE, const float &dt, const casadi::DMDict &props,
+                                                         const kmath::NLPSettings &nlp_settings)
 {
     scale = 0;
     P = casadi::DM::eye(NX);
@@ -147,13 +160,7 @@ PSODESolver<PolyOrder, NumSegments, NX, NU>::PSODESolver(casadi::Function ODE, c
     NLP["f"] = 1e-3 * casadi::SX::dot(G,G);
     NLP["g"] = G;
 
-    OPTS["ipopt.linear_solver"]  = "ma97";
-    OPTS["ipopt.print_level"]    = 5;
-    OPTS["ipopt.tol"]            = 1e-4;
-    OPTS["ipopt.acceptable_tol"] = 1e-4;
-    OPTS["ipopt.max_iter"]       = 3000;
-    OPTS["ipopt.hessian_approximation"] = "limited-memory";
-    NLP_Solver = nlpsol("solver", "ipopt", NLP, OPTS);
+    NLP_Solver = kmath::nlp_solver("solver", NLP, nlp_settings);
 
     std::cout << "problem set \n";
 
@@ -353,6 +353,7 @@ KiteDynamics::KiteDynamics(const KiteProperties &KiteProps, const AlgorithmPrope
 
     this->NumDynamics = dyn_func;
     this->NumJacobian = dyn_jac;
+    this->NumTransition = kmath::rk4_transition(dyn_func);
 
     /** return integrator function */
     if(AlgoProps.Integrator == IntType::CVODES)
@@ -651,6 +652,10 @@ RigidBodyKinematics::RigidBodyKinematics(const AlgorithmProperties &AlgoProps)
     SX Jacobian = SX::jacobian(Dynamics, state);
     NumJacobian = Function("RB_Jacobian", {state, u}, {Jacobian});
 
+    /** RK4 transition : control enters for interface compatibility only */
+    Function controlled_dynamics = Function("RB_Dynamics_u", {state, u}, {Dynamics});
+    NumTransition = kmath::rk4_transition(controlled_dynamics, "RB_TRANSITION");
+
     /** Integrators */
     /** CVODES */
     double h = algo_props.sampling_time;
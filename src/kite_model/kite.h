@@ -122,6 +122,8 @@ public:
     casadi::Function getNumericDynamics(){return this->NumDynamics;}
     casadi::Function getNumericIntegrator(){return this->NumIntegrator;}
     casadi::Function getNumericJacobian(){return this->NumJacobian;}
+    /** RK4 step and its exact transition matrix : Function({x, u, dt}) -> {x_next, Phi} */
+    casadi::Function getNumericTransition(){return this->NumTransition;}
 
     casadi::Function getAeroDynamicForces(){return this->AeroDynamics;}
 
@@ -145,6 +147,8 @@ private:
     casadi::Function NumIntegrator;
     //numerical jacobian evaluation
     casadi::Function NumJacobian;
+    //numerical state transition and sensitivity
+    casadi::Function NumTransition;
 
     casadi::Function AeroDynamics;
 };
@@ -159,6 +163,7 @@ public:
     casadi::Function getNumericIntegrator() {return NumIntegartor;}
     casadi::Function getNumericJacobian() {return NumJacobian;}
     casadi::Function getNumericDynamcis() {return NumDynamics;}
+    casadi::Function getNumericTransition() {return NumTransition;}
 
 private:
     casadi::SX state;
@@ -170,6 +175,8 @@ private:
     casadi::Function NumJacobian;
     /** numerical evaluation of system dynamics */
     casadi::Function NumDynamics;
+    /** RK4 step with exact transition matrix */
+    casadi::Function NumTransition;
 };
 
 
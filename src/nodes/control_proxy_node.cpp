@@ -1,12 +1,58 @@
 #include <control_proxy_node.hpp>
 
 void ControlProxyNode::controlCallback(const openkite::aircraft_controls::ConstPtr& msg)
+{
+    set_controls(msg->thrust, msg->elevator, msg->rudder, msg->ailerons);
+    trace = msg->trace;
+    trace_pending = true;
+}
+
+void ControlProxyNode::publish()
+{
+    proxy_pub.publish(servo_msg);
+    if(trace_pending)
+    {
+        trace.t_control_proxy = ros::Time::now().toSec();
+        trace_pub.publish(trace);
+        trace_pending = false;
+    }
+}
+
+void ControlProxyNode::set_controls(const double &thrust, const double &elevator,
+                                    const double &rudder, const double &ailerons)
 {
     /** transform data */
-    servo_msg.data[0] = static_cast<int16_t> (1100 + (800 / 0.15) * msg->thrust);
-    servo_msg.data[1] = static_cast<int16_t> (1500 + (400 / 0.26) * msg->rudder);
-    servo_msg.data[2] = static_cast<int16_t> (1500 + (400 / 0.26) * msg->elevator);
-    servo_msg.data[3] = static_cast<int16_t> (1500 + (400 / 0.26) * msg->ailerons);
+    uint16_t pulses[servo_protocol::NUM_CHANNELS];
+    servo_protocol::controls_to_pulses(thrust, elevator, rudder, ailerons, pulses);
+    for(int i = 0; i < servo_protocol::NUM_CHANNELS; ++i)
+        servo_msg.data[i] = static_cast<int16_t>(pulses[i]);
+}
+
+void ControlProxyNode::poll_control_bus()
+{
+    if(shm_control_name.empty())
+        return;
+
+    /** the controller may start later : open the segment on demand */
+    if(!control_bus)
+    {
+        try
+        {
+            control_bus = std::make_shared<ShmControlChannel>(shm_control_name, ShmControlChannel::READER);
+        }
+        catch(const std::runtime_error &e)
+        {
+            ROS_WARN_THROTTLE(5.0, "%s", e.what());
+            return;
+        }
+    }
+
+    ControlRecord record;
+    if(control_bus->readNew(record, last_control_sequence))
+    {
+        last_control_sequence = record.sequence;
+        set_controls(record.control[0], record.control[1], record.control[2], record.control[3]);
+    }
 }
 
 ControlProxyNode::ControlProxyNode(const ros::NodeHandle &_nh)
@@ -14,6 +60,8 @@ ControlProxyNode::ControlProxyNode(const ros::NodeHandle &_nh)
     nh = std::make_shared<ros::NodeHandle>(_nh);
     proxy_sub = nh->subscribe("kite_controls", 100, &ControlProxyNode::controlCallback, this);
     proxy_pub = nh->advertise<std_msgs::Int16MultiArray>("servo_controls", 100);
+    trace_pub = nh->advertise<openkite::latency_trace>("/latency_trace", 100);
+    trace_pending = false;
 
     /** array initialization */
     servo_msg.layout.dim.push_back(std_msgs::MultiArrayDimension());
@@ -24,6 +72,10 @@ ControlProxyNode::ControlProxyNode(const ros::NodeHandle &_nh)
     servo_msg.data.reserve(4);
 
     set_servos(1100, 1500, 1500, 1500);
+
+    /** shared memory segment name, empty disables */
+    nh->param<std::string>("shm_control", shm_control_name, "");
+    last_control_sequence = 0;
 }
 
 int main(int argc, char **argv)
@@ -58,8 +110,9 @@ int main(int argc, char **argv)
             ++counter;
         }
 
-        proxy.publish();
         ros::spinOnce();
+        proxy.poll_control_bus();
+        proxy.publish();
         loop_rate.sleep();
     }
 
@@ -5,7 +5,10 @@
 #include "std_msgs/Int32MultiArray.h"
 #include "std_msgs/Int16MultiArray.h"
 #include "openkite/aircraft_controls.h"
+#include "openkite/latency_trace.h"
 #include "boost/thread/mutex.hpp"
+#include "shm_state_bus.hpp"
+#include "servo_protocol.h"
 
 class ControlProxyNode
 {
@@ -13,7 +16,7 @@ public:
     ControlProxyNode(const ros::NodeHandle &_nh);
     virtual ~ControlProxyNode(){}
 
-    void publish(){ proxy_pub.publish(servo_msg); }
+    void publish();
     void set_servos(const int &thrust, const int &elevator,
                     const int &rudder, const int &ailerons)
     {
@@ -23,14 +26,28 @@ public:
         servo_msg.data.push_back( static_cast<uint16_t>(elevator) );
         servo_msg.data.push_back( static_cast<uint16_t>(ailerons) );
     }
+    /** control surface deflections to servo commands */
+    void set_controls(const double &thrust, const double &elevator,
+                      const double &rudder, const double &ailerons);
+    /** take the latest controls from shared memory if "shm_control" is set */
+    void poll_control_bus();
 
 private:
     std_msgs::Int16MultiArray servo_msg;
     void controlCallback(const openkite::aircraft_controls::ConstPtr& msg);
     ros::Subscriber proxy_sub;
     ros::Publisher proxy_pub;
+
+    /** latency tracing : completed on the first publish of a new control, published on /latency_trace */
+    ros::Publisher trace_pub;
+    openkite::latency_trace trace;
+    bool trace_pending;
     std::shared_ptr<ros::NodeHandle> nh;
 
+    std::string shm_control_name;
+    std::shared_ptr<ShmControlChannel> control_bus;
+    uint64_t last_control_sequence;
+
     boost::mutex m_mutex;
 };
 
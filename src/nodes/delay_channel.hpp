@@ -0,0 +1,174 @@
+#ifndef DELAY_CHANNEL_HPP
+#define DELAY_CHANNEL_HPP
+
+#include <queue>
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+
+/** Random transport delay of a communication link */
+class DelayModel
+{
+public:
+    enum Distribution {CONSTANT, UNIFORM, NORMAL, EMPIRICAL};
+
+    /** mean and deviation in seconds : uniform on [mean - deviation, mean + deviation], normal with std deviation */
+    DelayModel(const Distribution &type = CONSTANT, const double &mean = 0.0, const double &deviation = 0.0)
+        : m_type(type), m_mean(mean), m_deviation(deviation) {}
+
+    /** empirical distribution : histogram of measured delays in seconds */
+    static DelayModel fromSamples(const std::vector<double> &samples, const int &num_bins = 50)
+    {
+        if(samples.empty() || (num_bins < 1))
+            throw std::runtime_error("DelayModel: empty delay histogram");
+
+        const double lo = *std::min_element(samples.begin(), samples.end());
+        const double hi = *std::max_element(samples.begin(), samples.end());
+        const double width = (hi > lo) ? (hi - lo) / num_bins : 1e-6;
+
+        DelayModel model(EMPIRICAL);
+        model.m_edges.resize(num_bins + 1);
+        model.m_weights.assign(num_bins, 0.0);
+        for(int i = 0; i <= num_bins; ++i)
+            model.m_edges[i] = lo + i * width;
+        for(const double &sample : samples)
+            model.m_weights[std::min(num_bins - 1, static_cast<int>((sample - lo) / width))] += 1.0;
+        return model;
+    }
+
+    /** delay samples one per line, scale converts to seconds */
+    static DelayModel fromFile(const std::string &filename, const double &scale = 1.0, const int &num_bins = 50)
+    {
+        std::ifstream file(filename);
+        if(!file.is_open())
+            throw std::runtime_error("DelayModel: could not open delay histogram file: " + filename);
+        std::vector<double> samples;
+        double value;
+        while(file >> value)
+            samples.push_back(scale * value);
+        return fromSamples(samples, num_bins);
+    }
+
+    static Distribution distribution(const std::string &name)
+    {
+        if(name == "constant")  return CONSTANT;
+        if(name == "uniform")   return UNIFORM;
+        if(name == "normal")    return NORMAL;
+        if(name == "empirical") return EMPIRICAL;
+        throw std::runtime_error("DelayModel: unknown delay distribution: " + name);
+    }
+
+    /** non-negative delay sample */
+    template<typename Generator>
+    double sample(Generator &generator) const
+    {
+        double delay = m_mean;
+        switch(m_type)
+        {
+        case UNIFORM:
+            delay = std::uniform_real_distribution<double>(m_mean - m_deviation, m_mean + m_deviation)(generator);
+            break;
+        case NORMAL:
+            delay = std::normal_distribution<double>(m_mean, m_deviation)(generator);
+            break;
+        case EMPIRICAL:
+            delay = std::piecewise_constant_distribution<double>(m_edges.begin(), m_edges.end(), m_weights.begin())(generator);
+            break;
+        default:
+            break;
+        }
+        return std::max(0.0, delay);
+    }
+
+private:
+    Distribution m_type;
+    double m_mean;
+    double m_deviation;
+    std::vector<double> m_edges;
+    std::vector<double> m_weights;
+};
+
+/** Transport delay emulator : every message gets its own delivery time and any number of messages
+ *  can be in flight. Pending messages are kept in a priority queue ordered by the delivery time.
+ *  With reordering disabled the link is FIFO : a message is never delivered before its predecessor.
+ *  Times are in seconds on any monotonic clock; not thread safe, the caller serializes access.
+ *  A fixed seed makes the delays and losses reproducible.
+ */
+template<typename T>
+class DelayChannel
+{
+public:
+    DelayChannel(const DelayModel &model, const unsigned &seed = std::random_device()())
+        : m_model(model), m_generator(seed), m_loss(0.0), m_reorder(false), m_last_delivery(-std::numeric_limits<double>::infinity()),
+          m_sequence(0), m_sent(0), m_lost(0) {}
+
+    /** probability of losing a message */
+    void setLoss(const double &probability){m_loss = probability;}
+    /** allow independent delays to overtake each other */
+    void setReorder(const bool &enable){m_reorder = enable;}
+
+    /** returns false if the message is lost */
+    bool push(const T &message, const double &t_now)
+    {
+        ++m_sent;
+        const double delay = m_model.sample(m_generator);
+        if((m_loss > 0) && (std::uniform_real_distribution<double>(0.0, 1.0)(m_generator) < m_loss))
+        {
+            ++m_lost;
+            return false;
+        }
+
+        double delivery = t_now + delay;
+        if(!m_reorder)
+            delivery = std::max(delivery, m_last_delivery);
+        m_last_delivery = std::max(m_last_delivery, delivery);
+
+        m_queue.push(Pending{delivery, m_sequence++, message});
+        return true;
+    }
+
+    /** pop one message due at t_now */
+    bool pop(T &message, const double &t_now)
+    {
+        if(m_queue.empty() || (m_queue.top().delivery > t_now))
+            return false;
+        message = m_queue.top().message;
+        m_queue.pop();
+        return true;
+    }
+
+    /** delivery time of the next message, infinity if nothing is in flight */
+    double nextDelivery() const {return m_queue.empty() ? std::numeric_limits<double>::infinity() : m_queue.top().delivery;}
+    size_t inFlight() const {return m_queue.size();}
+    size_t sent() const {return m_sent;}
+    size_t lost() const {return m_lost;}
+
+private:
+    struct Pending
+    {
+        double delivery;
+        unsigned long sequence;
+        T message;
+
+        /** earliest delivery on top, ties in sending order */
+        bool operator<(const Pending &other) const
+        {
+            return (delivery != other.delivery) ? (delivery > other.delivery) : (sequence > other.sequence);
+        }
+    };
+
+    DelayModel m_model;
+    std::mt19937 m_generator;
+    double m_loss;
+    bool m_reorder;
+    double m_last_delivery;
+    unsigned long m_sequence;
+    size_t m_sent;
+    size_t m_lost;
+    std::priority_queue<Pending> m_queue;
+};
+
+#endif // DELAY_CHANNEL_HPP
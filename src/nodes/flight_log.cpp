@@ -0,0 +1,244 @@
+#include "flight_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flight_log
+{
+    namespace
+    {
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t header_size;
+            uint32_t num_columns;
+            uint32_t block_rows;
+            uint32_t reserved;
+            char stream[NAME_SIZE];
+        };
+
+        struct BlockHeader
+        {
+            uint32_t magic;
+            uint32_t rows;
+        };
+
+        void copy_name(const std::string &name, char *buffer)
+        {
+            std::memset(buffer, 0, NAME_SIZE);
+            std::strncpy(buffer, name.c_str(), NAME_SIZE - 1);
+        }
+    }
+
+    FlightLogger::FlightLogger(const int &block_rows) : m_block_rows(std::max(1, block_rows)), m_running(false)
+    {
+    }
+
+    FlightLogger::~FlightLogger()
+    {
+        close();
+    }
+
+    int FlightLogger::addStream(const std::string &filename, const std::string &stream_name, const std::vector<std::string> &columns)
+    {
+        if(m_running)
+            throw std::runtime_error("FlightLogger: streams must be added before logging starts");
+        if(columns.empty() || (columns.size() > MAX_COLUMNS))
+            throw std::runtime_error("FlightLogger: unsupported number of columns in stream: " + stream_name);
+
+        FILE *file = std::fopen(filename.c_str(), "wb");
+        if(!file)
+            throw std::runtime_error("FlightLogger: could not create log file: " + filename);
+
+        FileHeader header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.header_size = static_cast<uint32_t>(sizeof(FileHeader) + NAME_SIZE * columns.size());
+        header.num_columns = static_cast<uint32_t>(columns.size());
+        header.block_rows  = static_cast<uint32_t>(m_block_rows);
+        header.reserved    = 0;
+        copy_name(stream_name, header.stream);
+        std::fwrite(&header, sizeof(header), 1, file);
+
+        char name[NAME_SIZE];
+        for(const std::string &column : columns)
+        {
+            copy_name(column, name);
+            std::fwrite(name, NAME_SIZE, 1, file);
+        }
+
+        std::unique_ptr<Stream> stream(new Stream());
+        stream->file = file;
+        stream->num_columns = columns.size();
+        stream->rows = 0;
+        stream->block.resize(columns.size() * m_block_rows);
+        m_streams.push_back(std::move(stream));
+        return static_cast<int>(m_streams.size()) - 1;
+    }
+
+    bool FlightLogger::log(const int &stream, const double *values)
+    {
+        /** the writer thread is started by the first row */
+        std::call_once(m_started, [this]()
+        {
+            m_running = true;
+            m_writer = std::thread(&FlightLogger::writerLoop, this);
+        });
+
+        Row row;
+        std::memcpy(row.values, values, sizeof(double) * m_streams[stream]->num_columns);
+        return m_streams[stream]->queue.push(row);
+    }
+
+    void FlightLogger::close()
+    {
+        if(m_running)
+        {
+            m_running = false;
+            m_writer.join();
+        }
+
+        for(std::unique_ptr<Stream> &stream : m_streams)
+        {
+            if(!stream->file)
+                continue;
+            drain(*stream);
+            writeBlock(*stream);
+            std::fclose(stream->file);
+            stream->file = nullptr;
+        }
+    }
+
+    void FlightLogger::writerLoop()
+    {
+        while(m_running)
+        {
+            bool idle = true;
+            for(std::unique_ptr<Stream> &stream : m_streams)
+                idle = !drain(*stream) && idle;
+            if(idle)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    bool FlightLogger::drain(Stream &stream)
+    {
+        /** transpose rows into the column block */
+        Row row;
+        bool received = false;
+        while(stream.queue.pop(row))
+        {
+            received = true;
+            for(size_t c = 0; c < stream.num_columns; ++c)
+                stream.block[c * m_block_rows + stream.rows] = row.values[c];
+            if(++stream.rows == static_cast<size_t>(m_block_rows))
+                writeBlock(stream);
+        }
+        return received;
+    }
+
+    void FlightLogger::writeBlock(Stream &stream)
+    {
+        if(stream.rows == 0)
+            return;
+
+        BlockHeader header = {BLOCK_MAGIC, static_cast<uint32_t>(stream.rows)};
+        std::fwrite(&header, sizeof(header), 1, stream.file);
+        for(size_t c = 0; c < stream.num_columns; ++c)
+            std::fwrite(&stream.block[c * m_block_rows], sizeof(double), stream.rows, stream.file);
+        stream.rows = 0;
+    }
+
+    //-----------------------------------------------------------------//
+
+    FlightLogReader::FlightLogReader(const std::string &filename) : m_address(nullptr), m_size(0), m_rows(0)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("FlightLogReader: could not open log file: " + filename);
+
+        struct stat info;
+        if((fstat(fd, &info) != 0) || (static_cast<size_t>(info.st_size) < sizeof(FileHeader)))
+        {
+            ::close(fd);
+            throw std::runtime_error("FlightLogReader: not a flight log: " + filename);
+        }
+        m_size = info.st_size;
+        m_address = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(m_address == MAP_FAILED)
+        {
+            m_address = nullptr;
+            throw std::runtime_error("FlightLogReader: could not map log file: " + filename);
+        }
+
+        const char *base = static_cast<const char*>(m_address);
+        const FileHeader *header = reinterpret_cast<const FileHeader*>(base);
+        if((std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) || (header->header_size > m_size) ||
+           (header->header_size != sizeof(FileHeader) + NAME_SIZE * header->num_columns))
+        {
+            munmap(m_address, m_size);
+            m_address = nullptr;
+            throw std::runtime_error("FlightLogReader: not a flight log: " + filename);
+        }
+
+        m_stream = std::string(header->stream, strnlen(header->stream, NAME_SIZE));
+        const char *names = base + sizeof(FileHeader);
+        for(uint32_t c = 0; c < header->num_columns; ++c)
+            m_columns.push_back(std::string(names + c * NAME_SIZE, strnlen(names + c * NAME_SIZE, NAME_SIZE)));
+
+        /** block index */
+        size_t offset = header->header_size;
+        while(offset + sizeof(BlockHeader) <= m_size)
+        {
+            const BlockHeader *block = reinterpret_cast<const BlockHeader*>(base + offset);
+            size_t data_size = sizeof(double) * m_columns.size() * block->rows;
+            if((block->magic != BLOCK_MAGIC) || (offset + sizeof(BlockHeader) + data_size > m_size))
+                break;
+
+            Block entry;
+            entry.first_row = m_rows;
+            entry.rows = block->rows;
+            entry.data = reinterpret_cast<const double*>(base + offset + sizeof(BlockHeader));
+            m_blocks.push_back(entry);
+            m_rows += block->rows;
+            offset += sizeof(BlockHeader) + data_size;
+        }
+    }
+
+    FlightLogReader::~FlightLogReader()
+    {
+        if(m_address)
+            munmap(m_address, m_size);
+    }
+
+    int FlightLogReader::column(const std::string &name) const
+    {
+        std::vector<std::string>::const_iterator it = std::find(m_columns.begin(), m_columns.end(), name);
+        return (it == m_columns.end()) ? -1 : static_cast<int>(std::distance(m_columns.begin(), it));
+    }
+
+    double FlightLogReader::value(const size_t &row, const size_t &col) const
+    {
+        /** blocks are sorted by their first row */
+        std::vector<Block>::const_iterator it = std::upper_bound(m_blocks.begin(), m_blocks.end(), row,
+                                                [](const size_t &r, const Block &b){return r < b.first_row;});
+        const Block &block = *(--it);
+        return block.data[col * block.rows + (row - block.first_row)];
+    }
+
+    std::vector<double> FlightLogReader::columnValues(const size_t &col) const
+    {
+        std::vector<double> values;
+        values.reserve(m_rows);
+        for(const Block &block : m_blocks)
+            values.insert(values.end(), block.data + col * block.rows, block.data + (col + 1) * block.rows);
+        return values;
+    }
+}
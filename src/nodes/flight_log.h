@@ -0,0 +1,138 @@
+#ifndef FLIGHT_LOG_H
+#define FLIGHT_LOG_H
+
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Binary columnar flight log.
+ *  One file per stream : a schema header followed by blocks of rows stored column by column, all values
+ *  are little endian doubles so that a column of a block is a contiguous array in a memory-mapped file.
+ *
+ *  header : | "OKFLOG01" | u32 header_size | u32 num_columns | u32 block_rows | u32 reserved |
+ *           | char stream[32] | char columns[num_columns][32] |
+ *  block  : | u32 0x4B4C4F42 | u32 rows | double data[num_columns][rows] |
+ *
+ *  A truncated last block (e.g. after a crash) is ignored by the reader.
+ */
+namespace flight_log
+{
+    enum
+    {
+        NAME_SIZE   = 32,
+        MAX_COLUMNS = 32,
+        BLOCK_MAGIC = 0x4B4C4F42
+    };
+
+    static const char MAGIC[8] = {'O', 'K', 'F', 'L', 'O', 'G', '0', '1'};
+
+    struct Row
+    {
+        double values[MAX_COLUMNS];
+    };
+
+    /** Asynchronous writer : log() copies a row into a lock-free queue and returns, a background
+     *  thread transposes rows into column blocks and writes them. log() may be called from one thread
+     *  per stream (e.g. the ROS callback thread), streams are served by the same writer thread.
+     */
+    class FlightLogger
+    {
+    public:
+        FlightLogger(const int &block_rows = 1024);
+        virtual ~FlightLogger();
+
+        /** create "<filename>" for a stream, returns the stream id */
+        int addStream(const std::string &filename, const std::string &stream_name, const std::vector<std::string> &columns);
+
+        /** values has as many entries as the stream columns; false if the queue was full and the row dropped */
+        bool log(const int &stream, const double *values);
+
+        /** flush the rows queued so far, stop the writer thread and close the files : no logging afterwards */
+        void close();
+
+        size_t dropped(const int &stream) const {return m_streams[stream]->queue.dropped();}
+
+    private:
+        typedef SPSCRing<Row, 4096> RowQueue;
+
+        struct Stream
+        {
+            FILE *file;
+            size_t num_columns;
+            size_t rows;
+            std::vector<double> block;
+            RowQueue queue;
+        };
+
+        std::vector<std::unique_ptr<Stream>> m_streams;
+        int m_block_rows;
+        std::atomic<bool> m_running;
+        std::once_flag m_started;
+        std::thread m_writer;
+
+        void writerLoop();
+        bool drain(Stream &stream);
+        void writeBlock(Stream &stream);
+    };
+
+    /** Memory-mapped reader */
+    class FlightLogReader
+    {
+    public:
+        explicit FlightLogReader(const std::string &filename);
+        virtual ~FlightLogReader();
+
+        FlightLogReader(const FlightLogReader&) = delete;
+        FlightLogReader& operator=(const FlightLogReader&) = delete;
+
+        const std::string& stream() const {return m_stream;}
+        const std::vector<std::string>& columns() const {return m_columns;}
+        /** column index by name, -1 if not found */
+        int column(const std::string &name) const;
+
+        size_t rows() const {return m_rows;}
+        size_t blocks() const {return m_blocks.size();}
+
+        /** rows of block b, column c is the contiguous array blockData(b) + c * blockRows(b) */
+        size_t blockRows(const size_t &b) const {return m_blocks[b].rows;}
+        const double* blockData(const size_t &b) const {return m_blocks[b].data;}
+
+        double value(const size_t &row, const size_t &col) const;
+        std::vector<double> columnValues(const size_t &col) const;
+
+    private:
+        struct Block
+        {
+            size_t first_row;
+            size_t rows;
+            const double *data;
+        };
+
+        void *m_address;
+        size_t m_size;
+        std::string m_stream;
+        std::vector<std::string> m_columns;
+        std::vector<Block> m_blocks;
+        size_t m_rows;
+    };
+
+    /** control stream : servo channels of /chatter (std_msgs::Int16MultiArray::data), missing channels are zero */
+    static const std::vector<std::string> CONTROL_COLUMNS = {"t", "ch0", "ch1", "ch2", "ch3"};
+
+    template<typename Channels>
+    void control_row(const double &t, const Channels &channels, double *row)
+    {
+        row[0] = t;
+        for(size_t i = 1; i < CONTROL_COLUMNS.size(); ++i)
+            row[i] = (i <= channels.size()) ? static_cast<double>(channels[i - 1]) : 0.0;
+    }
+}
+
+#endif // FLIGHT_LOG_H
@@ -0,0 +1,93 @@
+#include "flight_log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+/** Reader and converter for the binary flight logs written by simple_logger
+ *  flight_log_tool info <file.oklog>               : schema, rows, time span
+ *  flight_log_tool text <file.oklog> [output.log]  : space separated text, one row per line
+ */
+namespace
+{
+    void print_info(const flight_log::FlightLogReader &reader)
+    {
+        std::cout << "stream  : " << reader.stream() << "\n";
+        std::cout << "rows    : " << reader.rows() << " in " << reader.blocks() << " blocks \n";
+        std::cout << "columns : ";
+        for(const std::string &name : reader.columns())
+            std::cout << name << " ";
+        std::cout << "\n";
+
+        if(reader.rows() > 0)
+        {
+            double t0 = reader.value(0, 0), tf = reader.value(reader.rows() - 1, 0);
+            std::printf("%s : %.6f .. %.6f (%.3f [s], %.1f [Hz]) \n", reader.columns()[0].c_str(), t0, tf, tf - t0,
+                        (tf > t0) ? (reader.rows() - 1) / (tf - t0) : 0.0);
+        }
+    }
+
+    void write_text(const flight_log::FlightLogReader &reader, FILE *out)
+    {
+        std::fprintf(out, "#");
+        for(const std::string &name : reader.columns())
+            std::fprintf(out, " %s", name.c_str());
+        std::fprintf(out, "\n");
+
+        /** block by block : columns are contiguous, rows are strided */
+        const size_t num_columns = reader.columns().size();
+        for(size_t b = 0; b < reader.blocks(); ++b)
+        {
+            const size_t rows = reader.blockRows(b);
+            const double *data = reader.blockData(b);
+            for(size_t r = 0; r < rows; ++r)
+            {
+                for(size_t c = 0; c < num_columns; ++c)
+                    std::fprintf(out, (c == 0) ? "%.8f" : " %.8f", data[c * rows + r]);
+                std::fprintf(out, "\n");
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        std::cout << "usage: flight_log_tool info <file.oklog> \n"
+                  << "       flight_log_tool text <file.oklog> [output.log] \n";
+        return 1;
+    }
+
+    try
+    {
+        flight_log::FlightLogReader reader(argv[2]);
+
+        if(std::strcmp(argv[1], "info") == 0)
+        {
+            print_info(reader);
+        }
+        else if(std::strcmp(argv[1], "text") == 0)
+        {
+            FILE *out = (argc > 3) ? std::fopen(argv[3], "w") : stdout;
+            if(!out)
+                throw std::runtime_error(std::string("flight_log_tool: could not create output file: ") + argv[3]);
+            write_text(reader, out);
+            if(out != stdout)
+                std::fclose(out);
+        }
+        else
+        {
+            std::cout << "flight_log_tool: unknown command: " << argv[1] << "\n";
+            return 1;
+        }
+    }
+    catch(const std::exception &e)
+    {
+        std::cout << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -232,31 +232,28 @@ DM KiteVisualizer::convertToDM(const sensor_msgs::MultiDOFJointState &_value, co
 
 DM KiteVisualizer::world2rviz(const DM &world_pose)
 {
+    static const double transform[4] = {0, 1, 0, 0};
+    static const double transform_inv[4] = {0, -1, 0, 0};
+    std::vector<double> world = world_pose.nonzeros();
     DM pose = DM::zeros(world_pose.size());
-    DM transform = DM::vertcat({0, 1, 0, 0});
+    double *rviz = pose.ptr();
+
     /** do only position transform if receive a point*/
     if(pose.size1() == 3)
     {
-        DM q_pose = quat_multiply(transform, DM::vertcat({0, world_pose}) );
-        DM tmp = quat_multiply(q_pose, quat_inverse(transform) );
-        pose = tmp(Slice(1,4), 0);
-
+        quat_transform(transform, world.data(), rviz);
         return pose;
     }
 
     /** position transform */
-    DM q_pose = quat_multiply(transform, DM::vertcat({0, world_pose(Slice(0,3), 0) }) );
-    DM tmp = quat_multiply(q_pose, quat_inverse(transform) );
-    pose(Slice(0,3), 0) = tmp(Slice(1,4), 0);
+    quat_transform(transform, world.data(), rviz);
     /** attitude transform */
-    pose(Slice(3,7),0) = quat_multiply(quat_multiply(transform, world_pose(Slice(3,7), 0)), quat_inverse(transform));
+    double tmp[4];
+    quat_multiply(transform, world.data() + 3, tmp);
+    quat_multiply(tmp, transform_inv, rviz + 3);
 
     if(pose.size1() == 10)
-    {
-        q_pose = quat_multiply(transform, DM::vertcat({0, world_pose(Slice(7,10), 0) }) );
-        tmp = quat_multiply(q_pose, quat_inverse(transform) );
-        pose(Slice(7,10), 0) = tmp(Slice(1,4), 0);
-    }
+        quat_transform(transform, world.data() + 7, rviz + 7);
 
     return pose;
 }
@@ -0,0 +1,139 @@
+#include "ros/ros.h"
+#include "openkite/latency_trace.h"
+#include "latency_histogram.hpp"
+#include "yaml-cpp/yaml.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+/** Collects the completed latency traces (/latency_trace, published by control_proxy_node or servo_serial_node)
+ *  and reports per stage latency histograms. On shutdown the report is written to "output" (if set) with
+ *  the delay to compensate in nmpf_node : the "percentile" of the actuation latency, measured from the mocap
+ *  sample, or from the start of the solve with prediction_source "service" (the estimator predicts from now).
+ *  The file can be loaded with rosparam to set the nmpf_node "delay".
+ */
+class LatencyCollector
+{
+public:
+    LatencyCollector(const ros::NodeHandle &_nh);
+    virtual ~LatencyCollector(){}
+
+    void traceCallback(const openkite::latency_trace::ConstPtr &msg);
+    void report();
+    void write(const std::string &filename);
+
+private:
+    struct Stage
+    {
+        std::string name;
+        double openkite::latency_trace::*from;
+        double openkite::latency_trace::*to;
+        LatencyHistogram histogram;
+    };
+
+    std::vector<Stage> stages;
+    LatencyHistogram end_to_end;
+    LatencyHistogram compensated;
+    std::string prediction_source;
+    double quantile;
+
+    std::shared_ptr<ros::NodeHandle> nh;
+    ros::Subscriber trace_sub;
+};
+
+LatencyCollector::LatencyCollector(const ros::NodeHandle &_nh)
+{
+    nh = std::make_shared<ros::NodeHandle>(_nh);
+    nh->param<std::string>("prediction_source", prediction_source, "");
+    nh->param<double>("percentile", quantile, 0.95);
+
+    typedef openkite::latency_trace T;
+    stages = {{"vrpn_to_ekf",    &T::t_vrpn_receive, &T::t_ekf_update,    LatencyHistogram()},
+              {"ekf_to_nmpf",    &T::t_ekf_update,   &T::t_nmpf_input,    LatencyHistogram()},
+              {"nmpf_solve",     &T::t_nmpf_input,   &T::t_nmpf_output,   LatencyHistogram()},
+              {"nmpf_to_proxy",  &T::t_nmpf_output,  &T::t_control_proxy, LatencyHistogram()},
+              {"nmpf_to_serial", &T::t_nmpf_output,  &T::t_serial_write,  LatencyHistogram()}};
+
+    trace_sub = nh->subscribe("/latency_trace", 1000, &LatencyCollector::traceCallback, this);
+}
+
+void LatencyCollector::traceCallback(const openkite::latency_trace::ConstPtr &msg)
+{
+    for(Stage &stage : stages)
+    {
+        if((msg->*stage.from > 0) && (msg->*stage.to > 0))
+            stage.histogram.add(msg->*stage.to - msg->*stage.from);
+    }
+
+    /** actuation : serial write or control proxy, whichever completed the trace */
+    const double t_actuation = (msg->t_serial_write > 0) ? msg->t_serial_write : msg->t_control_proxy;
+    if((t_actuation <= 0) || (msg->t_nmpf_input <= 0))
+        return;
+
+    end_to_end.add(t_actuation - msg->header.stamp.toSec());
+    compensated.add(t_actuation - ((prediction_source == "service") ? msg->t_nmpf_input : msg->header.stamp.toSec()));
+}
+
+void LatencyCollector::report()
+{
+    std::ostringstream out;
+    for(const Stage &stage : stages)
+    {
+        if(stage.histogram.count() > 0)
+            stage.histogram.print(out, stage.name);
+    }
+    end_to_end.print(out, "mocap_to_actuation");
+    out << "suggested nmpf_node delay : " << compensated.percentile(quantile) << " [s] \n";
+    ROS_INFO_STREAM("latency_collector: \n" << out.str());
+}
+
+void LatencyCollector::write(const std::string &filename)
+{
+    YAML::Emitter out;
+    out << YAML::BeginMap;
+    out << YAML::Key << "delay" << YAML::Value << compensated.percentile(quantile);
+    out << YAML::Key << "latency_ms" << YAML::Value << YAML::BeginMap;
+
+    auto emit = [&out](const std::string &name, const LatencyHistogram &histogram)
+    {
+        out << YAML::Key << name << YAML::Value << YAML::BeginMap;
+        out << YAML::Key << "count" << YAML::Value << histogram.count();
+        out << YAML::Key << "mean"  << YAML::Value << 1e3 * histogram.mean();
+        out << YAML::Key << "p50"   << YAML::Value << 1e3 * histogram.percentile(0.50);
+        out << YAML::Key << "p95"   << YAML::Value << 1e3 * histogram.percentile(0.95);
+        out << YAML::Key << "p99"   << YAML::Value << 1e3 * histogram.percentile(0.99);
+        out << YAML::Key << "max"   << YAML::Value << 1e3 * histogram.max();
+        out << YAML::EndMap;
+    };
+
+    for(const Stage &stage : stages)
+        emit(stage.name, stage.histogram);
+    emit("mocap_to_actuation", end_to_end);
+    out << YAML::EndMap;
+    out << YAML::EndMap;
+
+    std::ofstream fout(filename);
+    fout << out.c_str() << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "latency_collector");
+    ros::NodeHandle n("~");
+
+    std::string output;
+    double report_period;
+    n.param<std::string>("output", output, "");
+    n.param<double>("report_period", report_period, 10.0);
+
+    LatencyCollector collector(n);
+    ros::Timer timer = n.createTimer(ros::Duration(report_period), [&collector](const ros::TimerEvent&){collector.report();});
+    ros::spin();
+
+    collector.report();
+    if(!output.empty())
+        collector.write(output);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+
+/** Fixed bin latency histogram : constant time insertion at any message rate, percentiles are
+ *  resolved to the bin width. Latencies beyond the range are counted in the last bin.
+ */
+class LatencyHistogram
+{
+public:
+    /** bin width and range in seconds */
+    LatencyHistogram(const double &bin_width = 0.0005, const double &range = 0.5)
+        : m_bin_width(bin_width), m_bins(static_cast<size_t>(range / bin_width) + 1, 0), m_count(0), m_sum(0),
+          m_min(std::numeric_limits<double>::infinity()), m_max(-std::numeric_limits<double>::infinity()) {}
+
+    void add(const double &latency)
+    {
+        const size_t bin = (latency > 0) ? static_cast<size_t>(latency / m_bin_width) : 0;
+        ++m_bins[std::min(bin, m_bins.size() - 1)];
+        ++m_count;
+        m_sum += latency;
+        m_min = std::min(m_min, latency);
+        m_max = std::max(m_max, latency);
+    }
+
+    size_t count() const {return m_count;}
+    double mean() const {return m_count ? m_sum / m_count : 0.0;}
+    double min() const {return m_count ? m_min : 0.0;}
+    double max() const {return m_count ? m_max : 0.0;}
+
+    /** upper edge of the bin holding the p-quantile, p in [0, 1] */
+    double percentile(const double &p) const
+    {
+        if(m_count == 0)
+            return 0.0;
+        const double rank = std::max(1.0, p * m_count);
+        size_t cumulative = 0;
+        for(size_t i = 0; i < m_bins.size() - 1; ++i)
+        {
+            cumulative += m_bins[i];
+            if(cumulative >= rank)
+                return std::min((i + 1) * m_bin_width, m_max);
+        }
+        return m_max;
+    }
+
+    /** text histogram in milliseconds, bins merged to at most num_rows rows up to the maximum */
+    void print(std::ostream &out, const std::string &name, const int &num_rows = 20, const int &width = 50) const
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%s : %zu samples, mean %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f [ms]\n",
+                      name.c_str(), m_count, 1e3 * mean(), 1e3 * percentile(0.5), 1e3 * percentile(0.95),
+                      1e3 * percentile(0.99), 1e3 * max());
+        out << line;
+        if(m_count == 0)
+            return;
+
+        const size_t last = std::min(m_bins.size() - 1, static_cast<size_t>(max() / m_bin_width));
+        const size_t merge = last / num_rows + 1;
+        std::vector<size_t> rows;
+        for(size_t i = 0; i <= last; i += merge)
+        {
+            size_t count = 0;
+            for(size_t j = i; j < std::min(i + merge, m_bins.size()); ++j)
+                count += m_bins[j];
+            rows.push_back(count);
+        }
+
+        const size_t peak = *std::max_element(rows.begin(), rows.end());
+        for(size_t r = 0; r < rows.size(); ++r)
+        {
+            std::snprintf(line, sizeof(line), "  %7.2f - %7.2f | ", 1e3 * r * merge * m_bin_width, 1e3 * (r + 1) * merge * m_bin_width);
+            out << line << std::string(peak ? (width * rows[r]) / peak : 0, '#') << " " << rows[r] << "\n";
+        }
+    }
+
+private:
+    double m_bin_width;
+    std::vector<size_t> m_bins;
+    size_t m_count;
+    double m_sum;
+    double m_min;
+    double m_max;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,385 @@
+#include "spsc_ring.hpp"
+#include "shm_state_bus.hpp"
+#include "servo_protocol.h"
+#include "flight_log.h"
+#include "delay_channel.hpp"
+#include "latency_histogram.hpp"
+
+#define BOOST_TEST_MODULE nodes_test
+#include <boost/test/included/unit_test.hpp>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <termios.h>
+#include <poll.h>
+
+struct Sample
+{
+    double t_monotonic;
+    unsigned long seq;
+};
+
+BOOST_AUTO_TEST_CASE( spsc_ring_test )
+{
+    /** single thread : FIFO order and overflow */
+    SPSCRing<Sample, 8> small_ring;
+    Sample sample;
+    BOOST_CHECK(!small_ring.pop(sample));
+    for(unsigned long i = 0; i < 10; ++i)
+        small_ring.push(Sample{0.0, i});
+    BOOST_CHECK_EQUAL(small_ring.size(), 8u);
+    BOOST_CHECK_EQUAL(small_ring.dropped(), 2u);
+    for(unsigned long i = 0; i < 8; ++i)
+    {
+        BOOST_CHECK(small_ring.pop(sample));
+        BOOST_CHECK_EQUAL(sample.seq, i);
+    }
+    BOOST_CHECK(small_ring.empty());
+
+    /** producer / consumer threads : nothing lost or reordered, queueing delay.
+     *  Waiting sides yield : on a single core a busy spin holds the CPU for a whole time slice */
+    const unsigned long N = 100000;
+    static SPSCRing<Sample, 256> ring;
+    std::thread producer([&]()
+    {
+        for(unsigned long i = 0; i < N; ++i)
+        {
+            Sample s{std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(), i};
+            while(!ring.push(s))
+                std::this_thread::yield();
+        }
+    });
+
+    unsigned long expected = 0;
+    bool in_order = true;
+    double max_latency = 0;
+    while(expected < N)
+    {
+        if(!ring.pop(sample))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        max_latency = std::max(max_latency, now - sample.t_monotonic);
+        in_order = in_order && (sample.seq == expected);
+        ++expected;
+    }
+    producer.join();
+
+    std::cout << "SPSC ring : " << N << " samples, max queueing delay " << max_latency * 1e6 << " [us] \n";
+    BOOST_CHECK(in_order);
+    BOOST_CHECK(ring.empty());
+}
+
+BOOST_AUTO_TEST_CASE( shm_state_bus_test )
+{
+    /** writer in a child process at ~10 kHz, reader here : every record read must be consistent */
+    const std::string name = "openkite_nodes_test";
+    const uint64_t N = 20000;
+    ShmStateChannel::unlink(name);
+    ShmStateChannel bus(name, ShmStateChannel::WRITER);
+
+    pid_t pid = fork();
+    BOOST_REQUIRE(pid >= 0);
+    if(pid == 0)
+    {
+        ShmStateChannel writer(name, ShmStateChannel::WRITER);
+        StateRecord record;
+        for(uint64_t i = 1; i <= N; ++i)
+        {
+            record.t_stamp = static_cast<double>(i);
+            std::fill(record.state, record.state + 13, static_cast<double>(i));
+            writer.write(record);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        _exit(0);
+    }
+
+    ShmStateChannel reader(name, ShmStateChannel::READER);
+    StateRecord record;
+    uint64_t last_sequence = 0, received = 0;
+    bool consistent = true, monotonic = true;
+    double max_latency = 0;
+    while(last_sequence < N)
+    {
+        if(!reader.readNew(record, last_sequence))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        max_latency = std::max(max_latency, ShmStateChannel::monotonic_time() - record.t_monotonic);
+        monotonic = monotonic && (record.sequence > last_sequence);
+        for(int i = 0; i < 13; ++i)
+            consistent = consistent && (record.state[i] == record.t_stamp);
+        last_sequence = record.sequence;
+        ++received;
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    ShmStateChannel::unlink(name);
+
+    std::cout << "Shared memory bus : " << received << " of " << N << " records read, max age "
+              << max_latency * 1e6 << " [us] \n";
+    BOOST_CHECK(consistent);
+    BOOST_CHECK(monotonic);
+    BOOST_CHECK(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+
+namespace
+{
+    void make_raw(const int &fd)
+    {
+        termios tty;
+        tcgetattr(fd, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+
+    /** read one frame within timeout_ms */
+    bool read_frame(const int &fd, servo_protocol::FrameParser &parser, servo_protocol::Frame &frame, const int &timeout_ms)
+    {
+        pollfd pfd = {fd, POLLIN, 0};
+        while(poll(&pfd, 1, timeout_ms) > 0)
+        {
+            uint8_t byte;
+            if(read(fd, &byte, 1) != 1)
+                return false;
+            if(parser.push(byte, frame))
+                return true;
+        }
+        return false;
+    }
+}
+
+BOOST_AUTO_TEST_CASE( servo_protocol_test )
+{
+    /** pseudo-terminal loopback : the device side acknowledges every valid command */
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    BOOST_REQUIRE(master >= 0);
+    BOOST_REQUIRE((grantpt(master) == 0) && (unlockpt(master) == 0));
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    BOOST_REQUIRE(slave >= 0);
+    make_raw(master);
+    make_raw(slave);
+
+    const int N = 1000;
+    std::atomic<bool> done(false);
+    std::thread device([&]()
+    {
+        servo_protocol::FrameParser parser;
+        servo_protocol::Frame frame;
+        uint8_t buffer[servo_protocol::MAX_FRAME];
+        uint16_t pulses[servo_protocol::NUM_CHANNELS];
+        while(!done)
+        {
+            if(read_frame(master, parser, frame, 10) && servo_protocol::decode_command(frame, pulses))
+            {
+                size_t size = servo_protocol::encode_feedback(frame.seq, frame.seq, pulses, buffer);
+                if(write(master, buffer, size) != static_cast<ssize_t>(size))
+                    break;
+            }
+        }
+    });
+
+    servo_protocol::FrameParser parser;
+    servo_protocol::Frame frame;
+    uint8_t buffer[servo_protocol::MAX_FRAME];
+    uint16_t pulses[servo_protocol::NUM_CHANNELS], echo[servo_protocol::NUM_CHANNELS];
+    int acknowledged = 0;
+    double max_round_trip = 0;
+
+    for(int i = 0; i < N; ++i)
+    {
+        uint8_t seq = static_cast<uint8_t>(i);
+        servo_protocol::controls_to_pulses(0.1, 0.01 * (i % 20), -0.1, 0, pulses);
+        size_t size = servo_protocol::encode_command(seq, pulses, buffer);
+
+        /** every 10th frame is corrupted and must be dropped by the device */
+        bool corrupt = (i % 10 == 9);
+        if(corrupt)
+            buffer[6] ^= 0x40;
+
+        double sent = ShmStateChannel::monotonic_time();
+        BOOST_REQUIRE(write(slave, buffer, size) == static_cast<ssize_t>(size));
+        uint8_t ack;
+        if(read_frame(slave, parser, frame, corrupt ? 5 : 100) && servo_protocol::decode_feedback(frame, ack, echo))
+        {
+            max_round_trip = std::max(max_round_trip, ShmStateChannel::monotonic_time() - sent);
+            acknowledged += ((ack == seq) && std::equal(pulses, pulses + servo_protocol::NUM_CHANNELS, echo)) ? 1 : 0;
+        }
+    }
+    done = true;
+    device.join();
+    close(slave);
+    close(master);
+
+    std::cout << "Servo protocol : " << acknowledged << " of " << N << " commands acknowledged, max round trip "
+              << max_round_trip * 1e6 << " [us] \n";
+    BOOST_CHECK_EQUAL(acknowledged, N - N / 10);
+    BOOST_CHECK_EQUAL(parser.crc_errors(), 0u);
+
+    /** parser resynchronizes after garbage */
+    servo_protocol::FrameParser resync;
+    uint8_t garbage[] = {0x00, 0xA5, 0xA5, 0x5A, 0xFF};
+    size_t size = servo_protocol::encode_command(42, pulses, buffer);
+    int frames = 0;
+    for(uint8_t byte : garbage)
+        frames += resync.push(byte, frame) ? 1 : 0;
+    resync.reset();
+    for(size_t i = 0; i < size; ++i)
+        frames += resync.push(buffer[i], frame) ? 1 : 0;
+    BOOST_CHECK_EQUAL(frames, 1);
+    BOOST_CHECK_EQUAL(frame.seq, 42);
+}
+
+BOOST_AUTO_TEST_CASE( flight_log_test )
+{
+    /** write from a callback-like thread, read back through the mapped file */
+    const std::string filename = "/tmp/openkite_flight_log_test.oklog";
+    const int N = 10000;
+    {
+        flight_log::FlightLogger logger(1000);
+        int stream = logger.addStream(filename, "state", {"t", "x", "y"});
+        double row[3];
+        for(int i = 0; i < N; ++i)
+        {
+            row[0] = 0.01 * i; row[1] = i; row[2] = -i;
+            while(!logger.log(stream, row))
+                std::this_thread::yield();
+        }
+        logger.close();
+    }
+
+    flight_log::FlightLogReader reader(filename);
+    BOOST_CHECK_EQUAL(reader.stream(), "state");
+    BOOST_CHECK_EQUAL(reader.rows(), static_cast<size_t>(N));
+    BOOST_CHECK_EQUAL(reader.column("y"), 2);
+
+    std::vector<double> x = reader.columnValues(reader.column("x"));
+    bool consistent = (x.size() == static_cast<size_t>(N));
+    for(int i = 0; consistent && (i < N); ++i)
+        consistent = (x[i] == i) && (reader.value(i, 2) == -i);
+    BOOST_CHECK(consistent);
+
+    /** a truncated block is ignored */
+    BOOST_REQUIRE(truncate(filename.c_str(), 64 + 3 * 32 + 8 + 3 * 8 * 1000 + 100) == 0);
+    flight_log::FlightLogReader truncated(filename);
+    BOOST_CHECK_EQUAL(truncated.rows(), 1000u);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( control_log_test )
+{
+    /** /chatter payloads as received by simple_logger : full int16 range, short messages are zero padded */
+    const std::string filename = "/tmp/openkite_control_log_test.oklog";
+    const std::vector<std::vector<int16_t>> payloads = {{-32768, 1200, -4500, 32767}, {512, -1, 0, 7}, {300, 20}};
+    {
+        flight_log::FlightLogger logger(2);
+        int stream = logger.addStream(filename, "control", flight_log::CONTROL_COLUMNS);
+        double row[5];
+        for(size_t k = 0; k < payloads.size(); ++k)
+        {
+            flight_log::control_row(0.1 * k, payloads[k], row);
+            while(!logger.log(stream, row))
+                std::this_thread::yield();
+        }
+        logger.close();
+    }
+
+    flight_log::FlightLogReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.rows(), payloads.size());
+    bool consistent = true;
+    for(size_t k = 0; k < payloads.size(); ++k)
+    {
+        consistent = consistent && (reader.value(k, 0) == 0.1 * k);
+        for(int i = 0; i < 4; ++i)
+        {
+            double expected = (static_cast<size_t>(i) < payloads[k].size()) ? payloads[k][i] : 0.0;
+            std::vector<double> channel = reader.columnValues(reader.column("ch" + std::to_string(i)));
+            consistent = consistent && (channel[k] == expected);
+        }
+    }
+    BOOST_CHECK(consistent);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( delay_channel_test )
+{
+    /** 1 kHz input, 50 +- 20 ms delays : many messages in flight, delivered on time */
+    auto run = [](const bool &reorder, const double &loss, const unsigned &seed, std::vector<int> &order)
+    {
+        DelayChannel<int> channel(DelayModel(DelayModel::UNIFORM, 0.05, 0.02), seed);
+        channel.setReorder(reorder);
+        channel.setLoss(loss);
+
+        size_t max_in_flight = 0;
+        int msg;
+        for(int k = 0; k < 20000; ++k)
+        {
+            double t = 0.0005 * k;
+            if(k % 2 == 0)
+                channel.push(k / 2, t);
+            while(channel.pop(msg, t))
+                order.push_back(msg);
+            max_in_flight = std::max(max_in_flight, channel.inFlight());
+        }
+        return max_in_flight;
+    };
+
+    std::vector<int> fifo, fifo_again, reordered, lossy;
+    BOOST_CHECK_GT(run(false, 0.0, 42, fifo), 40u);
+    run(false, 0.0, 42, fifo_again);
+    run(true, 0.0, 42, reordered);
+    run(true, 0.1, 42, lossy);
+
+    /** seeded runs are identical, a FIFO link keeps the order */
+    BOOST_CHECK(fifo == fifo_again);
+    BOOST_CHECK(std::is_sorted(fifo.begin(), fifo.end()));
+    BOOST_CHECK_GT(fifo.size(), 9900u);
+    BOOST_CHECK(!std::is_sorted(reordered.begin(), reordered.end()));
+    BOOST_CHECK_CLOSE(static_cast<double>(lossy.size()), 0.9 * reordered.size(), 3.0);
+
+    /** empirical histogram reproduces the measured delays */
+    std::mt19937 generator(1);
+    std::vector<double> measured;
+    for(int i = 0; i < 10000; ++i)
+        measured.push_back((i % 2 == 0) ? 0.02 : 0.08);
+    DelayModel empirical = DelayModel::fromSamples(measured, 10);
+    double mean = 0, min = 1, max = 0;
+    for(int i = 0; i < 10000; ++i)
+    {
+        double delay = empirical.sample(generator);
+        mean += delay / 10000;
+        min = std::min(min, delay);
+        max = std::max(max, delay);
+    }
+    BOOST_CHECK_CLOSE(mean, 0.05, 5.0);
+    BOOST_CHECK_GE(min, 0.02);
+    BOOST_CHECK_LE(max, 0.08);
+}
+
+BOOST_AUTO_TEST_CASE( latency_histogram_test )
+{
+    /** uniform latencies 0 .. 100 ms : percentiles within one bin */
+    LatencyHistogram histogram(0.0005, 0.5);
+    for(int i = 1; i <= 1000; ++i)
+        histogram.add(1e-4 * i);
+    BOOST_CHECK_EQUAL(histogram.count(), 1000u);
+    BOOST_CHECK_CLOSE(histogram.mean(), 0.05005, 1e-6);
+    BOOST_CHECK_SMALL(histogram.percentile(0.5) - 0.05, 0.001);
+    BOOST_CHECK_SMALL(histogram.percentile(0.95) - 0.095, 0.001);
+    BOOST_CHECK_EQUAL(histogram.percentile(1.0), 0.1);
+
+    /** out of range latencies land in the last bin, percentiles are bounded by the maximum */
+    histogram.add(2.0);
+    BOOST_CHECK_EQUAL(histogram.max(), 2.0);
+    BOOST_CHECK_EQUAL(histogram.percentile(1.0), 2.0);
+
+    std::ostringstream out;
+    histogram.print(out, "test");
+    BOOST_CHECK(out.str().find("test : 1001 samples") == 0);
+}
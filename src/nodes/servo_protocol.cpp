@@ -0,0 +1,157 @@
+#include "servo_protocol.h"
+
+namespace servo_protocol
+{
+    namespace
+    {
+        inline void put_u16(const uint16_t &value, uint8_t *buffer)
+        {
+            buffer[0] = static_cast<uint8_t>(value & 0xFF);
+            buffer[1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        inline uint16_t get_u16(const uint8_t *buffer)
+        {
+            return static_cast<uint16_t>(buffer[0] | (buffer[1] << 8));
+        }
+
+        inline uint16_t to_pulse(const double &value)
+        {
+            return static_cast<uint16_t>(value < 0 ? 0 : (value > 65535 ? 65535 : value));
+        }
+    }
+
+    uint16_t crc16(const uint8_t *data, const size_t &size, uint16_t crc)
+    {
+        for(size_t i = 0; i < size; ++i)
+        {
+            crc ^= static_cast<uint16_t>(data[i]) << 8;
+            for(int bit = 0; bit < 8; ++bit)
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+        return crc;
+    }
+
+    size_t encode(const uint8_t &type, const uint8_t &seq, const uint8_t *payload, const uint8_t &length, uint8_t *buffer)
+    {
+        if(length > MAX_PAYLOAD)
+            return 0;
+
+        buffer[0] = SYNC0;
+        buffer[1] = SYNC1;
+        buffer[2] = type;
+        buffer[3] = seq;
+        buffer[4] = length;
+        for(uint8_t i = 0; i < length; ++i)
+            buffer[HEADER_SIZE + i] = payload[i];
+
+        put_u16(crc16(buffer + 2, HEADER_SIZE - 2 + length), buffer + HEADER_SIZE + length);
+        return HEADER_SIZE + length + CRC_SIZE;
+    }
+
+    size_t encode_command(const uint8_t &seq, const uint16_t pulses[NUM_CHANNELS], uint8_t *buffer)
+    {
+        uint8_t payload[2 * NUM_CHANNELS];
+        for(int i = 0; i < NUM_CHANNELS; ++i)
+            put_u16(pulses[i], payload + 2 * i);
+        return encode(COMMAND, seq, payload, sizeof(payload), buffer);
+    }
+
+    size_t encode_feedback(const uint8_t &seq, const uint8_t &ack, const uint16_t pulses[NUM_CHANNELS], uint8_t *buffer)
+    {
+        uint8_t payload[1 + 2 * NUM_CHANNELS];
+        payload[0] = ack;
+        for(int i = 0; i < NUM_CHANNELS; ++i)
+            put_u16(pulses[i], payload + 1 + 2 * i);
+        return encode(FEEDBACK, seq, payload, sizeof(payload), buffer);
+    }
+
+    bool decode_command(const Frame &frame, uint16_t pulses[NUM_CHANNELS])
+    {
+        if((frame.type != COMMAND) || (frame.length != 2 * NUM_CHANNELS))
+            return false;
+        for(int i = 0; i < NUM_CHANNELS; ++i)
+            pulses[i] = get_u16(frame.payload + 2 * i);
+        return true;
+    }
+
+    bool decode_feedback(const Frame &frame, uint8_t &ack, uint16_t pulses[NUM_CHANNELS])
+    {
+        if((frame.type != FEEDBACK) || (frame.length != 1 + 2 * NUM_CHANNELS))
+            return false;
+        ack = frame.payload[0];
+        for(int i = 0; i < NUM_CHANNELS; ++i)
+            pulses[i] = get_u16(frame.payload + 1 + 2 * i);
+        return true;
+    }
+
+    void controls_to_pulses(const double &thrust, const double &elevator, const double &rudder, const double &ailerons,
+                            uint16_t pulses[NUM_CHANNELS])
+    {
+        pulses[0] = to_pulse(1100 + (800 / 0.15) * thrust);
+        pulses[1] = to_pulse(1500 + (400 / 0.26) * rudder);
+        pulses[2] = to_pulse(1500 + (400 / 0.26) * elevator);
+        pulses[3] = to_pulse(1500 + (400 / 0.26) * ailerons);
+    }
+
+    //-----------------------------------------------------------------//
+
+    FrameParser::FrameParser() : m_state(WAIT_SYNC0), m_index(0), m_crc(0), m_crc_errors(0), m_frames(0)
+    {
+    }
+
+    bool FrameParser::push(const uint8_t &byte, Frame &frame)
+    {
+        switch(m_state)
+        {
+        case WAIT_SYNC0:
+            if(byte == SYNC0)
+                m_state = WAIT_SYNC1;
+            break;
+        case WAIT_SYNC1:
+            m_state = (byte == SYNC1) ? TYPE : ((byte == SYNC0) ? WAIT_SYNC1 : WAIT_SYNC0);
+            break;
+        case TYPE:
+            m_frame.type = byte;
+            m_state = SEQ;
+            break;
+        case SEQ:
+            m_frame.seq = byte;
+            m_state = LENGTH;
+            break;
+        case LENGTH:
+            m_frame.length = byte;
+            m_index = 0;
+            if(byte > MAX_PAYLOAD)
+                m_state = WAIT_SYNC0;
+            else
+                m_state = (byte == 0) ? CRC_LOW : PAYLOAD;
+            break;
+        case PAYLOAD:
+            m_frame.payload[m_index++] = byte;
+            if(m_index == m_frame.length)
+                m_state = CRC_LOW;
+            break;
+        case CRC_LOW:
+            m_crc = byte;
+            m_state = CRC_HIGH;
+            break;
+        case CRC_HIGH:
+        {
+            m_crc |= static_cast<uint16_t>(byte << 8);
+            m_state = WAIT_SYNC0;
+            uint8_t header[3] = {m_frame.type, m_frame.seq, m_frame.length};
+            uint16_t crc = crc16(m_frame.payload, m_frame.length, crc16(header, 3));
+            if(crc != m_crc)
+            {
+                ++m_crc_errors;
+                return false;
+            }
+            ++m_frames;
+            frame = m_frame;
+            return true;
+        }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SERVO_PROTOCOL_H
+#define SERVO_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+/** Binary serial protocol between the host and the PPM generator (arduino/servo_serial).
+ *  Frame : | 0xA5 | 0x5A | type | seq | length | payload[length] | crc16 (LE) |
+ *  The CRC-16/CCITT-FALSE is computed over type, seq, length and payload. Multi-byte fields are
+ *  little endian. The device answers every command with a FEEDBACK frame carrying the sequence
+ *  number of the last command it applied and the measured RC receiver pulses.
+ */
+namespace servo_protocol
+{
+    enum
+    {
+        SYNC0 = 0xA5,
+        SYNC1 = 0x5A,
+        HEADER_SIZE  = 5,
+        CRC_SIZE     = 2,
+        MAX_PAYLOAD  = 32,
+        MAX_FRAME    = HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE,
+        NUM_CHANNELS = 4
+    };
+
+    enum FrameType
+    {
+        COMMAND  = 0x01,  /** host -> device : NUM_CHANNELS servo pulses [us], uint16 */
+        FEEDBACK = 0x02   /** device -> host : acknowledged seq (uint8), NUM_CHANNELS measured pulses [us], uint16 */
+    };
+
+    struct Frame
+    {
+        uint8_t type;
+        uint8_t seq;
+        uint8_t length;
+        uint8_t payload[MAX_PAYLOAD];
+    };
+
+    uint16_t crc16(const uint8_t *data, const size_t &size, uint16_t crc = 0xFFFF);
+
+    /** writes the frame to buffer (at least MAX_FRAME bytes), returns the frame size or 0 if the payload is too long */
+    size_t encode(const uint8_t &type, const uint8_t &seq, const uint8_t *payload, const uint8_t &length, uint8_t *buffer);
+
+    size_t encode_command(const uint8_t &seq, const uint16_t pulses[NUM_CHANNELS], uint8_t *buffer);
+    size_t encode_feedback(const uint8_t &seq, const uint8_t &ack, const uint16_t pulses[NUM_CHANNELS], uint8_t *buffer);
+    bool decode_command(const Frame &frame, uint16_t pulses[NUM_CHANNELS]);
+    bool decode_feedback(const Frame &frame, uint8_t &ack, uint16_t pulses[NUM_CHANNELS]);
+
+    /** control inputs [thrust, elevator, rudder, ailerons] to servo pulses in channel order [thrust, rudder, elevator, ailerons] */
+    void controls_to_pulses(const double &thrust, const double &elevator, const double &rudder, const double &ailerons,
+                            uint16_t pulses[NUM_CHANNELS]);
+
+    /** Incremental frame parser : feed received bytes one by one, resynchronizes on garbage and CRC errors */
+    class FrameParser
+    {
+    public:
+        FrameParser();
+        virtual ~FrameParser(){}
+
+        /** returns true when byte completes a valid frame */
+        bool push(const uint8_t &byte, Frame &frame);
+        void reset(){m_state = WAIT_SYNC0;}
+
+        size_t crc_errors() const {return m_crc_errors;}
+        size_t frames() const {return m_frames;}
+
+    private:
+        enum State {WAIT_SYNC0, WAIT_SYNC1, TYPE, SEQ, LENGTH, PAYLOAD, CRC_LOW, CRC_HIGH};
+        State m_state;
+        Frame m_frame;
+        uint8_t m_index;
+        uint16_t m_crc;
+        size_t m_crc_errors;
+        size_t m_frames;
+    };
+}
+
+#endif // SERVO_PROTOCOL_H
@@ -0,0 +1,191 @@
+#include "servo_serial_node.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    double monotonic_seconds()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+ServoSerialNode::ServoSerialNode(const ros::NodeHandle &_nh) : m_seq(0), m_running(false), m_last_report(0)
+{
+    nh = std::make_shared<ros::NodeHandle>(_nh);
+
+    std::string port_name;
+    int baud_rate;
+    double keepalive_rate;
+    nh->param<std::string>("port", port_name, "/dev/ttyUSB0");
+    nh->param<int>("baud", baud_rate, 250000);
+    nh->param<double>("keepalive_rate", keepalive_rate, 10.0);
+    nh->param<double>("report_period", report_period, 5.0);
+
+    for(int i = 0; i < 256; ++i)
+    {
+        m_send_time[i] = 0.0;
+        m_queue_time[i] = 0.0;
+    }
+    servo_protocol::controls_to_pulses(0, 0, 0, 0, m_pulses);
+
+    /** short read timeout : the receive thread polls m_running between reads */
+    port = std::make_shared<serial::Serial>(port_name, static_cast<uint32_t>(baud_rate), serial::Timeout::simpleTimeout(10));
+    if(!port->isOpen())
+        throw std::runtime_error("servo_serial_node: could not open serial port: " + port_name);
+    port->flushInput();
+
+    feedback_pub = nh->advertise<std_msgs::Int16MultiArray>("/chatter", 100);
+    latency_pub  = nh->advertise<std_msgs::Float64MultiArray>("serial_latency", 100);
+    trace_pub    = nh->advertise<openkite::latency_trace>("/latency_trace", 100);
+    control_sub  = nh->subscribe("/kite_controls", 1, &ServoSerialNode::controlCallback, this,
+                                 ros::TransportHints().tcpNoDelay());
+    if(keepalive_rate > 0)
+        keepalive_timer = nh->createTimer(ros::Duration(1.0 / keepalive_rate), &ServoSerialNode::keepaliveCallback, this);
+
+    m_running = true;
+    read_thread = std::thread(&ServoSerialNode::readLoop, this);
+}
+
+ServoSerialNode::~ServoSerialNode()
+{
+    m_running = false;
+    if(read_thread.joinable())
+        read_thread.join();
+}
+
+void ServoSerialNode::controlCallback(const openkite::aircraft_controls::ConstPtr &msg)
+{
+    boost::unique_lock<boost::mutex> scoped_lock(m_write_mutex);
+    servo_protocol::controls_to_pulses(msg->thrust, msg->elevator, msg->rudder, msg->ailerons, m_pulses);
+    if(send(msg->header.stamp))
+    {
+        openkite::latency_trace trace = msg->trace;
+        trace.t_serial_write = m_last_sent.toSec();
+        trace_pub.publish(trace);
+    }
+}
+
+void ServoSerialNode::keepaliveCallback(const ros::TimerEvent &event)
+{
+    boost::unique_lock<boost::mutex> scoped_lock(m_write_mutex);
+    if((event.current_real - m_last_sent).toSec() >= (event.current_expected - event.last_expected).toSec())
+        send(ros::Time());
+}
+
+bool ServoSerialNode::send(const ros::Time &stamp)
+{
+    uint8_t buffer[servo_protocol::MAX_FRAME];
+    size_t size = servo_protocol::encode_command(++m_seq, m_pulses, buffer);
+
+    /** stored before the write : the acknowledgement may arrive before write() returns */
+    double queueing = stamp.isZero() ? 0.0 : (ros::Time::now() - stamp).toSec();
+    m_queue_time[m_seq] = queueing;
+    m_send_time[m_seq] = monotonic_seconds();
+    try
+    {
+        port->write(buffer, size);
+    }
+    catch(const std::exception &e)
+    {
+        ROS_ERROR_THROTTLE(1.0, "servo_serial_node: write failed: %s", e.what());
+        return false;
+    }
+    m_last_sent = ros::Time::now();
+
+    if(!stamp.isZero())
+    {
+        boost::unique_lock<boost::mutex> scoped_lock(m_stats_mutex);
+        queue_stats.add(queueing);
+    }
+    return true;
+}
+
+void ServoSerialNode::readLoop()
+{
+    uint8_t buffer[64];
+    servo_protocol::Frame frame;
+    while(m_running && ros::ok())
+    {
+        size_t received = 0;
+        try
+        {
+            /** blocks until at least one byte or the timeout */
+            received = port->read(buffer, 1);
+            if(received > 0)
+            {
+                size_t pending = std::min(port->available(), sizeof(buffer) - 1);
+                if(pending > 0)
+                    received += port->read(buffer + 1, pending);
+            }
+        }
+        catch(const std::exception &e)
+        {
+            ROS_ERROR_THROTTLE(1.0, "servo_serial_node: read failed: %s", e.what());
+            continue;
+        }
+
+        double t_receive = monotonic_seconds();
+        for(size_t i = 0; i < received; ++i)
+        {
+            if(m_parser.push(buffer[i], frame))
+                handleFrame(frame, t_receive);
+        }
+        report(t_receive);
+    }
+}
+
+void ServoSerialNode::handleFrame(const servo_protocol::Frame &frame, const double &t_receive)
+{
+    uint8_t ack;
+    uint16_t pulses[servo_protocol::NUM_CHANNELS];
+    if(!servo_protocol::decode_feedback(frame, ack, pulses))
+        return;
+
+    /** measured RC pulses, same layout as the former rosserial bridge */
+    std_msgs::Int16MultiArray feedback;
+    feedback.data.assign(pulses, pulses + servo_protocol::NUM_CHANNELS);
+    feedback_pub.publish(feedback);
+
+    /** the device answers every command once, periodic feedback repeats the last ack */
+    double sent = m_send_time[ack].exchange(0.0);
+    if(sent <= 0)
+        return;
+
+    double round_trip = t_receive - sent;
+    double queueing = m_queue_time[ack];
+    {
+        boost::unique_lock<boost::mutex> scoped_lock(m_stats_mutex);
+        rtt_stats.add(round_trip);
+    }
+
+    if(latency_pub.getNumSubscribers() > 0)
+    {
+        std_msgs::Float64MultiArray latency;
+        latency.data = {round_trip, queueing};
+        latency_pub.publish(latency);
+    }
+}
+
+void ServoSerialNode::report(const double &now)
+{
+    if(now - m_last_report < report_period)
+        return;
+    m_last_report = now;
+
+    boost::unique_lock<boost::mutex> scoped_lock(m_stats_mutex);
+    ROS_INFO("servo_serial_node: round trip mean %.2f max %.2f [ms] (%zu), queueing mean %.2f max %.2f [ms] (%zu), CRC errors %zu",
+             rtt_stats.mean() * 1e3, rtt_stats.max * 1e3, rtt_stats.count,
+             queue_stats.mean() * 1e3, queue_stats.max * 1e3, queue_stats.count, m_parser.crc_errors());
+    rtt_stats = LatencyStats();
+    queue_stats = LatencyStats();
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "servo_serial_node");
+    ros::NodeHandle n("~");
+    ServoSerialNode driver(n);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef SERVO_SERIAL_NODE_HPP
+#define SERVO_SERIAL_NODE_HPP
+
+#include "ros/ros.h"
+#include "std_msgs/Int16MultiArray.h"
+#include "std_msgs/Float64MultiArray.h"
+#include "openkite/aircraft_controls.h"
+#include "openkite/latency_trace.h"
+#include "boost/thread/mutex.hpp"
+#include "serial/serial.h"
+
+#include "servo_protocol.h"
+#include <atomic>
+#include <thread>
+
+/** Servo driver : writes a CRC-framed command to the PPM generator as soon as a control message arrives
+ *  and republishes the device feedback (measured RC pulses) on /chatter. Replaces control_proxy_node
+ *  and rosserial. Latency [s] is published on "serial_latency" as [round_trip, queueing] : round trip
+ *  from writing a command to its acknowledgement, queueing from the control message stamp to the write
+ *  of the same command (zero for keepalive resends).
+ */
+class ServoSerialNode
+{
+public:
+    ServoSerialNode(const ros::NodeHandle &_nh);
+    virtual ~ServoSerialNode();
+
+    void controlCallback(const openkite::aircraft_controls::ConstPtr &msg);
+    /** resend the last command if no control arrives, keeps the link and the RTT measurement alive */
+    void keepaliveCallback(const ros::TimerEvent &event);
+
+private:
+    std::shared_ptr<ros::NodeHandle> nh;
+    std::shared_ptr<serial::Serial> port;
+
+    ros::Subscriber control_sub;
+    ros::Publisher feedback_pub;
+    ros::Publisher latency_pub;
+    /** latency tracing : the control trace completed with the write time, on /latency_trace */
+    ros::Publisher trace_pub;
+    ros::Timer keepalive_timer;
+
+    boost::mutex m_write_mutex;
+    uint8_t m_seq;
+    uint16_t m_pulses[servo_protocol::NUM_CHANNELS];
+    ros::Time m_last_sent;
+    /** monotonic send time and queueing time of each sequence number, read by the receive thread */
+    std::atomic<double> m_send_time[256];
+    std::atomic<double> m_queue_time[256];
+
+    std::thread read_thread;
+    std::atomic<bool> m_running;
+    servo_protocol::FrameParser m_parser;
+
+    /** running statistics over the report period */
+    struct LatencyStats
+    {
+        LatencyStats() : count(0), sum(0), max(0) {}
+        void add(const double &value){++count; sum += value; max = std::max(max, value);}
+        double mean() const {return count ? sum / count : 0;}
+        size_t count;
+        double sum, max;
+    };
+    LatencyStats rtt_stats, queue_stats;
+    boost::mutex m_stats_mutex;
+    double report_period;
+    double m_last_report;
+
+    bool send(const ros::Time &stamp);
+    void readLoop();
+    void handleFrame(const servo_protocol::Frame &frame, const double &t_receive);
+    void report(const double &now);
+};
+
+#endif // SERVO_SERIAL_NODE_HPP
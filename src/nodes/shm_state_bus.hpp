@@ -0,0 +1,204 @@
+#ifndef SHM_STATE_BUS_HPP
+#define SHM_STATE_BUS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Fixed-layout records exchanged between nodes on the same host.
+ *  sequence and t_monotonic (CLOCK_MONOTONIC, comparable across processes) are set by the bus on write,
+ *  t_stamp is the ROS time the data refers to, e.g. the estimation time stamp
+ */
+struct StateRecord
+{
+    uint64_t sequence;
+    double t_monotonic;
+    double t_stamp;
+    double state[13];   /** [v, w, r, q] as in KiteEKF */
+};
+
+struct ControlRecord
+{
+    uint64_t sequence;
+    double t_monotonic;
+    double t_stamp;
+    double control[4];  /** thrust, elevator, rudder, ailerons */
+};
+
+/** Single writer / multiple reader transport of the latest record through POSIX shared memory.
+ *  The record is protected by a seqlock : the writer never blocks, a reader retries while a write is
+ *  in progress and only ever returns a consistent record. The payload is copied word by word through
+ *  relaxed atomics, so the segment can be shared by unrelated processes. Readers only see the most
+ *  recent record : this replaces a latched topic, not a queue.
+ */
+template<typename Record>
+class ShmStateBus
+{
+public:
+    static_assert(std::is_trivially_copyable<Record>::value, "ShmStateBus: record must be trivially copyable");
+    static_assert(sizeof(Record) % sizeof(uint64_t) == 0, "ShmStateBus: record size must be a multiple of 8 bytes");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "ShmStateBus: 64-bit atomics must be lock free");
+
+    enum Mode {WRITER, READER};
+
+    /** the writer creates (or takes over) the segment "/name", readers fail if it does not exist yet */
+    ShmStateBus(const std::string &name, const Mode &mode);
+    virtual ~ShmStateBus();
+
+    ShmStateBus(const ShmStateBus&) = delete;
+    ShmStateBus& operator=(const ShmStateBus&) = delete;
+
+    /** publish a record, sets its sequence number and monotonic time stamp */
+    void write(Record &record);
+    /** latest consistent record, false if nothing has been written yet */
+    bool read(Record &record) const;
+    /** latest record if its sequence number is newer than last_sequence */
+    bool readNew(Record &record, const uint64_t &last_sequence) const;
+
+    /** remove the segment name, mapped segments stay valid until unmapped */
+    static void unlink(const std::string &name){shm_unlink(("/" + name).c_str());}
+
+    static double monotonic_time()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    enum {WORDS = sizeof(Record) / sizeof(uint64_t), MAGIC = 0x6b697465, MAX_RETRIES = 1000};
+
+    struct Segment
+    {
+        uint32_t magic;
+        uint32_t record_size;
+        alignas(64) std::atomic<uint64_t> lock;
+        std::atomic<uint64_t> data[WORDS];
+    };
+
+    Segment *m_segment;
+    Mode m_mode;
+    uint64_t m_sequence;
+};
+
+template<typename Record>
+ShmStateBus<Record>::ShmStateBus(const std::string &name, const Mode &mode) : m_segment(nullptr), m_mode(mode), m_sequence(0)
+{
+    std::string shm_name = "/" + name;
+    int fd = (mode == WRITER) ? shm_open(shm_name.c_str(), O_CREAT | O_RDWR, 0666) : shm_open(shm_name.c_str(), O_RDWR, 0666);
+    if(fd < 0)
+        throw std::runtime_error("ShmStateBus: could not open shared memory segment: " + name);
+
+    if((mode == WRITER) && (ftruncate(fd, sizeof(Segment)) != 0))
+    {
+        close(fd);
+        throw std::runtime_error("ShmStateBus: could not resize shared memory segment: " + name);
+    }
+
+    struct stat info;
+    if((fstat(fd, &info) != 0) || (static_cast<size_t>(info.st_size) < sizeof(Segment)))
+    {
+        close(fd);
+        throw std::runtime_error("ShmStateBus: shared memory segment is not initialized: " + name);
+    }
+
+    void *address = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(address == MAP_FAILED)
+        throw std::runtime_error("ShmStateBus: could not map shared memory segment: " + name);
+    m_segment = static_cast<Segment*>(address);
+
+    if(mode == WRITER)
+    {
+        /** a restarted writer continues the sequence, readers keep their mapping */
+        uint64_t lock = m_segment->lock.load(std::memory_order_relaxed);
+        if((m_segment->magic != MAGIC) || (m_segment->record_size != sizeof(Record)) || (lock & 1))
+        {
+            m_segment->lock.store(0, std::memory_order_relaxed);
+            for(size_t i = 0; i < WORDS; ++i)
+                m_segment->data[i].store(0, std::memory_order_relaxed);
+            m_segment->record_size = sizeof(Record);
+            m_segment->magic = MAGIC;
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        else
+        {
+            Record last;
+            if(read(last))
+                m_sequence = last.sequence;
+        }
+    }
+    else if((m_segment->magic != MAGIC) || (m_segment->record_size != sizeof(Record)))
+    {
+        munmap(m_segment, sizeof(Segment));
+        throw std::runtime_error("ShmStateBus: record layout mismatch in shared memory segment: " + name);
+    }
+}
+
+template<typename Record>
+ShmStateBus<Record>::~ShmStateBus()
+{
+    if(m_segment)
+        munmap(m_segment, sizeof(Segment));
+}
+
+template<typename Record>
+void ShmStateBus<Record>::write(Record &record)
+{
+    record.sequence = ++m_sequence;
+    record.t_monotonic = monotonic_time();
+
+    uint64_t words[WORDS];
+    std::memcpy(words, &record, sizeof(Record));
+
+    /** odd lock : write in progress */
+    uint64_t lock = m_segment->lock.load(std::memory_order_relaxed);
+    m_segment->lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(size_t i = 0; i < WORDS; ++i)
+        m_segment->data[i].store(words[i], std::memory_order_relaxed);
+    m_segment->lock.store(lock + 2, std::memory_order_release);
+}
+
+template<typename Record>
+bool ShmStateBus<Record>::read(Record &record) const
+{
+    uint64_t words[WORDS];
+    for(int retry = 0; retry < MAX_RETRIES; ++retry)
+    {
+        uint64_t before = m_segment->lock.load(std::memory_order_acquire);
+        if(before & 1)
+            continue;
+        for(size_t i = 0; i < WORDS; ++i)
+            words[i] = m_segment->data[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(m_segment->lock.load(std::memory_order_relaxed) != before)
+            continue;
+
+        std::memcpy(&record, words, sizeof(Record));
+        return record.sequence != 0;
+    }
+    return false;
+}
+
+template<typename Record>
+bool ShmStateBus<Record>::readNew(Record &record, const uint64_t &last_sequence) const
+{
+    Record latest;
+    if(!read(latest) || (latest.sequence == last_sequence))
+        return false;
+    record = latest;
+    return true;
+}
+
+typedef ShmStateBus<StateRecord>   ShmStateChannel;
+typedef ShmStateBus<ControlRecord> ShmControlChannel;
+
+#endif // SHM_STATE_BUS_HPP
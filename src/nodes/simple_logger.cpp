@@ -1,69 +1,67 @@
 #include "ros/ros.h"
 #include "ros/time.h"
-#include "std_msgs/Int32MultiArray.h"
+#include "std_msgs/Int16MultiArray.h"
 #include "geometry_msgs/PoseStamped.h"
 #include "sensor_msgs/MultiDOFJointState.h"
 
+#include "flight_log.h"
 #include "iostream"
-#include "fstream"
+#include "algorithm"
 #include "string.h"
 
 
+/** Records controls, mocap poses and state estimates to binary columnar logs (see flight_log.h).
+ *  Callbacks only copy a row into a queue, files are written by a background thread.
+ *  Logs are read with flight_log_tool or scripts/python/flight_log.py
+ */
 class SimpleLogger
 {
 public:
-    SimpleLogger();
+    SimpleLogger(const std::string &prefix);
     virtual ~SimpleLogger()
     {
-        /** close loggers */
-        control_log.close();
-        pose_log.close();
-        state_log.close();
+        /** flush loggers */
+        logger.close();
     }
 
-    void controlCallback(const std_msgs::Int32MultiArray::ConstPtr& msg);
+    void controlCallback(const std_msgs::Int16MultiArray::ConstPtr& msg);
     void poseCallback(const geometry_msgs::PoseStamped::ConstPtr& msg);
     void stateCallback(const sensor_msgs::MultiDOFJointState::ConstPtr& msg);
 
 private:
-    std::ofstream control_log;
-    std::ofstream pose_log;
-    std::ofstream state_log;
+    flight_log::FlightLogger logger;
+    int control_log;
+    int pose_log;
+    int state_log;
 };
 
-SimpleLogger::SimpleLogger()
+SimpleLogger::SimpleLogger(const std::string &prefix)
 {
     /** create logger files */
-    control_log.open("kite_control.log");
-    pose_log.open("kite_pose.log");
-    state_log.open("kite_state.log");
-
-    if(control_log.is_open())
-        std::cout << "Kite control log file created in the current directory \n";
-
-    if(pose_log.is_open())
-        std::cout << "Kite pose log file created in the current directory \n";
-
-    if(state_log.is_open())
-        std::cout << "Kite state estimation log file created in the current directory \n";
+    control_log = logger.addStream(prefix + "_control.oklog", "control", flight_log::CONTROL_COLUMNS);
+    pose_log    = logger.addStream(prefix + "_pose.oklog", "pose", {"t", "x", "y", "z", "qw", "qx", "qy", "qz"});
+    state_log   = logger.addStream(prefix + "_state.oklog", "state", {"t", "vx", "vy", "vz", "wx", "wy", "wz",
+                                                                    "x", "y", "z", "qw", "qx", "qy", "qz"});
+    std::cout << "Kite log files " << prefix << "_{control, pose, state}.oklog created \n";
 }
 
-void SimpleLogger::controlCallback(const std_msgs::Int32MultiArray::ConstPtr& msg)
+void SimpleLogger::controlCallback(const std_msgs::Int16MultiArray::ConstPtr& msg)
 {
-    /** @badcode: it's not recommended to precess data in callbacks */
-    control_log << std::fixed << std::setprecision(8) << ros::Time::now().toSec() << " ";
-    for (unsigned i = 0; i < 4; ++i)
-    {
-        control_log << msg->data[i] << " ";
-    }
-    control_log << "\n";
+    double row[5];
+    flight_log::control_row(ros::Time::now().toSec(), msg->data, row);
+
+    if(!logger.log(control_log, row))
+        ROS_WARN_THROTTLE(1.0, "simple_logger: control log queue full");
 }
 
 void SimpleLogger::poseCallback(const geometry_msgs::PoseStamped::ConstPtr &msg)
 {
-    pose_log << std::fixed << std::setprecision(8) << msg->header.stamp << " ";
-    pose_log << msg->pose.position.x << " " << msg->pose.position.y << " " << msg->pose.position.z << " "
-             << msg->pose.orientation.w << " " << msg->pose.orientation.x << " " << msg->pose.orientation.y << " " << msg->pose.orientation.z << "\n";
+    double row[8] = {msg->header.stamp.toSec(),
+                     msg->pose.position.x, msg->pose.position.y, msg->pose.position.z,
+                     msg->pose.orientation.w, msg->pose.orientation.x, msg->pose.orientation.y, msg->pose.orientation.z};
+
+    if(!logger.log(pose_log, row))
+        ROS_WARN_THROTTLE(1.0, "simple_logger: pose log queue full");
 }
 
 /** state estimation logger callback */
@@ -71,29 +69,37 @@ void SimpleLogger::stateCallback(const sensor_msgs::MultiDOFJointState::ConstPtr
 {
     if (msg->transforms.empty() || msg->twist.empty())
     {
-        std::cout << "Message came but empty \n";
-    }
-    else
-    {
-        state_log << std::fixed << std::setprecision(8) << msg->header.stamp << " ";
-        state_log << msg->twist[0].linear.x << " " << msg->twist[0].linear.y << " " << msg->twist[0].linear.z << " "
-                                           << msg->twist[0].angular.x << " " << msg->twist[0].angular.y << " " << msg->twist[0].angular.z << " "
-                                           << msg->transforms[0].translation.x << " " << msg->transforms[0].translation.y << " " << msg->transforms[0].translation.z << " "
-                                           << msg->transforms[0].rotation.w << " " << msg->transforms[0].rotation.x
-                                           << " " << msg->transforms[0].rotation.y << " " << msg->transforms[0].rotation.z << "\n";
+        ROS_WARN_THROTTLE(1.0, "simple_logger: state message came but empty");
+        return;
     }
+
+    double row[14] = {msg->header.stamp.toSec(),
+                      msg->twist[0].linear.x, msg->twist[0].linear.y, msg->twist[0].linear.z,
+                      msg->twist[0].angular.x, msg->twist[0].angular.y, msg->twist[0].angular.z,
+                      msg->transforms[0].translation.x, msg->transforms[0].translation.y, msg->transforms[0].translation.z,
+                      msg->transforms[0].rotation.w, msg->transforms[0].rotation.x,
+                      msg->transforms[0].rotation.y, msg->transforms[0].rotation.z};
+
+    if(!logger.log(state_log, row))
+        ROS_WARN_THROTTLE(1.0, "simple_logger: state log queue full");
 }
 
 int main(int argc, char **argv)
 {
-    SimpleLogger logger;
-
     ros::init(argc, argv, "simple_logger");
-    ros::NodeHandle n;
+    ros::NodeHandle n, private_nh("~");
+
+    std::string prefix, control_topic, pose_topic, state_topic;
+    private_nh.param<std::string>("prefix", prefix, "kite");
+    private_nh.param<std::string>("control_topic", control_topic, "chatter");
+    private_nh.param<std::string>("pose_topic", pose_topic, "optitrack_client/RigidBody1/pose");
+    private_nh.param<std::string>("state_topic", state_topic, "kite_state");
+
+    SimpleLogger logger(prefix);
 
-    ros::Subscriber sub_ctrl = n.subscribe("chatter", 100, &SimpleLogger::controlCallback, &logger);
-    ros::Subscriber sub_pose = n.subscribe("optitrack_client/RigidBody1/pose", 100, &SimpleLogger::poseCallback, &logger);
-    ros::Subscriber sub_state = n.subscribe("kite_state", 100, &SimpleLogger::stateCallback, &logger);
+    ros::Subscriber sub_ctrl = n.subscribe(control_topic, 100, &SimpleLogger::controlCallback, &logger);
+    ros::Subscriber sub_pose = n.subscribe(pose_topic, 100, &SimpleLogger::poseCallback, &logger);
+    ros::Subscriber sub_state = n.subscribe(state_topic, 100, &SimpleLogger::stateCallback, &logger);
 
     ros::spin();
     return 0;
@@ -7,22 +7,43 @@
 
 #include <vector>
 #include <unordered_set>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
 
 namespace
 {
   std::unordered_set<std::string> name_blacklist_({"VRPN Control"});
+
+  double monotonic_seconds()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /** SCHED_FIFO priority for a receive thread, requires CAP_SYS_NICE */
+  void set_realtime_priority(std::thread &thread, const int &priority)
+  {
+    if (priority <= 0)
+      return;
+
+    sched_param param;
+    param.sched_priority = priority;
+    int error = pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+    if (error != 0)
+      ROS_WARN("Could not set the VRPN thread priority to %d : %s", priority, strerror(error));
+  }
 }
 
 namespace vrpn_client_ros
 {
 
-  VrpnTrackerRos::VrpnTrackerRos(std::string tracker_name, ConnectionPtr connection, ros::NodeHandle nh)
+  VrpnTrackerRos::VrpnTrackerRos(std::string tracker_name, ConnectionPtr connection, ros::NodeHandle nh) : ring_(nullptr)
   {
     tracker_remote_ = std::make_shared<vrpn_Tracker_Remote>(tracker_name.c_str(), connection.get());
     init(tracker_name, nh, false);
   }
 
-  VrpnTrackerRos::VrpnTrackerRos(std::string tracker_name, std::string host, ros::NodeHandle nh)
+  VrpnTrackerRos::VrpnTrackerRos(std::string tracker_name, std::string host, ros::NodeHandle nh) : ring_(nullptr)
   {
     std::string tracker_address;
     tracker_address = tracker_name + "@" + host;
@@ -57,6 +78,9 @@ namespace vrpn_client_ros
 
     pose_msg_.header.frame_id = frame_id;
 
+    if (!process_sensor_id_)
+      pose_pubs_ = output_nh_.advertise<geometry_msgs::PoseStamped>("pose", 1);
+
     if (create_mainloop_timer)
     {
       double update_frequency;
@@ -79,59 +103,70 @@ namespace vrpn_client_ros
 
   void VRPN_CALLBACK VrpnTrackerRos::handle_pose(void *userData, const vrpn_TRACKERCB tracker_pose)
   {
-
     VrpnTrackerRos *tracker = static_cast<VrpnTrackerRos *>(userData);
 
-    ros::Publisher *pose_pub;
-    //std::size_t sensor_index(0);
-    ros::NodeHandle nh = tracker->output_nh_;
+    PoseSample sample;
+    sample.source = tracker;
+    sample.t_monotonic = monotonic_seconds();
+    sample.t_ros = ros::Time::now().toSec();
+    sample.t_server = tracker_pose.msg_time.tv_sec + 1e-6 * tracker_pose.msg_time.tv_usec;
+    sample.sensor = tracker_pose.sensor;
+    std::copy(tracker_pose.pos, tracker_pose.pos + 3, sample.pos);
+    std::copy(tracker_pose.quat, tracker_pose.quat + 4, sample.quat);
 
-    if (tracker->process_sensor_id_)
+    //ROS_INFO("POS [%f %f %f] ATT [%f %f %f %f] \n", tracker_pose.pos[0], tracker_pose.pos[1], tracker_pose.pos[2],
+    //        tracker_pose.quat[0], tracker_pose.quat[1], tracker_pose.quat[2], tracker_pose.quat[3]);
+
+    if (tracker->ring_ == nullptr)
     {
-      //sensor_index = static_cast<std::size_t>(tracker_pose.sensor);
-      nh = ros::NodeHandle(tracker->output_nh_, std::to_string(tracker_pose.sensor));
+      tracker->publish(sample);
     }
-
-    pose_pub = &(tracker->pose_pubs_);
-
-    if (pose_pub->getTopic().empty())
+    else if (!tracker->ring_->push(sample))
     {
-      *pose_pub = nh.advertise<geometry_msgs::PoseStamped>("pose", 1);
+      ROS_WARN_THROTTLE(1.0, "VRPN pose ring is full, %zu samples dropped", tracker->ring_->dropped());
     }
+  }
 
-    //ROS_INFO("POS [%f %f %f] ATT [%f %f %f %f] \n", tracker_pose.pos[0], tracker_pose.pos[1], tracker_pose.pos[2],
-    //        tracker_pose.quat[0], tracker_pose.quat[1], tracker_pose.quat[2], tracker_pose.quat[3]);
+  void VrpnTrackerRos::publish(const PoseSample &sample)
+  {
+    ros::Publisher *pose_pub = &pose_pubs_;
 
-    if (pose_pub->getNumSubscribers() > 0)
+    if (process_sensor_id_)
     {
-      if (tracker->use_server_time_)
+      pose_pub = &sensor_pubs_[sample.sensor];
+      if (pose_pub->getTopic().empty())
       {
-        tracker->pose_msg_.header.stamp.sec = tracker_pose.msg_time.tv_sec;
-        tracker->pose_msg_.header.stamp.nsec = tracker_pose.msg_time.tv_usec * 1000;
+        ros::NodeHandle nh(output_nh_, std::to_string(sample.sensor));
+        *pose_pub = nh.advertise<geometry_msgs::PoseStamped>("pose", 1);
       }
+    }
+
+    if (pose_pub->getNumSubscribers() > 0)
+    {
+      if (use_server_time_)
+        pose_msg_.header.stamp.fromSec(sample.t_server);
       else
-      {
-        tracker->pose_msg_.header.stamp = ros::Time::now();
-      }
+        pose_msg_.header.stamp.fromSec(sample.t_ros);
 
-      tracker->pose_msg_.pose.position.x = tracker_pose.pos[0];
-      tracker->pose_msg_.pose.position.y = tracker_pose.pos[1];
-      tracker->pose_msg_.pose.position.z = tracker_pose.pos[2];
+      pose_msg_.pose.position.x = sample.pos[0];
+      pose_msg_.pose.position.y = sample.pos[1];
+      pose_msg_.pose.position.z = sample.pos[2];
 
-      tracker->pose_msg_.pose.orientation.x = tracker_pose.quat[0];
-      tracker->pose_msg_.pose.orientation.y = tracker_pose.quat[1];
-      tracker->pose_msg_.pose.orientation.z = tracker_pose.quat[2];
-      tracker->pose_msg_.pose.orientation.w = tracker_pose.quat[3];
+      pose_msg_.pose.orientation.x = sample.quat[0];
+      pose_msg_.pose.orientation.y = sample.quat[1];
+      pose_msg_.pose.orientation.z = sample.quat[2];
+      pose_msg_.pose.orientation.w = sample.quat[3];
 
       //ROS_INFO_STREAM("optitrack: caught a measurement");
 
-      pose_pub->publish(tracker->pose_msg_);
+      pose_pub->publish(pose_msg_);
     }
   }
 
   //-----------------------------------------------------------------//
 
-  VrpnClientRos::VrpnClientRos(ros::NodeHandle nh, ros::NodeHandle private_nh)
+  VrpnClientRos::VrpnClientRos(ros::NodeHandle nh, ros::NodeHandle private_nh, const PoseCallback &callback)
+    : pose_callback_(callback), running_(false)
   {
     output_nh_ = private_nh;
 
@@ -141,9 +176,14 @@ namespace vrpn_client_ros
     connection_ = std::shared_ptr<vrpn_Connection>(vrpn_get_connection_by_name(host_.c_str()));
     ROS_INFO("Connection established");
 
-    double update_frequency;
-    private_nh.param<double>("update_frequency", update_frequency, 50.0);
-    mainloop_timer = nh.createTimer(ros::Duration(1 / update_frequency), boost::bind(&VrpnClientRos::mainloop, this));
+    bool receive_thread;
+    private_nh.param<bool>("receive_thread", receive_thread, false);
+    if (!receive_thread)
+    {
+      double update_frequency;
+      private_nh.param<double>("update_frequency", update_frequency, 50.0);
+      mainloop_timer = nh.createTimer(ros::Duration(1 / update_frequency), boost::bind(&VrpnClientRos::mainloop, this));
+    }
 
     double refresh_tracker_frequency;
     private_nh.param<double>("refresh_tracker_frequency", refresh_tracker_frequency, 0.0);
@@ -154,6 +194,32 @@ namespace vrpn_client_ros
     private_nh.param<std::string>("trackers",param_tracker_name_,"Kite");
     trackers_.insert(std::make_pair(param_tracker_name_,
                                     std::make_shared<VrpnTrackerRos>(param_tracker_name_, connection_, output_nh_)));
+
+    if (receive_thread)
+    {
+      int priority;
+      private_nh.param<double>("receive_timeout", receive_timeout_, 0.01);
+      private_nh.param<int>("dispatch_period_us", dispatch_period_us_, 100);
+      private_nh.param<int>("receive_thread_priority", priority, 0);
+
+      for (TrackerMap::iterator it = trackers_.begin(); it != trackers_.end(); ++it)
+        it->second->setRing(&ring_);
+
+      running_ = true;
+      dispatch_thread_ = std::thread(&VrpnClientRos::dispatchLoop, this);
+      receive_thread_ = std::thread(&VrpnClientRos::receiveLoop, this);
+      set_realtime_priority(receive_thread_, priority);
+      ROS_INFO("VRPN receive thread started");
+    }
+  }
+
+  VrpnClientRos::~VrpnClientRos()
+  {
+    running_ = false;
+    if (receive_thread_.joinable())
+      receive_thread_.join();
+    if (dispatch_thread_.joinable())
+      dispatch_thread_.join();
   }
 
   std::string VrpnClientRos::getHostStringFromParams(ros::NodeHandle host_nh)
@@ -185,4 +251,42 @@ namespace vrpn_client_ros
     }
   }
 
+  void VrpnClientRos::receiveLoop()
+  {
+    /** block on the socket until a packet arrives or the timeout expires, handlers run in this thread */
+    while (running_)
+    {
+      timeval timeout;
+      timeout.tv_sec = static_cast<long>(receive_timeout_);
+      timeout.tv_usec = static_cast<long>(1e6 * (receive_timeout_ - timeout.tv_sec));
+      connection_->mainloop(&timeout);
+
+      if (!connection_->doing_okay())
+      {
+        ROS_WARN_THROTTLE(1.0, "VRPN connection is not 'doing okay'");
+      }
+      for (TrackerMap::iterator it = trackers_.begin(); it != trackers_.end(); ++it)
+      {
+        it->second->mainloop();
+      }
+    }
+  }
+
+  void VrpnClientRos::dispatchLoop()
+  {
+    PoseSample sample;
+    while (running_)
+    {
+      if (!ring_.pop(sample))
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(dispatch_period_us_));
+        continue;
+      }
+
+      if (pose_callback_)
+        pose_callback_(sample.source->name(), sample);
+      sample.source->publish(sample);
+    }
+  }
+
 }  // namespace vrpn_client_ros
@@ -7,6 +7,12 @@
 #include <vrpn_Tracker.h>
 #include <vrpn_Connection.h>
 #include <string>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "spsc_ring.hpp"
 
 #define DEFAULT_OPTITRACK_PORT 3883
 
@@ -17,6 +23,25 @@ namespace vrpn_client_ros
   typedef std::shared_ptr<vrpn_Connection> ConnectionPtr;
   typedef std::shared_ptr<vrpn_Tracker_Remote> TrackerRemotePtr;
 
+  class VrpnTrackerRos;
+
+  /**
+   * Pose sample handed over from the VRPN receive thread, stamped on reception
+   */
+  struct PoseSample
+  {
+    VrpnTrackerRos *source;
+    double t_monotonic;  /** steady clock at reception [s] */
+    double t_server;     /** VRPN server time [s] */
+    double t_ros;        /** ROS time at reception [s] */
+    int sensor;
+    double pos[3];
+    double quat[4];      /** x, y, z, w */
+  };
+
+  typedef SPSCRing<PoseSample, 256> PoseRing;
+  typedef std::function<void(const std::string &tracker_name, const PoseSample &sample)> PoseCallback;
+
   class VrpnTrackerRos
   {
   public:
@@ -41,10 +66,24 @@ namespace vrpn_client_ros
      */
     void mainloop();
 
+    /**
+     * Hand received poses over to the ring instead of publishing them from the VRPN callback
+     */
+    void setRing(PoseRing *ring){ring_ = ring;}
+
+    /**
+     * Publish a received pose, stamped with the reception or the server time
+     */
+    void publish(const PoseSample &sample);
+
+    const std::string& name() const {return tracker_name;}
+
   private:
     TrackerRemotePtr tracker_remote_;
     ros::Publisher pose_pubs_;
+    std::map<int, ros::Publisher> sensor_pubs_;
     ros::NodeHandle output_nh_;
+    PoseRing *ring_;
     bool use_server_time_, broadcast_tf_, process_sensor_id_;
     std::string tracker_name;
 
@@ -65,9 +104,13 @@ namespace vrpn_client_ros
     typedef std::map<std::string, VrpnTrackerRos::Ptr> TrackerMap;
 
     /**
-     * Create and initialize VrpnClientRos object in the private_nh namespace.
+     * Create and initialize VrpnClientRos object in the private_nh namespace. With the "receive_thread" parameter
+     * set, a dedicated thread blocks on the VRPN socket and poses are passed through a lock-free ring to a dispatch
+     * thread which calls the in-process callback (if any) and publishes; otherwise the connection is polled
+     * from a timer at "update_frequency".
      */
-    VrpnClientRos(ros::NodeHandle nh, ros::NodeHandle private_nh);
+    VrpnClientRos(ros::NodeHandle nh, ros::NodeHandle private_nh, const PoseCallback &callback = PoseCallback());
+    ~VrpnClientRos();
 
     static std::string getHostStringFromParams(ros::NodeHandle host_nh);
 
@@ -96,6 +139,19 @@ namespace vrpn_client_ros
     TrackerMap trackers_;
 
     ros::Timer refresh_tracker_timer_, mainloop_timer;
+
+    /**
+     * Receive / dispatch threads
+     */
+    PoseRing ring_;
+    PoseCallback pose_callback_;
+    std::atomic<bool> running_;
+    std::thread receive_thread_, dispatch_thread_;
+    double receive_timeout_;
+    int dispatch_period_us_;
+
+    void receiveLoop();
+    void dispatchLoop();
   };
 }  // namespace vrpn_client_ros
 
@@ -0,0 +1,70 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+/** Lock-free single producer / single consumer ring buffer of fixed capacity.
+ *  push() may only be called from one thread and pop() from one (other) thread; the indices
+ *  are free running counters on separate cache lines, the capacity must be a power of two.
+ *  When the ring is full push() fails and the element is dropped : the producer is never blocked.
+ */
+template<typename T, size_t N>
+class SPSCRing
+{
+public:
+    static_assert((N >= 2) && ((N & (N - 1)) == 0), "SPSCRing: capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "SPSCRing: element type must be trivially copyable");
+
+    SPSCRing() : m_head(0), m_tail(0), m_dropped(0) {}
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    /** producer side */
+    bool push(const T &value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if(head - m_tail.load(std::memory_order_acquire) >= N)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_buffer[head & MASK] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** consumer side */
+    bool pop(T &value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail == m_head.load(std::memory_order_acquire))
+            return false;
+        value = m_buffer[tail & MASK];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** approximate when called concurrently */
+    size_t size() const {return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);}
+    bool empty() const {return size() == 0;}
+    static constexpr size_t capacity() {return N;}
+    /** number of elements rejected because the ring was full */
+    size_t dropped() const {return m_dropped.load(std::memory_order_relaxed);}
+
+private:
+    enum {MASK = N - 1, CACHE_LINE = 64};
+
+    /** padding instead of alignas : the ring can be heap allocated without over-aligned new */
+    char m_pad0[CACHE_LINE];
+    std::atomic<size_t> m_head;
+    char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+    char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dropped;
+    char m_pad3[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    T m_buffer[N];
+};
+
+#endif // SPSC_RING_HPP
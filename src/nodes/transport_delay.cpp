@@ -1,98 +1,114 @@
 #include "ros/ros.h"
-#include "boost/thread.hpp"
-#include "boost/thread/mutex.hpp"
-#include "boost/circular_buffer.hpp"
-#include "boost/date_time/posix_time/posix_time.hpp"
 #include "openkite/aircraft_controls.h"
-#include <random>
-
+#include "delay_channel.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/** Emulates the radio link between the controller and the kite : /controls is republished on /delayed_control
+ *  after a random transport delay. Messages are scheduled independently (see delay_channel.hpp) so slow
+ *  messages do not hold back the following ones.
+ *  params : distribution (constant | uniform | normal | empirical), delay and deviation [ms],
+ *           histogram (file of measured delays [ms], one per line, for the empirical distribution), bins,
+ *           loss (probability), reorder, seed (0 : random)
+ */
 class TDelay
 {
 public:
     TDelay(const ros::NodeHandle &n);
-    virtual ~TDelay(){}
-
-    /** main loop */
-    int  getNumPublishers(){return sub.getNumPublishers();}
-    void run_publisher();
+    virtual ~TDelay();
 
 private:
-    double delay_mean;
-    double delay_deviation;
-    double loop_rate;
+    typedef std::chrono::steady_clock Clock;
 
-    std::random_device rndev;
-    std::mt19937 generator;
-    std::uniform_real_distribution<> distribution;
+    std::shared_ptr<DelayChannel<openkite::aircraft_controls>> channel;
+    Clock::time_point t_start;
 
-    boost::circular_buffer<openkite::aircraft_controls> buffer;
-    boost::thread pub_thread;
-    boost::mutex  m_mutex;
+    std::thread pub_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_running;
 
     std::shared_ptr<ros::NodeHandle> nh;
     ros::Publisher  pub;
     ros::Subscriber sub;
 
-    void inputCallback(const openkite::aircraft_controls::Ptr &input);
+    double now() const {return std::chrono::duration<double>(Clock::now() - t_start).count();}
+    void inputCallback(const openkite::aircraft_controls::ConstPtr &input);
     void publish();
 };
 
-TDelay::TDelay(const ros::NodeHandle &n)
+TDelay::TDelay(const ros::NodeHandle &n) : m_running(true)
 {
     nh = std::make_shared<ros::NodeHandle>(n);
 
+    double delay_mean, delay_deviation, loss;
+    std::string distribution, histogram;
+    int bins, seed;
+    bool reorder;
+    nh->param<std::string>("distribution", distribution, "uniform");
     nh->param<double>("delay", delay_mean, 20.0);
     nh->param<double>("deviation", delay_deviation, 5.0);
-    nh->param<double>("rate", loop_rate, 5.0);
-
-    pub = nh->advertise<openkite::aircraft_controls>("/delayed_control", 100);
-    sub = nh->subscribe("/controls", 100, &TDelay::inputCallback, this);
-
-    pub_thread = boost::thread(boost::bind(&TDelay::publish, this));
-    buffer.set_capacity(2);
-
-    generator = std::mt19937(rndev());
-    double lower_bound = (delay_mean - delay_deviation > 0) ? (delay_mean - delay_deviation) : 0;
-    double upper_bound = delay_mean + delay_deviation;
-    distribution     = std::uniform_real_distribution<>(lower_bound, upper_bound);
+    nh->param<std::string>("histogram", histogram, "");
+    nh->param<int>("bins", bins, 50);
+    nh->param<double>("loss", loss, 0.0);
+    nh->param<bool>("reorder", reorder, false);
+    nh->param<int>("seed", seed, 0);
+
+    DelayModel model = (distribution == "empirical") ? DelayModel::fromFile(histogram, 1e-3, bins) :
+                        DelayModel(DelayModel::distribution(distribution), 1e-3 * delay_mean, 1e-3 * delay_deviation);
+    channel = std::make_shared<DelayChannel<openkite::aircraft_controls>>(model, (seed != 0) ? seed : std::random_device()());
+    channel->setLoss(loss);
+    channel->setReorder(reorder);
+    t_start = Clock::now();
+
+    pub = nh->advertise<openkite::aircraft_controls>("/delayed_control", 1000);
+    sub = nh->subscribe("/controls", 1000, &TDelay::inputCallback, this, ros::TransportHints().tcpNoDelay());
+
+    pub_thread = std::thread(&TDelay::publish, this);
 }
 
-void TDelay::inputCallback(const openkite::aircraft_controls::Ptr &input)
+TDelay::~TDelay()
 {
-    boost::mutex::scoped_try_lock lock(m_mutex);
-    if(lock)
     {
-        buffer.push_back(*input);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
     }
+    m_wakeup.notify_one();
+    pub_thread.join();
 }
 
-void TDelay::run_publisher()
+void TDelay::inputCallback(const openkite::aircraft_controls::ConstPtr &input)
 {
-    pub_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!channel->push(*input, now()))
+            return;
+    }
+    /** the new message may be due before the one the publisher is waiting for */
+    m_wakeup.notify_one();
 }
 
 void TDelay::publish()
 {
     openkite::aircraft_controls msg;
-    while (ros::ok())
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_running && ros::ok())
     {
-        if(!buffer.empty())
+        /** deliver everything due, publishing outside the lock */
+        while(channel->pop(msg, now()))
         {
-            double _delay = distribution(generator);
-            {
-                /** take an element of the queue publish it and delete */
-                boost::mutex::scoped_lock lock(m_mutex);
-                msg = buffer.front();
-                buffer.pop_front();
-            }
-            boost::this_thread::sleep(boost::posix_time::milliseconds(_delay));
+            lock.unlock();
             msg.header.stamp = ros::Time::now();
             pub.publish(msg);
+            lock.lock();
         }
-        else
-        {
-            boost::this_thread::sleep(boost::posix_time::milliseconds(1000 / loop_rate ));
-        }
+
+        /** sleep until the next delivery or a new message, bounded to notice shutdown */
+        double wait = std::min(channel->nextDelivery() - now(), 0.1);
+        m_wakeup.wait_for(lock, std::chrono::duration<double>(std::max(0.0, wait)));
     }
 }
 
@@ -101,26 +117,8 @@ int main(int argc, char** argv)
     ros::init(argc, argv, "transport_delay");
     ros::NodeHandle handle;
 
-    double rate;
-    handle.param<double>("rate", rate, 40);
-
     TDelay transport_delay(handle);
-    ros::Rate loop_rate(rate);
-
-    while(ros::ok())
-    {
-        if(transport_delay.getNumPublishers())
-        {
-            ros::spinOnce();
-            loop_rate.sleep();
-        }
-        else
-        {
-            loop_rate.sleep();
-        }
-    }
-
-    transport_delay.run_publisher();
+    ros::spin();
 
     return 0;
 }